@@ -0,0 +1,33 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifndef WL_DIST
+namespace
+{
+	thread_local uint64_t s_thread_allocations = 0;
+	std::atomic<uint64_t> s_total_allocations = 0;
+
+	void* Allocate(std::size_t size) {
+		s_thread_allocations++;
+		s_total_allocations.fetch_add(1, std::memory_order_relaxed);
+		if (void* ptr = std::malloc(size ? size : 1))
+			return ptr;
+		throw std::bad_alloc();
+	}
+}
+
+void* operator new(std::size_t size) { return Allocate(size); }
+void* operator new[](std::size_t size) { return Allocate(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+uint64_t AllocationCounter::GetThreadAllocations() { return s_thread_allocations; }
+uint64_t AllocationCounter::GetTotalAllocations() { return s_total_allocations; }
+#else
+uint64_t AllocationCounter::GetThreadAllocations() { return 0; }
+uint64_t AllocationCounter::GetTotalAllocations() { return 0; }
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// counts heap allocations made through operator new, used to keep the per frame ui code allocation free.
+// the counters are only maintained in non dist builds
+namespace AllocationCounter
+{
+	// allocations made by the calling thread so far
+	uint64_t GetThreadAllocations();
+	// allocations made by all threads so far
+	uint64_t GetTotalAllocations();
+}
@@ -0,0 +1,71 @@
+#include "AsyncFileWriter.h"
+#include <chrono>
+#include <cstring>
+
+bool AsyncFileWriter::Open(const std::filesystem::path& path, uint32_t ring_size) {
+	Close();
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	ring.resize(ring_size);
+	head = 0;
+	tail = 0;
+	bytesWritten = 0;
+	closing = false;
+	writer = std::thread(&AsyncFileWriter::Drain, this);
+	return true;
+}
+
+void AsyncFileWriter::Close() {
+	if (!writer.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	wake.notify_one();
+	writer.join();
+	file.close();
+}
+
+bool AsyncFileWriter::Write(const void* data, uint32_t size) {
+	const uint32_t ring_size = (uint32_t)ring.size();
+	const uint64_t h = head.load(std::memory_order_relaxed);
+	if (ring_size - (h - tail.load(std::memory_order_acquire)) < size)
+		return false;
+	const uint32_t offset = (uint32_t)(h & (ring_size - 1));
+	const uint32_t first = size < ring_size - offset ? size : ring_size - offset;
+	memcpy(ring.data() + offset, data, first);
+	memcpy(ring.data(), (const uint8_t*)data + first, size - first);
+	head.store(h + size, std::memory_order_release);
+	return true;
+}
+
+void AsyncFileWriter::Drain() {
+	const uint32_t ring_size = (uint32_t)ring.size();
+	for (;;) {
+		bool stop;
+		{
+			// the producer never notifies, the writer polls unless it is woken up to close
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait_for(lock, std::chrono::milliseconds(10), [this]() { return closing; });
+			stop = closing;
+		}
+
+		const uint64_t t = tail.load(std::memory_order_relaxed);
+		const uint64_t h = head.load(std::memory_order_acquire);
+		if (h - t >= c_write_size || (stop && h != t)) {
+			// at most two sequential writes, one if the data does not wrap around
+			const uint32_t offset = (uint32_t)(t & (ring_size - 1));
+			const uint32_t size = (uint32_t)(h - t);
+			const uint32_t first = size < ring_size - offset ? size : ring_size - offset;
+			file.write((const char*)ring.data() + offset, first);
+			file.write((const char*)ring.data(), size - first);
+			tail.store(h, std::memory_order_release);
+			bytesWritten.fetch_add(size, std::memory_order_relaxed);
+		}
+		if (stop)
+			break;
+	}
+	file.flush();
+}
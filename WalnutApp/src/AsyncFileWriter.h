@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// bounded single producer/single consumer byte ring in front of a file. the producer (usually the run thread) never
+// waits for the disk: Write fails if the ring is full and the caller decides what to drop. a writer thread drains the
+// ring in large sequential writes.
+class AsyncFileWriter
+{
+public:
+	~AsyncFileWriter() { Close(); }
+
+	// ring_size has to be a power of two
+	bool Open(const std::filesystem::path& path, uint32_t ring_size = 1 << 22);
+	// writes what is left in the ring and closes the file. the producer must not write anymore
+	void Close();
+	bool IsOpen() const { return writer.joinable(); }
+
+	// producer side, false (and nothing written) if the ring does not have size bytes free
+	bool Write(const void* data, uint32_t size);
+	uint64_t GetBytesWritten() const { return bytesWritten.load(std::memory_order_relaxed); }
+private:
+	static constexpr uint32_t c_write_size = 1 << 16; // the writer waits for this much unless it is closing
+
+	void Drain();
+
+	std::vector<uint8_t> ring;
+	std::atomic<uint64_t> head = 0; // written by the producer
+	std::atomic<uint64_t> tail = 0; // written by the writer thread
+
+	std::ofstream file;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool closing = false;
+	std::atomic<uint64_t> bytesWritten = 0;
+};
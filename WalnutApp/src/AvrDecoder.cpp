@@ -0,0 +1,361 @@
+#include "AvrDecoder.h"
+#include <cstdio>
+
+namespace
+{
+	constexpr const char* c_mnemonics[] = {
+		"???",
+		"nop", "movw", "muls", "mulsu", "fmul", "fmuls", "fmulsu",
+		"cpc", "sbc", "add", "cpse", "cp", "sub", "adc", "and", "eor", "or", "mov", "mul",
+		"cpi", "sbci", "subi", "ori", "andi", "ldi",
+		"ld", "ldd", "lds", "st", "std", "sts", "lpm", "elpm", "spm", "xch", "las", "lac", "lat", "pop", "push",
+		"com", "neg", "swap", "inc", "dec", "asr", "lsr", "ror",
+		"bset", "bclr", "bld", "bst", "des",
+		"ret", "reti", "sleep", "break", "wdr",
+		"ijmp", "eijmp", "icall", "eicall", "jmp", "call", "rjmp", "rcall", "brbs", "brbc",
+		"adiw", "sbiw", "cbi", "sbi", "sbic", "sbis", "sbrc", "sbrs",
+		"in", "out",
+	};
+	static_assert(sizeof(c_mnemonics) / sizeof(c_mnemonics[0]) == (size_t)Mnemonic::Count);
+
+	// indexed by SREG bit
+	constexpr const char* c_bset[] = { "sec", "sez", "sen", "sev", "ses", "seh", "set", "sei" };
+	constexpr const char* c_bclr[] = { "clc", "clz", "cln", "clv", "cls", "clh", "clt", "cli" };
+	constexpr const char* c_brbs[] = { "brcs", "breq", "brmi", "brvs", "brlt", "brhs", "brts", "brie" };
+	constexpr const char* c_brbc[] = { "brcc", "brne", "brpl", "brvc", "brge", "brhc", "brtc", "brid" };
+
+	constexpr const char* c_pointers[] = { "", "X", "X+", "-X", "Y", "Y+", "-Y", "Y+", "Z", "Z+", "-Z", "Z+" };
+
+	// register fields of the common "rd dddd rrrr" encoding
+	constexpr uint8_t Rd5(uint16_t w) { return (w >> 4) & 0x1F; }
+	constexpr uint8_t Rr5(uint16_t w) { return (w & 0xF) | ((w >> 5) & 0x10); }
+	constexpr uint8_t K8(uint16_t w) { return ((w >> 4) & 0xF0) | (w & 0xF); }
+
+	constexpr uint32_t RelativeTarget(uint32_t address, int32_t k) {
+		return (uint32_t)((int32_t)address + 1 + k) & 0x3FFFFF;
+	}
+
+	instruction_t Make(Mnemonic mnemonic, uint8_t d = 0, uint8_t r = 0, int32_t k = 0, uint8_t flags = 0) {
+		instruction_t i;
+		i.mnemonic = mnemonic;
+		i.d = d;
+		i.r = r;
+		i.k = k;
+		i.flags = flags;
+		return i;
+	}
+
+	instruction_t MakePointer(Mnemonic mnemonic, uint8_t reg, Pointer pointer, uint8_t flags, int32_t q = 0) {
+		instruction_t i = Make(mnemonic, reg, reg, q, flags);
+		i.pointer = pointer;
+		return i;
+	}
+
+	// 1001 00xr rrrr xxxx
+	instruction_t Decode1001_00(uint16_t w, uint16_t next) {
+		const uint8_t reg = Rd5(w);
+		const bool store = w & 0x0200;
+		const uint8_t access = store ? InstructionFlags::Store : InstructionFlags::Load;
+		const Mnemonic ld_st = store ? Mnemonic::ST : Mnemonic::LD;
+		switch (w & 0xF) {
+		case 0x0: {
+			instruction_t i = Make(store ? Mnemonic::STS : Mnemonic::LDS, reg, reg, next, access);
+			i.length = 2;
+			return i;
+		}
+		case 0x1: return MakePointer(ld_st, reg, Pointer::ZInc, access);
+		case 0x2: return MakePointer(ld_st, reg, Pointer::ZDec, access);
+		case 0x4: return store ? MakePointer(Mnemonic::XCH, reg, Pointer::Z, InstructionFlags::Load | InstructionFlags::Store) : MakePointer(Mnemonic::LPM, reg, Pointer::Z, 0);
+		case 0x5: return store ? MakePointer(Mnemonic::LAS, reg, Pointer::Z, InstructionFlags::Load | InstructionFlags::Store) : MakePointer(Mnemonic::LPM, reg, Pointer::ZInc, 0);
+		case 0x6: return store ? MakePointer(Mnemonic::LAC, reg, Pointer::Z, InstructionFlags::Load | InstructionFlags::Store) : MakePointer(Mnemonic::ELPM, reg, Pointer::Z, 0);
+		case 0x7: return store ? MakePointer(Mnemonic::LAT, reg, Pointer::Z, InstructionFlags::Load | InstructionFlags::Store) : MakePointer(Mnemonic::ELPM, reg, Pointer::ZInc, 0);
+		case 0x9: return MakePointer(ld_st, reg, Pointer::YInc, access);
+		case 0xA: return MakePointer(ld_st, reg, Pointer::YDec, access);
+		case 0xC: return MakePointer(ld_st, reg, Pointer::X, access);
+		case 0xD: return MakePointer(ld_st, reg, Pointer::XInc, access);
+		case 0xE: return MakePointer(ld_st, reg, Pointer::XDec, access);
+		case 0xF: return Make(store ? Mnemonic::PUSH : Mnemonic::POP, reg, reg, 0, access);
+		}
+		return {};
+	}
+
+	// 1001 010x xxxx xxxx
+	instruction_t Decode1001_010(uint16_t w, uint16_t next) {
+		const uint8_t reg = Rd5(w);
+		switch (w & 0xF) {
+		case 0x0: return Make(Mnemonic::COM, reg);
+		case 0x1: return Make(Mnemonic::NEG, reg);
+		case 0x2: return Make(Mnemonic::SWAP, reg);
+		case 0x3: return Make(Mnemonic::INC, reg);
+		case 0x5: return Make(Mnemonic::ASR, reg);
+		case 0x6: return Make(Mnemonic::LSR, reg);
+		case 0x7: return Make(Mnemonic::ROR, reg);
+		case 0xA: return Make(Mnemonic::DEC, reg);
+		case 0xC: case 0xD: case 0xE: case 0xF: {
+			const bool call = w & 0x2;
+			instruction_t i = Make(call ? Mnemonic::CALL : Mnemonic::JMP, 0, 0, 0, call ? InstructionFlags::Call : InstructionFlags::Jump);
+			i.length = 2;
+			i.target = ((uint32_t)(((w >> 3) & 0x3E) | (w & 0x1)) << 16) | next;
+			return i;
+		}
+		}
+
+		switch (w) {
+		case 0x9409: return Make(Mnemonic::IJMP, 0, 0, 0, InstructionFlags::Jump | InstructionFlags::Indirect);
+		case 0x9419: return Make(Mnemonic::EIJMP, 0, 0, 0, InstructionFlags::Jump | InstructionFlags::Indirect);
+		case 0x9509: return Make(Mnemonic::ICALL, 0, 0, 0, InstructionFlags::Call | InstructionFlags::Indirect);
+		case 0x9519: return Make(Mnemonic::EICALL, 0, 0, 0, InstructionFlags::Call | InstructionFlags::Indirect);
+		case 0x9508: return Make(Mnemonic::RET, 0, 0, 0, InstructionFlags::Return);
+		case 0x9518: return Make(Mnemonic::RETI, 0, 0, 0, InstructionFlags::Return);
+		case 0x9588: return Make(Mnemonic::SLEEP);
+		case 0x9598: return Make(Mnemonic::BREAK);
+		case 0x95A8: return Make(Mnemonic::WDR);
+		case 0x95C8: return MakePointer(Mnemonic::LPM, 0, Pointer::None, 0);
+		case 0x95D8: return MakePointer(Mnemonic::ELPM, 0, Pointer::None, 0);
+		case 0x95E8: return MakePointer(Mnemonic::SPM, 0, Pointer::Z, 0);
+		case 0x95F8: return MakePointer(Mnemonic::SPM, 0, Pointer::ZInc, 0);
+		}
+
+		if ((w & 0xFF8F) == 0x9408)
+			return Make(Mnemonic::BSET, (w >> 4) & 0x7);
+		if ((w & 0xFF8F) == 0x9488)
+			return Make(Mnemonic::BCLR, (w >> 4) & 0x7);
+		if ((w & 0xFF0F) == 0x940B)
+			return Make(Mnemonic::DES, 0, 0, (w >> 4) & 0xF);
+		return {};
+	}
+}
+
+instruction_t DecodeInstruction(uint16_t w, uint16_t next, uint32_t address) {
+	switch (w >> 12) {
+	case 0x0:
+		if (w == 0x0000)
+			return Make(Mnemonic::NOP);
+		switch ((w >> 8) & 0xF) {
+		case 0x1: return Make(Mnemonic::MOVW, ((w >> 4) & 0xF) * 2, (w & 0xF) * 2);
+		case 0x2: return Make(Mnemonic::MULS, 16 + ((w >> 4) & 0xF), 16 + (w & 0xF));
+		case 0x3: {
+			static constexpr Mnemonic c_mul[] = { Mnemonic::MULSU, Mnemonic::FMUL, Mnemonic::FMULS, Mnemonic::FMULSU };
+			return Make(c_mul[((w >> 6) & 0x2) | ((w >> 3) & 0x1)], 16 + ((w >> 4) & 0x7), 16 + (w & 0x7));
+		}
+		}
+		switch ((w >> 10) & 0x3) {
+		case 0x1: return Make(Mnemonic::CPC, Rd5(w), Rr5(w));
+		case 0x2: return Make(Mnemonic::SBC, Rd5(w), Rr5(w));
+		case 0x3: return Make(Mnemonic::ADD, Rd5(w), Rr5(w));
+		}
+		return {};
+	case 0x1: {
+		static constexpr Mnemonic c_ops[] = { Mnemonic::CPSE, Mnemonic::CP, Mnemonic::SUB, Mnemonic::ADC };
+		const Mnemonic m = c_ops[(w >> 10) & 0x3];
+		return Make(m, Rd5(w), Rr5(w), 0, m == Mnemonic::CPSE ? InstructionFlags::Skip : 0);
+	}
+	case 0x2: {
+		static constexpr Mnemonic c_ops[] = { Mnemonic::AND, Mnemonic::EOR, Mnemonic::OR, Mnemonic::MOV };
+		return Make(c_ops[(w >> 10) & 0x3], Rd5(w), Rr5(w));
+	}
+	case 0x3: return Make(Mnemonic::CPI, 16 + ((w >> 4) & 0xF), 0, K8(w));
+	case 0x4: return Make(Mnemonic::SBCI, 16 + ((w >> 4) & 0xF), 0, K8(w));
+	case 0x5: return Make(Mnemonic::SUBI, 16 + ((w >> 4) & 0xF), 0, K8(w));
+	case 0x6: return Make(Mnemonic::ORI, 16 + ((w >> 4) & 0xF), 0, K8(w));
+	case 0x7: return Make(Mnemonic::ANDI, 16 + ((w >> 4) & 0xF), 0, K8(w));
+	case 0x8: case 0xA: {
+		// 10q0 qqsd dddd yqqq
+		const uint8_t q = ((w >> 8) & 0x20) | ((w >> 7) & 0x18) | (w & 0x7);
+		const bool store = w & 0x0200;
+		const bool y = w & 0x8;
+		const Pointer pointer = q ? (y ? Pointer::YDisp : Pointer::ZDisp) : (y ? Pointer::Y : Pointer::Z);
+		const Mnemonic m = q ? (store ? Mnemonic::STD : Mnemonic::LDD) : (store ? Mnemonic::ST : Mnemonic::LD);
+		return MakePointer(m, Rd5(w), pointer, store ? InstructionFlags::Store : InstructionFlags::Load, q);
+	}
+	case 0x9:
+		switch ((w >> 9) & 0x7) {
+		case 0x0: case 0x1: return Decode1001_00(w, next);
+		case 0x2: return Decode1001_010(w, next);
+		case 0x3: return Make((w & 0x0100) ? Mnemonic::SBIW : Mnemonic::ADIW, 24 + ((w >> 3) & 0x6), 0, ((w >> 2) & 0x30) | (w & 0xF));
+		case 0x4: case 0x5: {
+			static constexpr Mnemonic c_ops[] = { Mnemonic::CBI, Mnemonic::SBIC, Mnemonic::SBI, Mnemonic::SBIS };
+			const Mnemonic m = c_ops[(w >> 8) & 0x3];
+			const bool skip = m == Mnemonic::SBIC || m == Mnemonic::SBIS;
+			return Make(m, (w >> 3) & 0x1F, w & 0x7, 0, skip ? InstructionFlags::Skip : 0);
+		}
+		default: return Make(Mnemonic::MUL, Rd5(w), Rr5(w));
+		}
+	case 0xB: {
+		const uint8_t a = ((w >> 5) & 0x30) | (w & 0xF);
+		if (w & 0x0800)
+			return Make(Mnemonic::OUT, a, Rd5(w));
+		return Make(Mnemonic::IN, Rd5(w), a);
+	}
+	case 0xC: case 0xD: {
+		const bool call = w & 0x1000;
+		// 12 bit signed offset
+		const int32_t k = (int32_t)((w & 0xFFF) ^ 0x800) - 0x800;
+		instruction_t i = Make(call ? Mnemonic::RCALL : Mnemonic::RJMP, 0, 0, k, call ? InstructionFlags::Call : InstructionFlags::Jump);
+		i.target = RelativeTarget(address, k);
+		return i;
+	}
+	case 0xE: return Make(Mnemonic::LDI, 16 + ((w >> 4) & 0xF), 0, K8(w));
+	case 0xF:
+		if (!(w & 0x0800)) {
+			// 7 bit signed offset
+			const int32_t k = (int32_t)(((w >> 3) & 0x7F) ^ 0x40) - 0x40;
+			instruction_t i = Make((w & 0x0400) ? Mnemonic::BRBC : Mnemonic::BRBS, w & 0x7, 0, k, InstructionFlags::Branch);
+			i.target = RelativeTarget(address, k);
+			return i;
+		}
+		if (w & 0x8)
+			return {};
+		switch ((w >> 9) & 0x3) {
+		case 0x0: return Make(Mnemonic::BLD, Rd5(w), w & 0x7);
+		case 0x1: return Make(Mnemonic::BST, Rd5(w), w & 0x7);
+		case 0x2: return Make(Mnemonic::SBRC, Rd5(w), w & 0x7, 0, InstructionFlags::Skip);
+		case 0x3: return Make(Mnemonic::SBRS, Rd5(w), w & 0x7, 0, InstructionFlags::Skip);
+		}
+	}
+	return {};
+}
+
+const char* GetMnemonicName(const instruction_t& i) {
+	switch (i.mnemonic) {
+	case Mnemonic::BSET: return c_bset[i.d & 0x7];
+	case Mnemonic::BCLR: return c_bclr[i.d & 0x7];
+	case Mnemonic::BRBS: return c_brbs[i.d & 0x7];
+	case Mnemonic::BRBC: return c_brbc[i.d & 0x7];
+	case Mnemonic::ADD: return i.d == i.r ? "lsl" : "add";
+	case Mnemonic::ADC: return i.d == i.r ? "rol" : "adc";
+	case Mnemonic::AND: return i.d == i.r ? "tst" : "and";
+	case Mnemonic::EOR: return i.d == i.r ? "clr" : "eor";
+	case Mnemonic::LDI: return i.k == 0xFF ? "ser" : "ldi";
+	default: return c_mnemonics[(size_t)i.mnemonic];
+	}
+}
+
+int FormatInstruction(const instruction_t& i, char* buffer, size_t size) {
+	const char* name = GetMnemonicName(i);
+	const char* ptr = c_pointers[(size_t)i.pointer];
+	switch (i.mnemonic) {
+	case Mnemonic::MOVW: case Mnemonic::MULS: case Mnemonic::MULSU: case Mnemonic::FMUL: case Mnemonic::FMULS: case Mnemonic::FMULSU:
+	case Mnemonic::CPC: case Mnemonic::SBC: case Mnemonic::CPSE: case Mnemonic::CP: case Mnemonic::SUB:
+	case Mnemonic::OR: case Mnemonic::MOV: case Mnemonic::MUL:
+		return snprintf(buffer, size, "%s r%d, r%d", name, i.d, i.r);
+	case Mnemonic::ADD: case Mnemonic::ADC: case Mnemonic::AND: case Mnemonic::EOR:
+		if (i.d == i.r) // lsl, rol, tst, clr
+			return snprintf(buffer, size, "%s r%d", name, i.d);
+		return snprintf(buffer, size, "%s r%d, r%d", name, i.d, i.r);
+	case Mnemonic::LDI:
+		if (i.k == 0xFF)
+			return snprintf(buffer, size, "%s r%d", name, i.d);
+		[[fallthrough]];
+	case Mnemonic::CPI: case Mnemonic::SBCI: case Mnemonic::SUBI: case Mnemonic::ORI: case Mnemonic::ANDI:
+	case Mnemonic::ADIW: case Mnemonic::SBIW:
+		return snprintf(buffer, size, "%s r%d, 0x%02X", name, i.d, i.k);
+	case Mnemonic::LD: case Mnemonic::LPM: case Mnemonic::ELPM:
+		if (i.pointer == Pointer::None) // implied r0, Z
+			return snprintf(buffer, size, "%s", name);
+		return snprintf(buffer, size, "%s r%d, %s", name, i.d, ptr);
+	case Mnemonic::LDD:
+		return snprintf(buffer, size, "%s r%d, %s%d", name, i.d, ptr, i.k);
+	case Mnemonic::ST:
+		return snprintf(buffer, size, "%s %s, r%d", name, ptr, i.r);
+	case Mnemonic::STD:
+		return snprintf(buffer, size, "%s %s%d, r%d", name, ptr, i.k, i.r);
+	case Mnemonic::XCH: case Mnemonic::LAS: case Mnemonic::LAC: case Mnemonic::LAT:
+		return snprintf(buffer, size, "%s Z, r%d", name, i.d);
+	case Mnemonic::SPM:
+		return i.pointer == Pointer::ZInc ? snprintf(buffer, size, "%s Z+", name) : snprintf(buffer, size, "%s", name);
+	case Mnemonic::LDS:
+		return snprintf(buffer, size, "%s r%d, 0x%04X", name, i.d, i.k);
+	case Mnemonic::STS:
+		return snprintf(buffer, size, "%s 0x%04X, r%d", name, i.k, i.r);
+	case Mnemonic::POP: case Mnemonic::PUSH: case Mnemonic::COM: case Mnemonic::NEG: case Mnemonic::SWAP:
+	case Mnemonic::INC: case Mnemonic::DEC: case Mnemonic::ASR: case Mnemonic::LSR: case Mnemonic::ROR:
+		return snprintf(buffer, size, "%s r%d", name, i.d);
+	case Mnemonic::BLD: case Mnemonic::BST: case Mnemonic::SBRC: case Mnemonic::SBRS:
+		return snprintf(buffer, size, "%s r%d, %d", name, i.d, i.r);
+	case Mnemonic::CBI: case Mnemonic::SBI: case Mnemonic::SBIC: case Mnemonic::SBIS:
+		return snprintf(buffer, size, "%s 0x%02X, %d", name, i.d, i.r);
+	case Mnemonic::IN:
+		return snprintf(buffer, size, "%s r%d, 0x%02X", name, i.d, i.r);
+	case Mnemonic::OUT:
+		return snprintf(buffer, size, "%s 0x%02X, r%d", name, i.d, i.r);
+	case Mnemonic::DES:
+		return snprintf(buffer, size, "%s 0x%02X", name, i.k);
+	case Mnemonic::JMP: case Mnemonic::CALL: case Mnemonic::RJMP: case Mnemonic::RCALL: case Mnemonic::BRBS: case Mnemonic::BRBC:
+		return snprintf(buffer, size, "%s 0x%04X", name, i.target);
+	case Mnemonic::Unknown:
+		return snprintf(buffer, size, ".word");
+	default:
+		return snprintf(buffer, size, "%s", name);
+	}
+}
+
+int GetDataAccesses(const instruction_t& i, const uint8_t* data, data_access_t(&accesses)[2]) {
+	constexpr uint16_t c_io_offset = 0x20;
+	constexpr uint16_t c_sp = 0x5D;
+	const auto word = [data](uint16_t address) -> uint16_t { return data[address] | (data[address + 1] << 8); };
+	const uint16_t sp = word(c_sp);
+
+	switch (i.mnemonic) {
+	case Mnemonic::LD: case Mnemonic::LDD: case Mnemonic::ST: case Mnemonic::STD:
+	case Mnemonic::XCH: case Mnemonic::LAS: case Mnemonic::LAC: case Mnemonic::LAT: {
+		uint16_t address = 0;
+		switch (i.pointer) {
+		case Pointer::X: case Pointer::XInc: address = word(26); break;
+		case Pointer::XDec: address = word(26) - 1; break;
+		case Pointer::Y: case Pointer::YInc: address = word(28); break;
+		case Pointer::YDec: address = word(28) - 1; break;
+		case Pointer::YDisp: address = word(28) + i.k; break;
+		case Pointer::Z: case Pointer::ZInc: address = word(30); break;
+		case Pointer::ZDec: address = word(30) - 1; break;
+		case Pointer::ZDisp: address = word(30) + i.k; break;
+		default: return 0;
+		}
+		// the read-modify-write instructions access the byte twice
+		int count = 0;
+		if (i.Is(InstructionFlags::Load))
+			accesses[count++] = { address, 1, false };
+		if (i.Is(InstructionFlags::Store))
+			accesses[count++] = { address, 1, true };
+		return count;
+	}
+	case Mnemonic::LDS: accesses[0] = { (uint16_t)i.k, 1, false }; return 1;
+	case Mnemonic::STS: accesses[0] = { (uint16_t)i.k, 1, true }; return 1;
+	case Mnemonic::PUSH: accesses[0] = { sp, 1, true }; return 1;
+	case Mnemonic::POP: accesses[0] = { (uint16_t)(sp + 1), 1, false }; return 1;
+	// 16 bit program counter (up to 128 KiB of flash)
+	case Mnemonic::CALL: case Mnemonic::RCALL: case Mnemonic::ICALL: case Mnemonic::EICALL:
+		accesses[0] = { (uint16_t)(sp - 1), 2, true };
+		return 1;
+	case Mnemonic::RET: case Mnemonic::RETI:
+		accesses[0] = { (uint16_t)(sp + 1), 2, false };
+		return 1;
+	case Mnemonic::IN: accesses[0] = { (uint16_t)(i.r + c_io_offset), 1, false }; return 1;
+	case Mnemonic::OUT: accesses[0] = { (uint16_t)(i.d + c_io_offset), 1, true }; return 1;
+	case Mnemonic::SBIC: case Mnemonic::SBIS: accesses[0] = { (uint16_t)(i.d + c_io_offset), 1, false }; return 1;
+	case Mnemonic::CBI: case Mnemonic::SBI:
+		accesses[0] = { (uint16_t)(i.d + c_io_offset), 1, false };
+		accesses[1] = { (uint16_t)(i.d + c_io_offset), 1, true };
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+uint8_t GetDestinationRegister(const instruction_t& i) {
+	switch (i.mnemonic) {
+	case Mnemonic::MUL: case Mnemonic::MULS: case Mnemonic::MULSU: case Mnemonic::FMUL: case Mnemonic::FMULS: case Mnemonic::FMULSU:
+		return 0; // r1:r0
+	case Mnemonic::LPM: case Mnemonic::ELPM: // r0 without operands, decoded with d = 0
+	case Mnemonic::MOVW: case Mnemonic::ADIW: case Mnemonic::SBIW:
+	case Mnemonic::ADD: case Mnemonic::ADC: case Mnemonic::SUB: case Mnemonic::SBC: case Mnemonic::AND: case Mnemonic::OR:
+	case Mnemonic::EOR: case Mnemonic::MOV: case Mnemonic::SUBI: case Mnemonic::SBCI: case Mnemonic::ORI: case Mnemonic::ANDI:
+	case Mnemonic::LDI: case Mnemonic::LD: case Mnemonic::LDD: case Mnemonic::LDS: case Mnemonic::POP: case Mnemonic::IN:
+	case Mnemonic::XCH: case Mnemonic::LAS: case Mnemonic::LAC: case Mnemonic::LAT:
+	case Mnemonic::COM: case Mnemonic::NEG: case Mnemonic::SWAP: case Mnemonic::INC: case Mnemonic::DEC:
+	case Mnemonic::ASR: case Mnemonic::LSR: case Mnemonic::ROR: case Mnemonic::BLD:
+		return i.d;
+	default:
+		return NoRegister;
+	}
+}
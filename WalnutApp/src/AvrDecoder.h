@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// decodes single AVR instructions as per the instruction set manual
+// https://ww1.microchip.com/downloads/en/devicedoc/atmel-0856-avr-instruction-set-manual.pdf
+enum class Mnemonic : uint8_t
+{
+	Unknown,
+	NOP, MOVW, MULS, MULSU, FMUL, FMULS, FMULSU,
+	CPC, SBC, ADD, CPSE, CP, SUB, ADC, AND, EOR, OR, MOV, MUL,
+	CPI, SBCI, SUBI, ORI, ANDI, LDI,
+	LD, LDD, LDS, ST, STD, STS, LPM, ELPM, SPM, XCH, LAS, LAC, LAT, POP, PUSH,
+	COM, NEG, SWAP, INC, DEC, ASR, LSR, ROR,
+	BSET, BCLR, BLD, BST, DES,
+	RET, RETI, SLEEP, BREAK, WDR,
+	IJMP, EIJMP, ICALL, EICALL, JMP, CALL, RJMP, RCALL, BRBS, BRBC,
+	ADIW, SBIW, CBI, SBI, SBIC, SBIS, SBRC, SBRS,
+	IN, OUT,
+	Count
+};
+
+// pointer register addressing of LD, ST, LPM, ...
+enum class Pointer : uint8_t
+{
+	None,
+	X, XInc, XDec,
+	Y, YInc, YDec, YDisp,
+	Z, ZInc, ZDec, ZDisp,
+};
+
+namespace InstructionFlags
+{
+	enum : uint8_t
+	{
+		Call = 1 << 0, // pushes the return address (CALL, RCALL, ICALL, EICALL)
+		Return = 1 << 1, // RET, RETI
+		Jump = 1 << 2, // unconditional change of flow (JMP, RJMP, IJMP, EIJMP)
+		Branch = 1 << 3, // conditional relative branch
+		Skip = 1 << 4, // conditionally skips the next instruction
+		Indirect = 1 << 5, // target is in Z (and EIND)
+		Load = 1 << 6, // reads data memory
+		Store = 1 << 7, // writes data memory
+	};
+}
+
+struct instruction_t
+{
+	static constexpr uint32_t NoTarget = 0xFFFFFFFF;
+
+	Mnemonic mnemonic = Mnemonic::Unknown;
+	uint8_t length = 1; // in words
+	uint8_t d = 0; // destination register, io address of CBI/SBI/SBIC/SBIS/OUT or SREG bit of BSET/BCLR/BRBS/BRBC
+	uint8_t r = 0; // source register, io address of IN or bit number
+	Pointer pointer = Pointer::None;
+	uint8_t flags = 0;
+	int32_t k = 0; // immediate, displacement or absolute (data) address
+	uint32_t target = NoTarget; // word address of direct jumps, calls and branches
+
+	bool Is(uint8_t flag) const { return (flags & flag) != 0; }
+};
+
+// word is the word at address, next the one following it (only used by 2 word instructions)
+instruction_t DecodeInstruction(uint16_t word, uint16_t next, uint32_t address);
+
+// formats the instruction as avr-objdump would (e.g. "ldi r24, 0x3F"), returns the number of characters written
+int FormatInstruction(const instruction_t& instruction, char* buffer, size_t size);
+const char* GetMnemonicName(const instruction_t& instruction);
+
+// data space access of an instruction, size bytes starting at address
+struct data_access_t
+{
+	uint16_t address;
+	uint8_t size;
+	bool write;
+};
+
+// data space accesses (sram, io and the stack) the instruction is about to make. data is the data space before the
+// instruction executes, the pointer registers and SP are read from it. register operands are not reported.
+// returns the number of accesses written to accesses
+int GetDataAccesses(const instruction_t& instruction, const uint8_t* data, data_access_t(&accesses)[2]);
+
+// register the instruction writes (the low one of register pairs), NoRegister if it writes none
+constexpr uint8_t NoRegister = 0xFF;
+uint8_t GetDestinationRegister(const instruction_t& instruction);
@@ -0,0 +1,193 @@
+#include "Breakpoints.h"
+#include "DebugInfo.h"
+#include <algorithm>
+#include <charconv>
+
+void Breakpoints::Resize(uint32_t words) {
+	std::lock_guard lock(mutex);
+	breakpoints.clear();
+	stops.clear();
+	this->words = words;
+	bitmapWords = (words + 63) / 64;
+	bitmap = std::make_unique<std::atomic<uint64_t>[]>(bitmapWords);
+	for (uint32_t i = 0; i < bitmapWords; i++)
+		bitmap[i].store(0, std::memory_order_relaxed);
+	activeCount = 0;
+	lastHit = NoAddress;
+}
+
+bool Breakpoints::Hit(uint32_t address, const uint8_t* data, uint32_t data_size) {
+	std::lock_guard lock(mutex);
+	breakpoint_t* breakpoint = Find(address);
+	if (!breakpoint || !breakpoint->enabled || !breakpoint->condition.IsTrue(data, data_size, address))
+		return false;
+	breakpoint->hits++;
+	if (breakpoint->hits <= breakpoint->ignore)
+		return false;
+	lastHit.store(address, std::memory_order_relaxed);
+	return true;
+}
+
+uint32_t Breakpoints::ResolveLocation(std::string_view location, const DebugInfo& debug_info) {
+	while (!location.empty() && location.front() == ' ')
+		location.remove_prefix(1);
+	while (!location.empty() && location.back() == ' ')
+		location.remove_suffix(1);
+	if (location.empty())
+		return NoAddress;
+
+	const auto parse_number = [](std::string_view text, uint32_t& value) {
+		int base = 10;
+		if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+			text.remove_prefix(2);
+			base = 16;
+		}
+		auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+		return ec == std::errc() && end == text.data() + text.size();
+	};
+
+	uint32_t address = 0;
+	if (parse_number(location, address))
+		return address;
+
+	// function or function+offset (offset in words)
+	uint32_t offset = 0;
+	const size_t plus = location.find('+');
+	if (plus != std::string_view::npos) {
+		if (!parse_number(location.substr(plus + 1), offset))
+			return NoAddress;
+		location = location.substr(0, plus);
+	}
+	const uint32_t symbol = debug_info.FindFunction(location);
+	if (symbol == DebugInfo::NoSymbol)
+		return NoAddress;
+	return debug_info.GetFunctions().GetAddress(symbol) + offset;
+}
+
+bool Breakpoints::Add(std::string_view location, std::string_view condition, const DebugInfo& debug_info, std::string& error) {
+	const uint32_t address = ResolveLocation(location, debug_info);
+	if (address == NoAddress) {
+		error = "unknown location";
+		return false;
+	}
+	if (!Covers(address)) {
+		error = "address outside the program";
+		return false;
+	}
+	Condition compiled;
+	if (!compiled.Compile(condition, debug_info, error))
+		return false;
+
+	std::lock_guard lock(mutex);
+	breakpoint_t* breakpoint = Find(address);
+	if (!breakpoint) {
+		breakpoint = &breakpoints.emplace_back();
+		breakpoint->address = address;
+	}
+	breakpoint->conditionText = condition;
+	breakpoint->condition = std::move(compiled);
+	UpdateBit(address);
+	return true;
+}
+
+void Breakpoints::Add(uint32_t address) {
+	if (!Covers(address))
+		return;
+	std::lock_guard lock(mutex);
+	if (!Find(address))
+		breakpoints.emplace_back().address = address;
+	UpdateBit(address);
+}
+
+void Breakpoints::Remove(uint32_t address) {
+	std::lock_guard lock(mutex);
+	breakpoints.erase(std::remove_if(breakpoints.begin(), breakpoints.end(), [address](const breakpoint_t& b) { return b.address == address; }), breakpoints.end());
+	UpdateBit(address);
+}
+
+void Breakpoints::Toggle(uint32_t address) {
+	if (Contains(address))
+		Remove(address);
+	else
+		Add(address);
+}
+
+void Breakpoints::SetEnabled(uint32_t address, bool enabled) {
+	std::lock_guard lock(mutex);
+	if (breakpoint_t* breakpoint = Find(address))
+		breakpoint->enabled = enabled;
+	UpdateBit(address);
+}
+
+void Breakpoints::SetIgnoreCount(uint32_t address, uint64_t ignore) {
+	std::lock_guard lock(mutex);
+	if (breakpoint_t* breakpoint = Find(address))
+		breakpoint->ignore = ignore;
+}
+
+bool Breakpoints::SetCondition(uint32_t address, std::string_view condition, const DebugInfo& debug_info, std::string& error) {
+	Condition compiled;
+	if (!compiled.Compile(condition, debug_info, error))
+		return false;
+	std::lock_guard lock(mutex);
+	if (breakpoint_t* breakpoint = Find(address)) {
+		breakpoint->conditionText = condition;
+		breakpoint->condition = std::move(compiled);
+	}
+	return true;
+}
+
+bool Breakpoints::Contains(uint32_t address) const {
+	std::lock_guard lock(mutex);
+	return std::any_of(breakpoints.begin(), breakpoints.end(), [address](const breakpoint_t& b) { return b.address == address; });
+}
+
+void Breakpoints::ClearHits() {
+	std::lock_guard lock(mutex);
+	for (breakpoint_t& breakpoint : breakpoints)
+		breakpoint.hits = 0;
+}
+
+bool Breakpoints::AddStop(uint32_t address) {
+	if (!Covers(address))
+		return false;
+	std::lock_guard lock(mutex);
+	stops.push_back(address);
+	UpdateBit(address);
+	return true;
+}
+
+void Breakpoints::RemoveStop(uint32_t address) {
+	std::lock_guard lock(mutex);
+	const auto stop = std::find(stops.begin(), stops.end(), address);
+	if (stop == stops.end())
+		return;
+	stops.erase(stop);
+	UpdateBit(address);
+}
+
+void Breakpoints::GetAll(std::vector<breakpoint_t>& breakpoints) const {
+	std::lock_guard lock(mutex);
+	breakpoints = this->breakpoints;
+}
+
+Breakpoints::breakpoint_t* Breakpoints::Find(uint32_t address) {
+	for (breakpoint_t& breakpoint : breakpoints)
+		if (breakpoint.address == address)
+			return &breakpoint;
+	return nullptr;
+}
+
+void Breakpoints::UpdateBit(uint32_t address) {
+	if (address >= bitmapWords * 64)
+		return;
+	// only enabled breakpoints (and stops) cost anything in the run loop
+	const breakpoint_t* breakpoint = Find(address);
+	const bool set = (breakpoint && breakpoint->enabled) || std::find(stops.begin(), stops.end(), address) != stops.end();
+	const uint64_t bit = 1ull << (address % 64);
+	const uint64_t old = set ? bitmap[address / 64].fetch_or(bit, std::memory_order_relaxed) : bitmap[address / 64].fetch_and(~bit, std::memory_order_relaxed);
+	if (set && !(old & bit))
+		activeCount++;
+	else if (!set && (old & bit))
+		activeCount--;
+}
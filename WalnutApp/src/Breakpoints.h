@@ -0,0 +1,80 @@
+#pragma once
+#include "Condition.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DebugInfo;
+
+// code breakpoints. a bitmap with one bit per flash word is what the run loop tests, so there is no cost while no
+// breakpoint is set and a single bit test per instruction otherwise. the details (condition, hit count) are only
+// looked at when the bit is set
+class Breakpoints
+{
+public:
+	static constexpr uint32_t NoAddress = 0xFFFFFFFF;
+
+	struct breakpoint_t
+	{
+		uint32_t address; // word address
+		bool enabled = true;
+		std::string conditionText;
+		Condition condition;
+		uint64_t hits = 0; // times the condition was true
+		uint64_t ignore = 0; // the first ignore hits do not stop
+	};
+
+	// sizes the bitmap for a program of words flash words and removes all breakpoints
+	void Resize(uint32_t words);
+
+	// true if address is a word of the program
+	bool Covers(uint32_t address) const { return address < words; }
+	bool Any() const { return activeCount.load(std::memory_order_relaxed) != 0; }
+	bool Test(uint32_t address) const {
+		return address < bitmapWords * 64 && (bitmap[address / 64].load(std::memory_order_relaxed) >> (address % 64)) & 1;
+	}
+	// called by the run loop when the bit of address is set, true if the run has to stop there
+	bool Hit(uint32_t address, const uint8_t* data, uint32_t data_size);
+
+	// location is a function name, a word address (hex with 0x, or decimal) or function+offset. false with error if
+	// the location or the condition does not resolve
+	bool Add(std::string_view location, std::string_view condition, const DebugInfo& debug_info, std::string& error);
+	void Add(uint32_t address);
+	void Remove(uint32_t address);
+	void Toggle(uint32_t address);
+	void SetEnabled(uint32_t address, bool enabled);
+	void SetIgnoreCount(uint32_t address, uint64_t ignore);
+	bool SetCondition(uint32_t address, std::string_view condition, const DebugInfo& debug_info, std::string& error);
+	bool Contains(uint32_t address) const;
+	void ClearHits();
+	// stops of RunConditions share the bitmap without being breakpoints, Hit ignores them. false outside the program
+	bool AddStop(uint32_t address);
+	void RemoveStop(uint32_t address);
+
+	// copies for the ui, taken under the lock
+	void GetAll(std::vector<breakpoint_t>& breakpoints) const;
+	// address of the breakpoint that stopped the last run, NoAddress if none did
+	uint32_t GetLastHit() const { return lastHit.load(std::memory_order_relaxed); }
+	void ResetLastHit() { lastHit.store(NoAddress, std::memory_order_relaxed); }
+
+	// resolves a code location as Add does, NoAddress if it does not
+	static uint32_t ResolveLocation(std::string_view location, const DebugInfo& debug_info);
+private:
+	breakpoint_t* Find(uint32_t address);
+	void UpdateBit(uint32_t address);
+
+	// atomics so the ui can flip bits while the run thread reads them, sized once in Resize
+	std::unique_ptr<std::atomic<uint64_t>[]> bitmap;
+	uint32_t words = 0;
+	uint32_t bitmapWords = 0;
+	std::atomic<uint32_t> activeCount = 0;
+	std::atomic<uint32_t> lastHit = NoAddress;
+
+	mutable std::mutex mutex; // guards breakpoints and stops
+	std::vector<breakpoint_t> breakpoints;
+	std::vector<uint32_t> stops;
+};
@@ -0,0 +1,323 @@
+#include "Condition.h"
+#include "DebugInfo.h"
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+	enum Op : uint8_t
+	{
+		Const, // 4 byte little endian operand
+		Register, // 1 byte register number
+		Word, // 1 byte data address of a 16 bit register pair (X, Y, Z, SP)
+		Pc,
+		Load, // pops an address, pushes the data byte
+		Not, Complement, Negate,
+		Add, Sub, And, Or, Xor, Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, LogicalAnd, LogicalOr,
+	};
+
+	constexpr uint32_t c_max_stack = 32;
+	constexpr uint8_t c_sreg = 0x5F;
+	constexpr uint8_t c_sp = 0x5D;
+}
+
+// recursive descent, one function per precedence level. emits postfix code
+class ConditionParser
+{
+public:
+	ConditionParser(std::string_view text, const DebugInfo& debug_info, std::vector<uint8_t>& code) : text(text), debugInfo(debug_info), code(code) {}
+
+	bool Parse(std::string& error) {
+		LogicalOr();
+		SkipSpaces();
+		if (!failed && position != text.size())
+			Fail("unexpected character");
+		if (!failed && maxDepth > c_max_stack)
+			Fail("expression too complex");
+		if (failed)
+			error = this->error;
+		return !failed;
+	}
+private:
+	std::string_view text;
+	const DebugInfo& debugInfo;
+	std::vector<uint8_t>& code;
+	size_t position = 0;
+	uint32_t depth = 0; // stack depth of the emitted code
+	uint32_t maxDepth = 0;
+	bool failed = false;
+	std::string error;
+
+	void Fail(const char* message) {
+		if (failed)
+			return;
+		failed = true;
+		error = message;
+		error += " at column " + std::to_string(position + 1);
+	}
+
+	void SkipSpaces() {
+		while (position < text.size() && isspace((unsigned char)text[position]))
+			position++;
+	}
+
+	bool Accept(std::string_view token) {
+		SkipSpaces();
+		if (text.substr(position, token.size()) != token)
+			return false;
+		// "|" must not match the start of "||", "<" not "<=" and so on
+		if (token.size() == 1 && position + 1 < text.size()) {
+			const char next = text[position + 1];
+			if ((token[0] == '|' || token[0] == '&') && next == token[0])
+				return false;
+			if ((token[0] == '<' || token[0] == '>' || token[0] == '!') && next == '=')
+				return false;
+		}
+		position += token.size();
+		return true;
+	}
+
+	void Emit(uint8_t op, int stack_change) {
+		code.push_back(op);
+		depth += stack_change;
+		if (depth > maxDepth)
+			maxDepth = depth;
+	}
+	void EmitConst(int32_t value) {
+		Emit(Const, 1);
+		for (int i = 0; i < 4; i++)
+			code.push_back((uint8_t)(value >> (8 * i)));
+	}
+
+	void LogicalOr() {
+		LogicalAnd();
+		while (!failed && Accept("||")) { LogicalAnd(); Emit(Op::LogicalOr, -1); }
+	}
+	void LogicalAnd() {
+		BitOr();
+		while (!failed && Accept("&&")) { BitOr(); Emit(Op::LogicalAnd, -1); }
+	}
+	// the bitwise operators bind looser than the comparisons, as in c: "SREG & 2 == 2" is "SREG & (2 == 2)"
+	void BitOr() {
+		BitXor();
+		while (!failed && Accept("|")) { BitXor(); Emit(Or, -1); }
+	}
+	void BitXor() {
+		BitAnd();
+		while (!failed && Accept("^")) { BitAnd(); Emit(Xor, -1); }
+	}
+	void BitAnd() {
+		Equality();
+		while (!failed && Accept("&")) { Equality(); Emit(And, -1); }
+	}
+	void Equality() {
+		Relational();
+		while (!failed) {
+			if (Accept("==")) { Relational(); Emit(Equal, -1); }
+			else if (Accept("!=")) { Relational(); Emit(NotEqual, -1); }
+			else break;
+		}
+	}
+	void Relational() {
+		Sum();
+		static constexpr std::pair<const char*, Op> c_ops[] = {
+			{ "<=", LessEqual }, { ">=", GreaterEqual }, { "<", Less }, { ">", Greater },
+		};
+		while (!failed) {
+			bool matched = false;
+			for (const auto& [token, op] : c_ops) {
+				if (Accept(token)) {
+					Sum();
+					Emit(op, -1);
+					matched = true;
+					break;
+				}
+			}
+			if (!matched)
+				break;
+		}
+	}
+	void Sum() {
+		Unary();
+		while (!failed) {
+			if (Accept("+")) { Unary(); Emit(Add, -1); }
+			else if (Accept("-")) { Unary(); Emit(Sub, -1); }
+			else break;
+		}
+	}
+	void Unary() {
+		if (Accept("!")) { Unary(); Emit(Not, 0); }
+		else if (Accept("~")) { Unary(); Emit(Complement, 0); }
+		else if (Accept("-")) { Unary(); Emit(Negate, 0); }
+		else Primary();
+	}
+
+	void Primary() {
+		SkipSpaces();
+		if (failed)
+			return;
+		if (Accept("(")) {
+			LogicalOr();
+			if (!Accept(")"))
+				Fail("expected )");
+			return;
+		}
+		if (Accept("[")) {
+			LogicalOr();
+			if (!Accept("]"))
+				Fail("expected ]");
+			Emit(Load, 0);
+			return;
+		}
+		if (position < text.size() && isdigit((unsigned char)text[position])) {
+			Number();
+			return;
+		}
+
+		const size_t start = position;
+		while (position < text.size() && (isalnum((unsigned char)text[position]) || text[position] == '_' || text[position] == '.'))
+			position++;
+		const std::string_view name = text.substr(start, position - start);
+		if (name.empty()) {
+			Fail("expected a value");
+			return;
+		}
+		Identifier(name);
+	}
+
+	void Number() {
+		int base = 10;
+		if (text.substr(position, 2) == "0x" || text.substr(position, 2) == "0X") { base = 16; position += 2; }
+		else if (text.substr(position, 2) == "0b" || text.substr(position, 2) == "0B") { base = 2; position += 2; }
+		int64_t value = 0;
+		size_t digits = 0;
+		while (position < text.size()) {
+			const char c = (char)tolower((unsigned char)text[position]);
+			const int digit = isdigit((unsigned char)c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 99;
+			if (digit >= base)
+				break;
+			value = value * base + digit;
+			if (value > 0xFFFFFFFF) {
+				Fail("number too large");
+				return;
+			}
+			position++;
+			digits++;
+		}
+		if (!digits)
+			Fail("expected digits");
+		EmitConst((int32_t)value);
+	}
+
+	static bool Equals(std::string_view a, const char* b) {
+		if (a.size() != strlen(b))
+			return false;
+		for (size_t i = 0; i < a.size(); i++)
+			if (tolower((unsigned char)a[i]) != b[i])
+				return false;
+		return true;
+	}
+
+	void Identifier(std::string_view name) {
+		if ((name[0] == 'r' || name[0] == 'R') && name.size() <= 3 && name.size() > 1 && isdigit((unsigned char)name[1]) && (name.size() == 2 || isdigit((unsigned char)name[2]))) {
+			const int index = atoi(std::string(name.substr(1)).c_str());
+			if (index > 31) {
+				Fail("no such register");
+				return;
+			}
+			Emit(Register, 1);
+			code.push_back((uint8_t)index);
+			return;
+		}
+		struct pair_t { const char* name; uint8_t address; };
+		static constexpr pair_t c_pairs[] = { { "x", 26 }, { "y", 28 }, { "z", 30 }, { "sp", c_sp } };
+		for (const pair_t& pair : c_pairs) {
+			if (Equals(name, pair.name)) {
+				Emit(Word, 1);
+				code.push_back(pair.address);
+				return;
+			}
+		}
+		if (Equals(name, "sreg")) {
+			EmitConst(c_sreg);
+			Emit(Load, 0);
+			return;
+		}
+		if (Equals(name, "pc")) {
+			Emit(Pc, 1);
+			return;
+		}
+
+		const DebugInfo::SymbolTable& objects = debugInfo.GetObjects();
+		const uint32_t symbol = objects.Find(name);
+		if (symbol == DebugInfo::NoSymbol) {
+			Fail("unknown name");
+			return;
+		}
+		EmitConst((int32_t)objects.GetAddress(symbol));
+	}
+};
+
+bool Condition::Compile(std::string_view text, const DebugInfo& debug_info, std::string& error) {
+	code.clear();
+	bool blank = true;
+	for (char c : text)
+		blank &= isspace((unsigned char)c) != 0;
+	if (blank)
+		return true;
+
+	ConditionParser parser(text, debug_info, code);
+	if (!parser.Parse(error)) {
+		code.clear();
+		return false;
+	}
+	return true;
+}
+
+int32_t Condition::Evaluate(const uint8_t* data, uint32_t data_size, uint32_t pc) const {
+	int32_t stack[c_max_stack];
+	uint32_t top = 0; // number of values, the compiler guarantees it stays within c_max_stack
+	const auto binary = [&](auto op) {
+		top--;
+		stack[top - 1] = op(stack[top - 1], stack[top]);
+	};
+
+	for (size_t i = 0; i < code.size(); i++) {
+		switch ((Op)code[i]) {
+		case Const:
+			stack[top++] = (int32_t)(code[i + 1] | (code[i + 2] << 8) | (code[i + 3] << 16) | ((uint32_t)code[i + 4] << 24));
+			i += 4;
+			break;
+		case Register: stack[top++] = data[code[++i]]; break;
+		case Word: {
+			const uint8_t address = code[++i];
+			stack[top++] = data[address] | (data[address + 1] << 8);
+			break;
+		}
+		case Pc: stack[top++] = (int32_t)pc; break;
+		case Load: {
+			const uint32_t address = (uint32_t)stack[top - 1];
+			stack[top - 1] = address < data_size ? data[address] : 0;
+			break;
+		}
+		case Not: stack[top - 1] = !stack[top - 1]; break;
+		case Complement: stack[top - 1] = ~stack[top - 1]; break;
+		// wrapping arithmetic, signed overflow would be undefined
+		case Negate: stack[top - 1] = (int32_t)(0u - (uint32_t)stack[top - 1]); break;
+		case Add: binary([](int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }); break;
+		case Sub: binary([](int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }); break;
+		case And: binary([](int32_t a, int32_t b) { return a & b; }); break;
+		case Or: binary([](int32_t a, int32_t b) { return a | b; }); break;
+		case Xor: binary([](int32_t a, int32_t b) { return a ^ b; }); break;
+		case Equal: binary([](int32_t a, int32_t b) { return (int32_t)(a == b); }); break;
+		case NotEqual: binary([](int32_t a, int32_t b) { return (int32_t)(a != b); }); break;
+		case Less: binary([](int32_t a, int32_t b) { return (int32_t)(a < b); }); break;
+		case LessEqual: binary([](int32_t a, int32_t b) { return (int32_t)(a <= b); }); break;
+		case Greater: binary([](int32_t a, int32_t b) { return (int32_t)(a > b); }); break;
+		case GreaterEqual: binary([](int32_t a, int32_t b) { return (int32_t)(a >= b); }); break;
+		case LogicalAnd: binary([](int32_t a, int32_t b) { return (int32_t)(a && b); }); break;
+		case LogicalOr: binary([](int32_t a, int32_t b) { return (int32_t)(a || b); }); break;
+		}
+	}
+	return top ? stack[top - 1] : 1;
+}
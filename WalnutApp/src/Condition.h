@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DebugInfo;
+
+// predicate over the cpu state, compiled once to a small stack bytecode so evaluating it on every hit is cheap.
+//   r0..r31, X, Y, Z, SP, SREG, PC     registers (PC in words)
+//   [expr]                             data space byte at expr
+//   name                               address of a data symbol (so [counter] reads it)
+//   123, 0x7B, 0b1111011               constants
+//   ( ) ! ~ - + & | ^ == != < <= > >= && ||   with the precedence of c, arithmetic wraps at 32 bits
+class Condition
+{
+public:
+	// empty text compiles to an always true condition. on failure error describes the problem
+	bool Compile(std::string_view text, const DebugInfo& debug_info, std::string& error);
+	void Clear() { code.clear(); }
+	bool IsEmpty() const { return code.empty(); }
+
+	int32_t Evaluate(const uint8_t* data, uint32_t data_size, uint32_t pc) const;
+	bool IsTrue(const uint8_t* data, uint32_t data_size, uint32_t pc) const { return code.empty() || Evaluate(data, data_size, pc) != 0; }
+private:
+	friend class ConditionParser;
+	std::vector<uint8_t> code;
+};
@@ -0,0 +1,487 @@
+#include "DebugInfo.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace
+{
+	// elf32, see https://refspecs.linuxfoundation.org/elf/elf.pdf
+	constexpr uint32_t SHT_SYMTAB = 2;
+	constexpr uint8_t STT_NOTYPE = 0;
+	constexpr uint8_t STT_OBJECT = 1;
+	constexpr uint8_t STT_FUNC = 2;
+	constexpr uint16_t SHN_UNDEF = 0;
+	constexpr uint16_t SHN_LORESERVE = 0xFF00;
+	constexpr uint16_t EM_AVR = 83;
+
+	// avr-gcc places data space at this offset in the elf address space
+	constexpr uint32_t c_data_offset = 0x800000;
+
+	// DWARF line program, see https://dwarfstd.org/doc/DWARF5.pdf (6.2)
+	enum : uint8_t
+	{
+		DW_LNS_copy = 1, DW_LNS_advance_pc, DW_LNS_advance_line, DW_LNS_set_file, DW_LNS_set_column,
+		DW_LNS_negate_stmt, DW_LNS_set_basic_block, DW_LNS_const_add_pc, DW_LNS_fixed_advance_pc,
+		DW_LNS_set_prologue_end, DW_LNS_set_epilogue_begin, DW_LNS_set_isa,
+	};
+	enum : uint8_t { DW_LNE_end_sequence = 1, DW_LNE_set_address, DW_LNE_define_file, DW_LNE_set_discriminator };
+	enum : uint8_t { DW_LNCT_path = 1, DW_LNCT_directory_index };
+	enum : uint8_t
+	{
+		DW_FORM_block = 0x09, DW_FORM_block1 = 0x0a, DW_FORM_data1 = 0x0b, DW_FORM_data2 = 0x05, DW_FORM_data4 = 0x06,
+		DW_FORM_data8 = 0x07, DW_FORM_data16 = 0x1e, DW_FORM_string = 0x08, DW_FORM_strp = 0x0e, DW_FORM_udata = 0x0f,
+		DW_FORM_line_strp = 0x1f,
+	};
+
+	// bounds checked little endian reader. reading past the end sets failed and returns 0
+	struct Reader
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t offset = 0;
+		bool failed = false;
+
+		bool AtEnd() const { return offset >= size || failed; }
+		uint64_t Read(size_t bytes) {
+			if (offset + bytes > size) {
+				failed = true;
+				offset = size;
+				return 0;
+			}
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; i++)
+				value |= (uint64_t)data[offset + i] << (8 * i);
+			offset += bytes;
+			return value;
+		}
+		uint8_t U8() { return (uint8_t)Read(1); }
+		uint16_t U16() { return (uint16_t)Read(2); }
+		uint32_t U32() { return (uint32_t)Read(4); }
+		uint64_t ULEB() {
+			uint64_t value = 0;
+			for (uint32_t shift = 0; !AtEnd(); shift += 7) {
+				uint8_t byte = U8();
+				if (shift < 64)
+					value |= (uint64_t)(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					break;
+			}
+			return value;
+		}
+		int64_t SLEB() {
+			int64_t value = 0;
+			uint32_t shift = 0;
+			uint8_t byte = 0;
+			do {
+				byte = U8();
+				if (shift < 64)
+					value |= (int64_t)(byte & 0x7F) << shift;
+				shift += 7;
+			} while ((byte & 0x80) && !AtEnd());
+			if (shift < 64 && (byte & 0x40))
+				value |= -((int64_t)1 << shift);
+			return value;
+		}
+		std::string_view String() {
+			const char* begin = (const char*)data + offset;
+			while (offset < size && data[offset])
+				offset++;
+			std::string_view string(begin, (const char*)data + offset - begin);
+			if (offset < size)
+				offset++; // terminator
+			else
+				failed = true;
+			return string;
+		}
+		void Skip(size_t bytes) {
+			if (offset + bytes > size) {
+				failed = true;
+				offset = size;
+			} else {
+				offset += bytes;
+			}
+		}
+	};
+
+	std::string_view StringAt(const uint8_t* data, size_t size, uint64_t offset) {
+		if (!data || offset >= size)
+			return {};
+		const char* begin = (const char*)data + offset;
+		return std::string_view(begin, strnlen(begin, size - offset));
+	}
+
+	struct section_t
+	{
+		uint32_t name, type, flags, addr, offset, size, link, info, addralign, entsize;
+	};
+}
+
+bool DebugInfo::Load(const std::filesystem::path& path) {
+	Clear();
+
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream)
+		return false;
+	std::vector<uint8_t> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+	Reader elf{ file.data(), file.size() };
+	// 32 bit little endian
+	if (elf.U32() != 0x464C457F || elf.U8() != 1 || elf.U8() != 1)
+		return false;
+	elf.offset = 18;
+	if (elf.U16() != EM_AVR)
+		return false;
+	elf.offset = 32;
+	const uint32_t shoff = elf.U32();
+	elf.offset = 46;
+	const uint16_t shentsize = elf.U16();
+	const uint16_t shnum = elf.U16();
+	const uint16_t shstrndx = elf.U16();
+	if (elf.failed || shentsize < 40)
+		return false;
+
+	std::vector<section_t> sections(shnum);
+	for (uint16_t i = 0; i < shnum; i++) {
+		elf.offset = shoff + (size_t)i * shentsize;
+		section_t& s = sections[i];
+		s = { elf.U32(), elf.U32(), elf.U32(), elf.U32(), elf.U32(), elf.U32(), elf.U32(), elf.U32(), elf.U32(), elf.U32() };
+		if (elf.failed || (uint64_t)s.offset + s.size > file.size())
+			s.size = 0;
+	}
+	if (shstrndx >= shnum)
+		return false;
+
+	const auto section_data = [&](const section_t& s) { return file.data() + s.offset; };
+	const auto find_section = [&](std::string_view name) -> const section_t* {
+		const section_t& names = sections[shstrndx];
+		for (const section_t& s : sections) {
+			if (StringAt(section_data(names), names.size, s.name) == name && s.size)
+				return &s;
+		}
+		return nullptr;
+	};
+
+	for (const section_t& s : sections) {
+		if (s.type != SHT_SYMTAB || s.link >= shnum)
+			continue;
+		const section_t& strtab = sections[s.link];
+		ReadSymbols(section_data(s), s.size, (const char*)section_data(strtab), strtab.size);
+		break;
+	}
+
+	if (const section_t* debug_line = find_section(".debug_line")) {
+		const section_t* line_str = find_section(".debug_line_str");
+		const section_t* str = find_section(".debug_str");
+		ReadLines(section_data(*debug_line), debug_line->size,
+			line_str ? section_data(*line_str) : nullptr, line_str ? line_str->size : 0,
+			str ? section_data(*str) : nullptr, str ? str->size : 0);
+	}
+	return true;
+}
+
+void DebugInfo::Clear() {
+	functions.Clear();
+	objects.Clear();
+	strings.clear();
+	lineAddresses.clear();
+	lineNumbers.clear();
+	lineFiles.clear();
+	files.clear();
+	fileIndices.clear();
+}
+
+bool DebugInfo::ReadSymbols(const uint8_t* symtab, size_t symtab_size, const char* strtab, size_t strtab_size) {
+	// names have to outlive the elf file buffer
+	strings.assign(strtab, strtab + strtab_size);
+	if (strings.empty() || strings.back() != '\0')
+		strings.push_back('\0');
+
+	Reader reader{ symtab, symtab_size };
+	while (reader.offset + 16 <= symtab_size) {
+		const uint32_t name = reader.U32();
+		const uint32_t value = reader.U32();
+		const uint32_t size = reader.U32();
+		const uint8_t info = reader.U8();
+		reader.U8(); // other
+		const uint16_t shndx = reader.U16();
+
+		const uint8_t type = info & 0xF;
+		if (shndx == SHN_UNDEF || shndx >= SHN_LORESERVE || name == 0 || name >= strings.size())
+			continue;
+		if (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)
+			continue;
+		std::string_view symbol_name(strings.data() + name);
+		if (symbol_name.empty() || symbol_name[0] == '.')
+			continue; // local labels
+
+		if (value >= c_data_offset) {
+			if (type != STT_FUNC && value < c_data_offset + 0x10000)
+				objects.Add(value - c_data_offset, size, symbol_name);
+		} else if (type != STT_OBJECT) {
+			// flash symbols are in bytes, the pc is in words
+			functions.Add(value / 2, (size + 1) / 2, symbol_name);
+		}
+	}
+	functions.Sort();
+	objects.Sort();
+	return true;
+}
+
+uint16_t DebugInfo::AddFile(std::string path) {
+	if (auto it = fileIndices.find(path); it != fileIndices.end())
+		return it->second;
+	if (files.size() >= NoFile)
+		return NoFile;
+	uint16_t index = (uint16_t)files.size();
+	fileIndices.emplace(path, index);
+	files.push_back(std::move(path));
+	return index;
+}
+
+bool DebugInfo::ReadLines(const uint8_t* data, size_t size, const uint8_t* line_str, size_t line_str_size, const uint8_t* str, size_t str_size) {
+	struct row_t { uint32_t address; uint32_t line; uint16_t file; bool end; };
+	std::vector<row_t> rows;
+
+	Reader unit{ data, size };
+	while (!unit.AtEnd()) {
+		uint64_t unit_length = unit.U32();
+		bool dwarf64 = false;
+		if (unit_length == 0xFFFFFFFF) {
+			unit_length = unit.Read(8);
+			dwarf64 = true;
+		}
+		const size_t unit_end = unit.offset + unit_length;
+		if (unit.failed || unit_end > size || unit_length < 2)
+			break;
+
+		Reader r{ data, unit_end, unit.offset };
+		unit.offset = unit_end;
+
+		const uint16_t version = r.U16();
+		if (version < 2 || version > 5)
+			continue;
+		if (version >= 5)
+			r.Skip(2); // address_size, segment_selector_size
+		const uint64_t header_length = r.Read(dwarf64 ? 8 : 4);
+		const size_t program_begin = r.offset + header_length;
+		const uint8_t min_inst_length = r.U8();
+		if (version >= 4)
+			r.U8(); // maximum_operations_per_instruction, always 1 on avr
+		r.U8(); // default_is_stmt
+		const int8_t line_base = (int8_t)r.U8();
+		const uint8_t line_range = r.U8();
+		const uint8_t opcode_base = r.U8();
+		uint8_t opcode_lengths[256] = {};
+		for (uint8_t i = 1; i < opcode_base; i++)
+			opcode_lengths[i] = r.U8();
+		if (r.failed || line_range == 0)
+			continue;
+
+		// file table of this unit, mapped to indices into files
+		std::vector<std::string> directories;
+		std::vector<uint16_t> unit_files;
+		if (version < 5) {
+			directories.emplace_back(); // 0 is the compilation directory
+			for (std::string_view dir = r.String(); !dir.empty() && !r.failed; dir = r.String())
+				directories.emplace_back(dir);
+			unit_files.push_back(NoFile); // file numbers start at 1
+			for (std::string_view name = r.String(); !name.empty() && !r.failed; name = r.String()) {
+				uint64_t dir = r.ULEB();
+				r.ULEB(); // modification time
+				r.ULEB(); // length
+				std::string path = dir && dir < directories.size() ? directories[dir] + "/" + std::string(name) : std::string(name);
+				unit_files.push_back(AddFile(std::move(path)));
+			}
+		} else {
+			// directory and file entries are described by (content type, form) pairs
+			const auto read_entries = [&](const auto& on_entry) {
+				uint8_t format_count = r.U8();
+				std::vector<std::pair<uint64_t, uint64_t>> formats;
+				for (uint8_t i = 0; i < format_count; i++) {
+					uint64_t content = r.ULEB();
+					formats.emplace_back(content, r.ULEB());
+				}
+				uint64_t count = r.ULEB();
+				for (uint64_t i = 0; i < count && !r.failed; i++) {
+					std::string_view path;
+					uint64_t dir = 0;
+					for (auto& [content, form] : formats) {
+						uint64_t value = 0;
+						std::string_view string;
+						switch (form) {
+						case DW_FORM_string: string = r.String(); break;
+						case DW_FORM_line_strp: string = StringAt(line_str, line_str_size, r.Read(dwarf64 ? 8 : 4)); break;
+						case DW_FORM_strp: string = StringAt(str, str_size, r.Read(dwarf64 ? 8 : 4)); break;
+						case DW_FORM_udata: value = r.ULEB(); break;
+						case DW_FORM_data1: value = r.U8(); break;
+						case DW_FORM_data2: value = r.U16(); break;
+						case DW_FORM_data4: value = r.U32(); break;
+						case DW_FORM_data8: value = r.Read(8); break;
+						case DW_FORM_data16: r.Skip(16); break;
+						case DW_FORM_block: r.Skip(r.ULEB()); break;
+						case DW_FORM_block1: r.Skip(r.U8()); break;
+						default: r.failed = true; break;
+						}
+						if (content == DW_LNCT_path)
+							path = string;
+						else if (content == DW_LNCT_directory_index)
+							dir = value;
+					}
+					on_entry(path, dir);
+				}
+			};
+			read_entries([&](std::string_view path, uint64_t) { directories.emplace_back(path); });
+			read_entries([&](std::string_view name, uint64_t dir) {
+				bool absolute = !name.empty() && (name[0] == '/' || (name.size() > 1 && name[1] == ':'));
+				std::string path = !absolute && dir < directories.size() ? directories[dir] + "/" + std::string(name) : std::string(name);
+				unit_files.push_back(AddFile(std::move(path)));
+				});
+		}
+		if (r.failed)
+			continue;
+
+		// line number program
+		r.offset = program_begin;
+		uint32_t address = 0;
+		uint32_t line = 1;
+		uint64_t file = 1;
+		const auto emit = [&](bool end_sequence) {
+			uint16_t f = end_sequence || file >= unit_files.size() ? NoFile : unit_files[file];
+			rows.push_back({ address, line, f, end_sequence });
+		};
+		const auto reset = [&]() {
+			address = 0;
+			line = 1;
+			file = 1;
+		};
+
+		while (!r.AtEnd()) {
+			const uint8_t opcode = r.U8();
+			if (opcode >= opcode_base) {
+				const uint8_t adjusted = opcode - opcode_base;
+				address += (adjusted / line_range) * min_inst_length;
+				line += line_base + adjusted % line_range;
+				emit(false);
+				continue;
+			}
+			switch (opcode) {
+			case 0: {
+				const uint64_t length = r.ULEB();
+				const size_t end = r.offset + length;
+				switch (length ? r.U8() : 0) {
+				case DW_LNE_end_sequence:
+					emit(true);
+					reset();
+					break;
+				case DW_LNE_set_address:
+					address = (uint32_t)r.Read(length - 1);
+					break;
+				}
+				r.offset = std::max(r.offset, end);
+				break;
+			}
+			case DW_LNS_copy: emit(false); break;
+			case DW_LNS_advance_pc: address += (uint32_t)r.ULEB() * min_inst_length; break;
+			case DW_LNS_advance_line: line += (int32_t)r.SLEB(); break;
+			case DW_LNS_set_file: file = r.ULEB(); break;
+			case DW_LNS_const_add_pc: address += ((255 - opcode_base) / line_range) * min_inst_length; break;
+			case DW_LNS_fixed_advance_pc: address += r.U16(); break;
+			default:
+				// set_column, negate_stmt, ... and unknown standard opcodes only have uleb operands
+				for (uint8_t i = 0; i < opcode_lengths[opcode]; i++)
+					r.ULEB();
+				break;
+			}
+		}
+	}
+
+	// flash addresses are in bytes, the pc is in words. an end_sequence row goes in front of a sequence starting at
+	// its address, wherever that sequence is in .debug_line (-ffunction-sections emits them in any order). stable
+	// so rows of one sequence at the same address keep their order and the last one counts
+	std::stable_sort(rows.begin(), rows.end(), [](const row_t& a, const row_t& b) {
+		return a.address != b.address ? a.address < b.address : a.end && !b.end;
+		});
+	lineAddresses.reserve(rows.size());
+	lineNumbers.reserve(rows.size());
+	lineFiles.reserve(rows.size());
+	for (const row_t& row : rows) {
+		if (row.address >= c_data_offset)
+			continue;
+		lineAddresses.push_back(row.address / 2);
+		lineNumbers.push_back(row.line);
+		lineFiles.push_back(row.file);
+	}
+	return true;
+}
+
+std::string_view DebugInfo::GetFunctionName(uint32_t address) const {
+	uint32_t index = functions.Find(address);
+	return index == NoSymbol ? std::string_view() : functions.GetName(index);
+}
+
+bool DebugInfo::FindLine(uint32_t address, line_t& line) const {
+	auto it = std::upper_bound(lineAddresses.begin(), lineAddresses.end(), address);
+	if (it == lineAddresses.begin())
+		return false;
+	size_t index = it - lineAddresses.begin() - 1;
+	if (lineFiles[index] == NoFile)
+		return false;
+	line.file = files[lineFiles[index]];
+	line.line = lineNumbers[index];
+	return true;
+}
+
+void DebugInfo::SymbolTable::Add(uint32_t address, uint32_t size, std::string_view name) {
+	addresses.push_back(address);
+	sizes.push_back(size);
+	names.push_back(name);
+}
+
+void DebugInfo::SymbolTable::Sort() {
+	std::vector<uint32_t> order(addresses.size());
+	std::iota(order.begin(), order.end(), 0);
+	// sized symbols (functions) before labels at the same address
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return addresses[a] != addresses[b] ? addresses[a] < addresses[b] : sizes[a] > sizes[b];
+		});
+
+	std::vector<uint32_t> sorted_addresses, sorted_sizes;
+	std::vector<std::string_view> sorted_names;
+	for (uint32_t i : order) {
+		// one symbol per address, the first one wins
+		if (!sorted_addresses.empty() && sorted_addresses.back() == addresses[i]) {
+			byName.emplace(names[i], (uint32_t)sorted_addresses.size() - 1);
+			continue;
+		}
+		byName.emplace(names[i], (uint32_t)sorted_addresses.size());
+		sorted_addresses.push_back(addresses[i]);
+		sorted_sizes.push_back(sizes[i]);
+		sorted_names.push_back(names[i]);
+	}
+	addresses = std::move(sorted_addresses);
+	sizes = std::move(sorted_sizes);
+	names = std::move(sorted_names);
+}
+
+void DebugInfo::SymbolTable::Clear() {
+	addresses.clear();
+	sizes.clear();
+	names.clear();
+	byName.clear();
+}
+
+uint32_t DebugInfo::SymbolTable::Find(uint32_t address) const {
+	auto it = std::upper_bound(addresses.begin(), addresses.end(), address);
+	if (it == addresses.begin())
+		return NoSymbol;
+	uint32_t index = (uint32_t)(it - addresses.begin() - 1);
+	if (sizes[index] && address >= addresses[index] + sizes[index])
+		return NoSymbol;
+	return index;
+}
+
+uint32_t DebugInfo::SymbolTable::Find(std::string_view name) const {
+	auto it = byName.find(name);
+	return it == byName.end() ? NoSymbol : it->second;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// symbol table and DWARF line table of the loaded firmware, read once per elf file.
+// everything is kept in flat sorted arrays so lookups are a binary search over a contiguous array of addresses.
+// code addresses are in words (like the pc), data addresses are data space addresses (without avr-gcc's 0x800000 offset)
+class DebugInfo
+{
+public:
+	static constexpr uint32_t NoSymbol = 0xFFFFFFFF;
+
+	class SymbolTable
+	{
+	public:
+		// symbol that contains address. symbols without a size extend up to the next symbol
+		uint32_t Find(uint32_t address) const;
+		uint32_t Find(std::string_view name) const;
+
+		uint32_t GetCount() const { return (uint32_t)addresses.size(); }
+		uint32_t GetAddress(uint32_t index) const { return addresses[index]; }
+		uint32_t GetSize(uint32_t index) const { return sizes[index]; }
+		std::string_view GetName(uint32_t index) const { return names[index]; }
+	private:
+		friend class DebugInfo;
+		void Add(uint32_t address, uint32_t size, std::string_view name);
+		void Sort();
+		void Clear();
+
+		std::vector<uint32_t> addresses;
+		std::vector<uint32_t> sizes;
+		std::vector<std::string_view> names; // point into DebugInfo::strings
+		std::unordered_map<std::string_view, uint32_t> byName;
+	};
+
+	struct line_t
+	{
+		std::string_view file;
+		uint32_t line = 0;
+	};
+
+	bool Load(const std::filesystem::path& path);
+	void Clear();
+	bool HasLines() const { return !lineAddresses.empty(); }
+
+	const SymbolTable& GetFunctions() const { return functions; }
+	const SymbolTable& GetObjects() const { return objects; }
+
+	// function containing the word address
+	uint32_t FindFunction(uint32_t address) const { return functions.Find(address); }
+	uint32_t FindFunction(std::string_view name) const { return functions.Find(name); }
+	std::string_view GetFunctionName(uint32_t address) const;
+
+	// source line of the word address, false if there is no line information for it
+	bool FindLine(uint32_t address, line_t& line) const;
+private:
+	bool ReadSymbols(const uint8_t* symtab, size_t symtab_size, const char* strtab, size_t strtab_size);
+	bool ReadLines(const uint8_t* data, size_t size, const uint8_t* line_str, size_t line_str_size, const uint8_t* str, size_t str_size);
+	uint16_t AddFile(std::string path);
+
+	std::vector<char> strings; // copy of the elf string table, symbol names point into it
+	SymbolTable functions;
+	SymbolTable objects;
+
+	// line table rows sorted by address. a row is valid up to the next row, rows with NoFile end a sequence
+	static constexpr uint16_t NoFile = 0xFFFF;
+	std::vector<uint32_t> lineAddresses;
+	std::vector<uint32_t> lineNumbers;
+	std::vector<uint16_t> lineFiles;
+	std::vector<std::string> files;
+	std::unordered_map<std::string, uint16_t> fileIndices;
+};
@@ -0,0 +1,66 @@
+#include "Disassembler.h"
+#include <algorithm>
+
+Disassembler::~Disassembler() {
+	Clear();
+}
+
+void Disassembler::Build(const uint8_t* flash, uint32_t flashend) {
+	Clear();
+	this->flash = flash;
+	wordCount = (flashend + 1) / 2;
+	instructions.assign(wordCount, instruction_t());
+	rows.assign(wordCount, 0);
+	wordRows.assign(wordCount, NoRow);
+
+	thread = std::thread([this]() { Decode(); });
+}
+
+void Disassembler::Clear() {
+	if (thread.joinable()) {
+		cancel = true;
+		thread.join();
+		cancel = false;
+	}
+	decodedWords = 0;
+	rowCount = 0;
+	wordCount = 0;
+	flash = nullptr;
+}
+
+uint32_t Disassembler::GetRow(uint32_t address) const {
+	if (address >= decodedWords.load(std::memory_order_acquire))
+		return NoRow;
+	return wordRows[address];
+}
+
+uint16_t Disassembler::GetWord(uint32_t address) const {
+	return flash[address * 2] | (flash[address * 2 + 1] << 8);
+}
+
+void Disassembler::Decode() {
+	// publish in chunks so the ui can start showing rows while the rest is decoded
+	constexpr uint32_t c_chunk = 1024;
+
+	uint32_t row = 0;
+	uint32_t address = 0;
+	while (address < wordCount && !cancel) {
+		const uint32_t chunk_end = std::min(address + c_chunk, wordCount);
+		while (address < chunk_end) {
+			uint16_t next = address + 1 < wordCount ? GetWord(address + 1) : 0;
+			instruction_t instruction = DecodeInstruction(GetWord(address), next, address);
+			if (address + instruction.length > wordCount)
+				instruction = instruction_t(); // truncated 2 word instruction at the end of flash
+
+			rows[row] = address;
+			for (uint32_t i = 0; i < instruction.length; i++) {
+				instructions[address + i] = instruction;
+				wordRows[address + i] = row;
+			}
+			address += instruction.length;
+			row++;
+		}
+		rowCount.store(row, std::memory_order_release);
+		decodedWords.store(address, std::memory_order_release);
+	}
+}
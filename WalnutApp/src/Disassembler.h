@@ -0,0 +1,48 @@
+#pragma once
+#include "AvrDecoder.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// decodes the whole flash once into an index on a background thread.
+// rows (instructions) become visible incrementally while the index is being built, so the ui can show the
+// beginning of the program right away. all addresses are in words.
+class Disassembler
+{
+public:
+	static constexpr uint32_t NoRow = 0xFFFFFFFF;
+
+	~Disassembler();
+
+	// (re)builds the index. flash has to stay valid until the next Build or Clear
+	void Build(const uint8_t* flash, uint32_t flashend);
+	void Clear();
+
+	bool IsReady() const { return decodedWords == wordCount && wordCount != 0; }
+	float GetProgress() const { return wordCount ? (float)decodedWords / wordCount : 0.f; }
+
+	// number of instructions decoded so far
+	uint32_t GetRowCount() const { return rowCount.load(std::memory_order_acquire); }
+	uint32_t GetRowAddress(uint32_t row) const { return rows[row]; }
+	// row of the instruction that covers the address, NoRow if it has not been decoded yet
+	uint32_t GetRow(uint32_t address) const;
+	// only valid for decoded addresses
+	const instruction_t& GetInstruction(uint32_t address) const { return instructions[address]; }
+	uint16_t GetWord(uint32_t address) const;
+	uint32_t GetWordCount() const { return wordCount; }
+private:
+	void Decode();
+
+	std::thread thread;
+	std::atomic_bool cancel = false;
+
+	const uint8_t* flash = nullptr;
+	uint32_t wordCount = 0;
+
+	// sized up front so readers never see a reallocation, published through decodedWords/rowCount
+	std::vector<instruction_t> instructions; // per word
+	std::vector<uint32_t> rows; // row -> address
+	std::vector<uint32_t> wordRows; // address -> row
+	std::atomic<uint32_t> decodedWords = 0;
+	std::atomic<uint32_t> rowCount = 0;
+};
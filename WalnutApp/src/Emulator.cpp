@@ -1,10 +1,30 @@
 #include "Emulator.h"
+#include <cstring>
 
 Emulator::Emulator() : io_manager(nullptr) {
 	//avr = avr_make_mcu_from_maker(&mega644);
 	avr = avr_make_mcu_by_name("atmega644");
 	avr_init(avr);
 	io_manager = IoManager<4>(avr);
+
+	// interrupt entries for the call tracking of the profiler
+	AddCallback(GetInterruptIrq(AVR_INT_ANY) + AVR_INT_IRQ_RUNNING, [](avr_irq_t* irq, uint32_t value, void* param) {
+		Emulator* emulator = (Emulator*)param;
+		if (emulator->profiler.IsEnabled() && emulator->profiler.IsTrackingCalls())
+			emulator->profiler.OnInterrupt((uint8_t)value, emulator->avr->cycle);
+		}, this);
+	interrupt_profiler.Attach(*this);
+	memory_tracker.Resize(GetDataSize());
+	watchpoints.Resize(GetDataSize());
+
+	// pin changes for the flight recorder
+	for (uint8_t i = 0; i < std::size(pin_watches); i++) {
+		pin_watches[i] = { this, GetPortName(i * 3) };
+		AddCallback(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(pin_watches[i].port), IOPORT_IRQ_PIN_ALL), [](avr_irq_t* irq, uint32_t value, void* param) {
+			pin_watch_t* watch = (pin_watch_t*)param;
+			watch->emulator->flight_recorder.AddPin(watch->emulator->avr->cycle, watch->port, (uint8_t)value);
+			}, &pin_watches[i]);
+	}
 }
 
 Emulator::~Emulator() {
@@ -22,42 +42,177 @@ bool Emulator::LoadProgram(std::filesystem::path path) {
 		return false;
 
 	avr_load_firmware(avr, &f);
+	program_path = path;
 
 	memory = avr->flash;
 	flashend = avr->flashend;
+	disassembler.Build(memory, flashend);
+	flight_recorder.Build(memory, flashend);
+	debug_info.Load(path);
+	profiler.Resize((flashend + 1) / 2);
+	memory_tracker.Resize(GetDataSize());
+	watchpoints.Resize(GetDataSize());
+	breakpoints.Resize((flashend + 1) / 2);
 	return true;
 }
 
 void Emulator::Reset() {
 	Stop();
+	const avr_cycle_count_t end = avr->cycle;
 	avr_reset(avr);
+	resets++;
+	OnCpuReset(end);
 	io_manager.OnReset();
 	for (auto& callback : reset_callbacks) {
 		callback();
 	};
 }
 
+// each reset is handled exactly once: Reset handles its own, including an Exception raised by a peripheral from a
+// cycle timer inside avr_run. Tick only handles the resets simavr does by itself (watchdog), the counter of resets
+// tells them apart
+void Emulator::OnCpuReset(avr_cycle_count_t end) {
+	profiler.OnReset(end, avr->cycle);
+	logic_analyzer.OnReset(end, avr->cycle);
+	capture.OnReset(end, avr->cycle);
+	interrupt_profiler.OnReset();
+	memory_tracker.OnReset();
+	trace.OnReset();
+	flight_recorder.OnReset();
+	run_conditions.OnReset(end, avr->cycle);
+	// avr_reset dropped the sample timer
+	if (profiler.GetSampleInterval()) {
+		CancelTimer(SampleTimer, this);
+		RegisterTimer(profiler.GetSampleInterval(), SampleTimer, this);
+	}
+}
+
 void Emulator::SingleStep() {
 	Stop();
+	watchpoints.ResetLastHit();
+	Step();
+}
+
+bool Emulator::Step() {
+	if (!watchpoints.Any()) {
+		Tick();
+		return true;
+	}
+	// accesses to pages without watchpoints only cost the decode and a bit test
+	instruction_t scratch;
+	data_access_t accesses[2];
+	const uint32_t pc = avr->pc / 2;
+	const int count = GetDataAccesses(Decode(pc, scratch), avr->data, accesses);
+	if (!watchpoints.IsWatched(accesses, count)) {
+		Tick();
+		return true;
+	}
+	watchpoints.Before(pc, accesses, count, avr->data);
 	Tick();
+	return !watchpoints.After(avr->data);
 }
 
 void Emulator::Run() {
+	Run({ RunTarget::None });
+}
+
+void Emulator::StepOver() {
+	instruction_t scratch;
+	const uint32_t pc = avr->pc / 2;
+	const instruction_t& instruction = Decode(pc, scratch);
+	if (!instruction.Is(InstructionFlags::Call)) {
+		SingleStep();
+		return;
+	}
+	// the sp check keeps recursive calls of the same function from stopping early
+	Stop();
+	Run({ RunTarget::Address, pc + instruction.length, GetStackPointer() });
+}
+
+void Emulator::StepOut() {
+	Stop();
+	Run({ RunTarget::Return, 0, GetStackPointer() });
+}
+
+void Emulator::RunTo(uint32_t address) {
+	Stop();
+	Run({ RunTarget::Address, address, 0 });
+}
+
+bool Emulator::RunUntil(std::vector<RunConditions::condition_t> conditions, uint64_t timeout, std::string& error) {
+	Stop();
+	if (!run_conditions.Arm(*this, std::move(conditions), timeout, error))
+		return false;
+	if (run_conditions.GetResult() != RunConditions::Result::Running)
+		run_conditions.Disarm(false);
+	else
+		Run();
+	return true;
+}
+
+RunConditions::Result Emulator::WaitForRun() {
+	if (run_thread.joinable() && run_thread.get_id() != std::this_thread::get_id())
+		run_thread.join();
+	return run_conditions.GetResult();
+}
+
+void Emulator::Run(const run_target_t& target) {
 	if (running)
 		return;
-	run_thread = std::thread([this]() {
-		running = true;
+	// the thread may have ended on its own (breakpoint)
+	if (run_thread.joinable())
+		run_thread.join();
+	breakpoints.ResetLastHit();
+	watchpoints.ResetLastHit();
+	// a paused run stopped before checking the breakpoint under the pc, a new one has to get past it
+	const bool continued = paused;
+	paused = false;
+	run_target = target;
+	running = true;
+	run_thread = std::thread([this, target, continued]() {
+		// the instruction under the pc is executed even if it has a breakpoint, otherwise continuing would stop right away
+		bool resume = !continued;
+		bool ended = false; // by a breakpoint, a watchpoint or the target
 		while (running) {
-			Tick();
+			// run conditions on the pc share the bitmap
+			if (!resume && breakpoints.Any() && breakpoints.Test(avr->pc / 2) && (run_conditions.OnPc(avr->pc / 2) || breakpoints.Hit(avr->pc / 2, avr->data, GetDataSize()))) {
+				ended = true;
+				break;
+			}
+			resume = false;
+			if (target.kind == RunTarget::None) {
+				if (!Step()) {
+					ended = true;
+					break;
+				}
+				continue;
+			}
+
+			// returns are recognized by the instruction, popping saved registers raises the sp as well
+			bool is_return = false;
+			if (target.kind == RunTarget::Return) {
+				instruction_t scratch;
+				is_return = Decode(avr->pc / 2, scratch).Is(InstructionFlags::Return);
+			}
+			ended = !Step() ||
+				(target.kind == RunTarget::Address && avr->pc / 2 == target.address && GetStackPointer() >= target.sp) ||
+				(is_return && GetStackPointer() > target.sp);
+			if (ended)
+				break;
 		}
+		// a met condition stops the run as well, the conditions of a paused run stay armed for its continuation
+		paused = pausing && !ended && (!run_conditions.IsArmed() || run_conditions.GetResult() == RunConditions::Result::Running);
+		if (!paused)
+			run_conditions.Disarm(breakpoints.GetLastHit() != Breakpoints::NoAddress);
+		running = false;
 		});
 }
 
 void Emulator::Stop() {
-	if (!running)
-		return;
 	running = false;
-	run_thread.join();
+	// the run thread stops itself on breakpoints (and resets itself on exceptions), it can not join itself
+	if (run_thread.joinable() && run_thread.get_id() != std::this_thread::get_id())
+		run_thread.join();
 }
 
 std::bitset<8> Emulator::GetRegister(uint8_t index) {
@@ -80,8 +235,18 @@ avr_irq_t* Emulator::GetIrq(char name, uint8_t pin) {
 	return avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(name), pin);
 }
 
+avr_irq_t* Emulator::GetInterruptIrq(uint8_t vector) {
+	return avr_get_interrupt_irq(avr, vector);
+}
+
 avr_irq_t* Emulator::AllocateIrq(uint32_t count, const char** names) {
-	return avr_alloc_irq(&avr->irq_pool, 0, count, names);
+	avr_irq_t* irqs = avr_alloc_irq(&avr->irq_pool, 0, count, names);
+	for (uint32_t i = 0; i < count; i++) {
+		std::string name = names && names[i] ? names[i] : "irq" + std::to_string(allocated_irqs.size());
+		name.erase(0, name.find_first_not_of("=<>"));
+		allocated_irqs.push_back({ irqs + i, name });
+	}
+	return irqs;
 }
 
 void Emulator::ConnectIrq(avr_irq_t* irq, avr_irq_t* other) {
@@ -121,12 +286,190 @@ void Emulator::RegisterTimer(avr_cycle_count_t when, avr_cycle_timer_t timer, vo
 	avr_cycle_timer_register(avr, when, t, param);
 }
 
+void Emulator::CancelTimer(avr_cycle_timer_t timer, void* param) {
+	avr_cycle_timer_t t = { timer };
+	avr_cycle_timer_cancel(avr, t, param);
+}
+
+void Emulator::SetSampling(uint32_t interval) {
+	// the cycle timers belong to the run thread
+	WhileStopped([&]() {
+		CancelTimer(SampleTimer, this);
+		profiler.SetSampleInterval(interval);
+		if (interval)
+			RegisterTimer(interval, SampleTimer, this);
+		});
+}
+
+avr_cycle_count_t Emulator::SampleTimer(avr_t* avr, avr_cycle_count_t when, void* param) {
+	Emulator* emulator = (Emulator*)param;
+	const uint32_t interval = emulator->profiler.GetSampleInterval();
+	if (!interval)
+		return 0;
+	emulator->profiler.Sample(avr->pc / 2, emulator->GetStackPointer());
+	return when + interval;
+}
+
+bool Emulator::StartTrace(const std::filesystem::path& path, uint8_t options) {
+	// the recorder belongs to the run thread while it is enabled
+	return WhileStopped([&]() { return trace.Start(path, options, GetFrequency()); });
+}
+
+void Emulator::StopTrace() {
+	WhileStopped([&]() { trace.Stop(); });
+}
+
+bool Emulator::StartVcd(const std::filesystem::path& path) {
+	// the callbacks are called by the run thread
+	return WhileStopped([&]() { return vcd.Start(path, *this); });
+}
+
+void Emulator::StopVcd() {
+	WhileStopped([&]() { vcd.Stop(); });
+}
+
+void Emulator::EnableLogicAnalyzer(bool enable) {
+	// the connectors allocate their irqs after the emulator is constructed
+	WhileStopped([&]() {
+		logic_analyzer.Attach(*this);
+		logic_analyzer.Enable(enable);
+		});
+}
+
+void Emulator::EnableLogicAnalyzerPorts(bool enable) {
+	WhileStopped([&]() {
+		logic_analyzer.Attach(*this);
+		logic_analyzer.EnablePorts(enable);
+		});
+}
+
+void Emulator::AddDecoder(std::unique_ptr<ProtocolDecoder> decoder, const uint32_t* roles) {
+	WhileStopped([&]() {
+		logic_analyzer.Attach(*this);
+		logic_analyzer.AddDecoder(std::move(decoder), roles);
+		});
+}
+
+void Emulator::RemoveDecoder(uint32_t index) {
+	WhileStopped([&]() { logic_analyzer.RemoveDecoder(index); });
+}
+
+void Emulator::ClearLogicAnalyzer() {
+	WhileStopped([&]() { logic_analyzer.Clear(); });
+}
+
+void Emulator::ArmCapture(const TriggerCapture::trigger_t& trigger, uint64_t pre, uint64_t post) {
+	WhileStopped([&]() {
+		capture.Attach(*this);
+		capture.Arm(trigger, pre, post);
+		});
+}
+
 void Emulator::Exception(const char* message) {
 	printf("Exception: %s\n", message);
+	Fault(message);
 	Reset();
 }
 
+void Emulator::Fault(const char* reason) {
+	flight_recorder.Capture(reason, avr->cycle);
+	std::filesystem::path path = "flight_recorder.txt";
+	if (!program_path.empty())
+		path = std::filesystem::path(program_path).replace_extension(".flight.txt");
+	if (flight_recorder.Dump(path, debug_info))
+		printf("Flight recorder: %s written to %s\n", reason, path.string().c_str());
+}
+
 void Emulator::Tick() {
+	const uint32_t pc = avr->pc / 2;
+	const avr_cycle_count_t cycle = avr->cycle;
+	const uint8_t destination = flight_recorder.GetDestination(pc);
+	if (destination == FlightRecorder::InvalidOpcode) {
+		// simavr skips it, the run stops right after it
+		char reason[64];
+		snprintf(reason, sizeof(reason), "invalid opcode 0x%04X at 0x%04X", ((const uint16_t*)memory)[pc], pc);
+		Fault(reason);
+		running = false;
+	}
+
+	const uint32_t reset_count = resets;
+	if (!IsInstrumented())
+		avr_run(avr);
+	else
+		TickInstrumented(pc, cycle);
+	flight_recorder.Add(cycle, pc, destination, avr->data);
+	// simavr resets the cpu itself when the watchdog fires, the cycle counter starts over without a Reset.
+	// WDRF in MCUSR stays set until the firmware clears it, so it only names the cause on the reset edge
+	if (avr->cycle < cycle && resets == reset_count) {
+		if (avr->data[AVR_IO_TO_DATA(0x34)] & (1 << 3))
+			Fault("watchdog reset");
+		OnCpuReset(cycle);
+	}
+	if (avr->state == cpu_Crashed) {
+		Fault("cpu crashed");
+		running = false;
+	}
+}
+
+void Emulator::TickInstrumented(uint32_t pc, avr_cycle_count_t cycle) {
+	// the cycles of the instruction (and of an interrupt entry right after it) are charged to its address
+	const bool interrupts_enabled = avr->sreg[S_I];
+	const bool tracing = trace.IsEnabled();
+	const bool capturing = capture.IsRecording();
+	data_access_t accesses[2];
+	int count = 0;
+	if (memory_tracker.IsEnabled() || (tracing && trace.Has(TraceRecorder::Memory)) || (capturing && capture.GetTrigger().kind == TriggerCapture::Trigger::MemoryWrite)) {
+		instruction_t scratch;
+		count = GetDataAccesses(Decode(pc, scratch), avr->data, accesses);
+		if (memory_tracker.IsEnabled())
+			memory_tracker.Record(accesses, count);
+	}
+	uint8_t registers[32];
+	if (tracing && trace.Has(TraceRecorder::Registers))
+		memcpy(registers, avr->data, sizeof(registers));
 	avr_run(avr);
+	if (tracing)
+		trace.Record(cycle, pc, registers, avr->data, accesses, count);
+	if (capturing)
+		capture.OnInstruction(cycle, pc, accesses, count, avr->data);
+	// the instruction reset the cpu, Tick hands the new cycle counter to OnCpuReset
+	if (avr->cycle < cycle)
+		return;
+	const uint32_t cycles = (uint32_t)(avr->cycle - cycle);
+	if (profiler.IsEnabled()) {
+		profiler.Add(pc, cycles);
+		if (profiler.IsTrackingCalls())
+			TrackCalls(pc);
+	}
+	if (interrupt_profiler.IsEnabled())
+		interrupt_profiler.AddCycles(cycles, interrupts_enabled);
+	if (memory_tracker.IsEnabled())
+		memory_tracker.UpdateStackPointer(GetStackPointer());
 }
 
+bool Emulator::IsInstrumented() const {
+	return profiler.IsEnabled() || interrupt_profiler.IsEnabled() || memory_tracker.IsEnabled() || trace.IsEnabled() || capture.IsRecording();
+}
+
+const instruction_t& Emulator::Decode(uint32_t pc, instruction_t& scratch) const {
+	// the disassembler usually has it already, but only as the row starting at pc. a jump into the second word of
+	// a two word instruction executes that word as an instruction of its own
+	const uint32_t row = disassembler.GetRow(pc);
+	if (row != Disassembler::NoRow && disassembler.GetRowAddress(row) == pc)
+		return disassembler.GetInstruction(pc);
+	const uint32_t words = (flashend + 1) / 2;
+	if (!memory || pc >= words) {
+		scratch = instruction_t();
+		return scratch;
+	}
+	const uint16_t* flash = (const uint16_t*)memory;
+	scratch = DecodeInstruction(flash[pc], pc + 1 < words ? flash[pc + 1] : 0, pc);
+	return scratch;
+}
+
+void Emulator::TrackCalls(uint32_t pc) {
+	instruction_t scratch;
+	const instruction_t& instruction = Decode(pc, scratch);
+	const uint32_t z = avr->data[30] | (avr->data[31] << 8);
+	profiler.OnInstruction(instruction, z, avr->cycle);
+}
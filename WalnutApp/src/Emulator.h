@@ -8,8 +8,22 @@
 #include <simavr/sim/avr_ioport.h>
 #include <functional>
 #include <mutex>
+#include <string>
 
 #include "IoManager.h"
+#include "Disassembler.h"
+#include "DebugInfo.h"
+#include "Profiler.h"
+#include "InterruptProfiler.h"
+#include "MemoryTracker.h"
+#include "Breakpoints.h"
+#include "Watchpoints.h"
+#include "TraceRecorder.h"
+#include "FlightRecorder.h"
+#include "VcdRecorder.h"
+#include "LogicAnalyzer.h"
+#include "TriggerCapture.h"
+#include "RunConditions.h"
 
 class Emulator
 {
@@ -22,19 +36,75 @@ public:
 	uint8_t* memory = nullptr;
 	uint32_t flashend = 0;
 	IoManager<4> io_manager;
+	Disassembler disassembler; // rebuilt in the background whenever a program is loaded
+	DebugInfo debug_info; // symbols and lines of the loaded elf file, empty if it has none
+	Profiler profiler; // opt-in, costs a branch per instruction while disabled
+	InterruptProfiler interrupt_profiler; // opt-in as well
+	MemoryTracker memory_tracker; // opt-in, decodes every instruction for its data accesses while enabled
+	Breakpoints breakpoints; // checked by the run loop, SingleStep ignores them
+	Watchpoints watchpoints; // instruction accesses only, interrupt entries pushing the pc are not seen
+	TraceRecorder trace; // opt-in, started and stopped through StartTrace/StopTrace
+	FlightRecorder flight_recorder; // always on, captured and dumped on exceptions, invalid opcodes and watchdog resets
+	VcdRecorder vcd; // opt-in, started and stopped through StartVcd/StopVcd
+	LogicAnalyzer logic_analyzer; // opt-in through EnableLogicAnalyzer, costs nothing per instruction
+	TriggerCapture capture; // instrumented while armed through ArmCapture
+	RunConditions run_conditions; // armed by RunUntil for one run
 
 	void SingleStep();
 	void Run();
 	void Stop();
+	// calls change (on state the run thread owns) with the run thread stopped, then continues the run if there was one
+	template<class F>
+	auto WhileStopped(F&& change) {
+		// the run continues with its target (step over, step out, run to) and its armed run conditions
+		struct resume_t
+		{
+			Emulator& emulator;
+			~resume_t() { if (emulator.paused) emulator.Run(emulator.run_target); }
+		} resume{ *this };
+		pausing = true;
+		Stop();
+		pausing = false;
+		return change();
+	}
+	// run in the run thread until the target is reached (or a breakpoint/watchpoint hits)
+	void StepOver(); // calls execute as a whole, everything else is a single step
+	void StepOut(); // until the current function returns
+	void RunTo(uint32_t address); // word address
+	// runs until one of the conditions is met, timeout cycles passed (0 for none) or a breakpoint hits. false with
+	// error if a condition does not resolve, does not run at all if one is already met
+	bool RunUntil(std::vector<RunConditions::condition_t> conditions, uint64_t timeout, std::string& error);
+	// blocks until the run thread ended on its own, not from the run thread
+	RunConditions::Result WaitForRun();
 
 	std::bitset<8> GetRegister(uint8_t index);
 	std::bitset<32> GetPc();
+	// emulated cycles since the last reset
+	uint64_t GetCycle() const { return avr->cycle; }
+	// cpu clock in Hz, the psp board runs at 20 MHz if the elf file does not say otherwise
+	uint32_t GetFrequency() const { return avr->frequency ? avr->frequency : 20000000; }
+	bool IsRunning() const { return running; }
+	// data space (registers, io and sram)
+	uint32_t GetDataSize() const { return avr->ramend + 1; }
+	uint8_t ReadData(uint16_t address) const { return avr->data[address]; }
+	uint16_t GetStackPointer() const { return avr->data[AVR_IO_TO_DATA(0x3D)] | (avr->data[AVR_IO_TO_DATA(0x3E)] << 8); }
 	std::bitset<8> GetIORegister(uint8_t index);
 	bool GetPin(char name, uint8_t pin);
+	// raw PINx register of a port
+	uint8_t ReadPort(char name) { return avr->data[AVR_IO_TO_DATA(GetPortIndex(name))]; }
 
 
 	avr_irq_t* GetIrq(char name, uint8_t pin);
+	// pending and running irqs of an interrupt vector (AVR_INT_ANY for all), nullptr if the mcu does not have it
+	avr_irq_t* GetInterruptIrq(uint8_t vector);
 	avr_irq_t* AllocateIrq(uint32_t count, const char** names);
+	// every irq allocated so far (the io connector pins), named without simavr's direction prefix ("lcd.D4")
+	struct named_irq_t
+	{
+		avr_irq_t* irq;
+		std::string name;
+	};
+	const std::vector<named_irq_t>& GetAllocatedIrqs() const { return allocated_irqs; }
 	void ConnectIrq(avr_irq_t* irq, avr_irq_t* other);
 	void BiConnectIrq(avr_irq_t* irq, avr_irq_t* other);
 	void DisconnectIrq(avr_irq_t* irq, avr_irq_t* other);
@@ -44,6 +114,27 @@ public:
 	void RemoveCallback(avr_irq_t* irq, avr_irq_notify_t callback, void* param);
 
 	void RegisterTimer(avr_cycle_count_t when, avr_cycle_timer_t timer, void* param);
+	void CancelTimer(avr_cycle_timer_t timer, void* param);
+
+	// the following change state the run thread owns, a run is paused around the change and continues afterwards
+
+	// samples the pc into the profiler every interval cycles, 0 turns sampling off
+	void SetSampling(uint32_t interval);
+	// records every executed instruction to path (TraceRecorder::Options)
+	bool StartTrace(const std::filesystem::path& path, uint8_t options);
+	void StopTrace();
+	// value change dump of the connector irqs and port registers
+	bool StartVcd(const std::filesystem::path& path);
+	void StopVcd();
+	// records the connector pins into the logic analyzer
+	void EnableLogicAnalyzer(bool enable);
+	void EnableLogicAnalyzerPorts(bool enable); // PA0-PD7 as well
+	void ClearLogicAnalyzer();
+	// feeds a protocol decoder the transitions of the logic analyzer channels in roles
+	void AddDecoder(std::unique_ptr<ProtocolDecoder> decoder, const uint32_t* roles);
+	void RemoveDecoder(uint32_t index);
+	// waits for the trigger and captures pre/post cycles around it
+	void ArmCapture(const TriggerCapture::trigger_t& trigger, uint64_t pre, uint64_t post);
 
 	// called AFTER the emulator is reset (so its used for re-initializing IO modules)
 	void OnReset(std::function<void()> callback) { reset_callbacks.push_back(callback); }
@@ -54,15 +145,49 @@ private:
 	static constexpr char GetPortName(uint8_t index) { return (index / 3) + 'A'; } // 3 ports per letter (DDR, PORT, PIN)
 	static constexpr uint8_t GetPortIndex(char name) { return (CharToUpper(name) - 'A') * 3; }
 
+	enum class RunTarget : uint8_t { None, Address, Return };
+	struct run_target_t
+	{
+		RunTarget kind;
+		uint32_t address = 0; // RunTarget::Address, word address
+		uint16_t sp = 0; // the address only counts with the stack at or above it, Return stops once the stack is above it
+	};
+	void Run(const run_target_t& target);
+
 	void Tick();
+	// the cpu was reset at cycle end, by Reset or by simavr itself inside avr_run (watchdog)
+	void OnCpuReset(avr_cycle_count_t end);
+	void TickInstrumented(uint32_t pc, avr_cycle_count_t cycle);
+	// captures the flight recorder and dumps it next to the program
+	void Fault(const char* reason);
+	// executes one instruction, false if a watchpoint hit
+	bool Step();
+	bool IsInstrumented() const;
+	// instruction at the word address pc, from the disassembler if it got there already
+	const instruction_t& Decode(uint32_t pc, instruction_t& scratch) const;
+	void TrackCalls(uint32_t pc);
+	static avr_cycle_count_t SampleTimer(avr_t* avr, avr_cycle_count_t when, void* param);
 
 	avr_t* avr = nullptr;
 
 	std::thread run_thread;
 	std::atomic_bool running = false;
+	run_target_t run_target = { RunTarget::None }; // of the current or last run
+	std::atomic_bool pausing = false; // WhileStopped is stopping the run
+	bool paused = false; // the last run was stopped by WhileStopped and not by itself
+	uint32_t resets = 0; // Reset calls, so Tick does not handle a reset done inside avr_run twice
 	std::mutex avr_mutex;
 
 	std::vector<avr_irq_notify_t> callbacks;
+	std::vector<named_irq_t> allocated_irqs;
 
 	std::vector<std::function<void()>> reset_callbacks;
+
+	struct pin_watch_t
+	{
+		Emulator* emulator;
+		char port;
+	};
+	pin_watch_t pin_watches[4];
+	std::filesystem::path program_path; // flight recorder dumps go next to it
 };
\ No newline at end of file
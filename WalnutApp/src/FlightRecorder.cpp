@@ -0,0 +1,90 @@
+#include "FlightRecorder.h"
+#include <cstdio>
+#include <fstream>
+
+void FlightRecorder::Build(const uint8_t* flash, uint32_t flashend) {
+	this->flash = flash;
+	const uint32_t words = (flashend + 1) / 2;
+	const uint16_t* memory = (const uint16_t*)flash;
+	destinations.resize(words);
+	for (uint32_t pc = 0; pc < words; pc++) {
+		const instruction_t instruction = DecodeInstruction(memory[pc], pc + 1 < words ? memory[pc + 1] : 0, pc);
+		destinations[pc] = instruction.mnemonic == Mnemonic::Unknown ? InvalidOpcode : GetDestinationRegister(instruction);
+	}
+	OnReset();
+}
+
+void FlightRecorder::OnReset() {
+	index = 0;
+	pinIndex = 0;
+}
+
+void FlightRecorder::Capture(const std::string& reason, uint64_t cycle) {
+	std::lock_guard<std::mutex> lock(mutex);
+	capture.reason = reason;
+	capture.cycle = cycle;
+	capture.entries.clear();
+	for (uint64_t i = index > c_instructions ? index - c_instructions : 0; i < index; i++)
+		capture.entries.push_back(entries[i & (c_instructions - 1)]);
+	capture.pins.clear();
+	for (uint64_t i = pinIndex > c_pins ? pinIndex - c_pins : 0; i < pinIndex; i++)
+		capture.pins.push_back(pins[i & (c_pins - 1)]);
+	captures.fetch_add(1, std::memory_order_release);
+}
+
+void FlightRecorder::GetCapture(capture_t& capture) {
+	std::lock_guard<std::mutex> lock(mutex);
+	capture = this->capture;
+}
+
+int FlightRecorder::FormatEntry(const entry_t& entry, const DebugInfo& debug_info, char* buffer, size_t size) const {
+	const uint32_t words = (uint32_t)destinations.size();
+	if (!flash || entry.pc >= words)
+		return snprintf(buffer, size, "?");
+	const uint16_t* memory = (const uint16_t*)flash;
+	const instruction_t instruction = DecodeInstruction(memory[entry.pc], entry.pc + 1u < words ? memory[entry.pc + 1] : 0, entry.pc);
+	int length = FormatInstruction(instruction, buffer, size);
+	const std::string_view target = debug_info.GetFunctionName(instruction.target);
+	if (instruction.target != instruction_t::NoTarget && !target.empty() && length < (int)size)
+		length += snprintf(buffer + length, size - length, " <%.*s>", (int)target.size(), target.data());
+	return length;
+}
+
+bool FlightRecorder::Dump(const std::filesystem::path& path, const DebugInfo& debug_info) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	char line[256];
+	snprintf(line, sizeof(line), "%s at cycle %llu, the last %zu instructions (oldest first)\n\n", capture.reason.c_str(), (unsigned long long)capture.cycle, capture.entries.size());
+	file << line;
+
+	const DebugInfo::SymbolTable& functions = debug_info.GetFunctions();
+	size_t pin = 0;
+	for (const entry_t& entry : capture.entries) {
+		for (; pin < capture.pins.size() && capture.pins[pin].cycle <= entry.cycle; pin++) {
+			snprintf(line, sizeof(line), "%12llu         PIN%c = 0x%02X\n", (unsigned long long)capture.pins[pin].cycle, capture.pins[pin].port, capture.pins[pin].value);
+			file << line;
+		}
+
+		char location[64] = "";
+		const uint32_t function = functions.Find(entry.pc);
+		if (function != DebugInfo::NoSymbol) {
+			const std::string_view name = functions.GetName(function);
+			snprintf(location, sizeof(location), "%.*s+0x%X", (int)name.size(), name.data(), (entry.pc - functions.GetAddress(function)) * 2);
+		}
+		char text[128];
+		FormatEntry(entry, debug_info, text, sizeof(text));
+		char write[16] = "";
+		if (entry.reg != NoRegister)
+			snprintf(write, sizeof(write), "r%u = 0x%02X", entry.reg, entry.value);
+		snprintf(line, sizeof(line), "%12llu  %04X  %-24s %-32s %s\n", (unsigned long long)entry.cycle, entry.pc, location, text, write);
+		file << line;
+	}
+	for (; pin < capture.pins.size(); pin++) {
+		snprintf(line, sizeof(line), "%12llu         PIN%c = 0x%02X\n", (unsigned long long)capture.pins[pin].cycle, capture.pins[pin].port, capture.pins[pin].value);
+		file << line;
+	}
+	return (bool)file;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "AvrDecoder.h"
+#include "DebugInfo.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// always-on ring of the last executed instructions (cycle, pc and the register they wrote) and pin changes.
+// the run loop adds every instruction with a handful of stores, the registers an instruction writes are looked up
+// in a table built once per program. on a fault the rings are captured so the ui and a dump file can show
+// what led up to it.
+class FlightRecorder
+{
+public:
+	static constexpr uint32_t c_instructions = 4096; // power of two
+	static constexpr uint32_t c_pins = 256; // power of two
+	static constexpr uint8_t InvalidOpcode = 0xFE; // GetDestination of words that do not decode
+
+	struct entry_t
+	{
+		uint64_t cycle;
+		uint16_t pc; // word address
+		uint8_t reg; // NoRegister if the instruction writes none
+		uint8_t value; // of reg after the instruction
+	};
+
+	struct pin_t
+	{
+		uint64_t cycle;
+		char port;
+		uint8_t value; // PINx after the change
+	};
+
+	struct capture_t
+	{
+		std::string reason;
+		uint64_t cycle;
+		std::vector<entry_t> entries; // oldest first
+		std::vector<pin_t> pins; // oldest first
+	};
+
+	// builds the destination table for the program, keeps flash to decode the captured instructions
+	void Build(const uint8_t* flash, uint32_t flashend);
+	// the rings start over, the cycle counter may restart
+	void OnReset();
+
+	uint8_t GetDestination(uint32_t pc) const { return pc < destinations.size() ? destinations[pc] : NoRegister; }
+	// called by the run loop after every instruction, destination is GetDestination(pc), data the data space after it
+	void Add(uint64_t cycle, uint32_t pc, uint8_t destination, const uint8_t* data) {
+		entry_t& entry = entries[index & (c_instructions - 1)];
+		entry.cycle = cycle;
+		entry.pc = (uint16_t)pc;
+		// an invalid opcode writes nothing, the word itself is shown by FormatEntry
+		entry.reg = destination == InvalidOpcode ? NoRegister : destination;
+		entry.value = data[destination & 31];
+		index++;
+	}
+	void AddPin(uint64_t cycle, char port, uint8_t value) {
+		pins[pinIndex & (c_pins - 1)] = { cycle, port, value };
+		pinIndex++;
+	}
+
+	// copies the rings, call from the run thread (or while it is stopped)
+	void Capture(const std::string& reason, uint64_t cycle);
+	// incremented by every capture, the ui shows a new capture when it changes
+	uint32_t GetCaptureCount() const { return captures.load(std::memory_order_acquire); }
+	void GetCapture(capture_t& capture);
+
+	// one line per instruction with its disassembly, function and register write, pin changes in between
+	bool Dump(const std::filesystem::path& path, const DebugInfo& debug_info);
+	// formats an instruction of the capture, returns the number of characters written
+	int FormatEntry(const entry_t& entry, const DebugInfo& debug_info, char* buffer, size_t size) const;
+private:
+	std::vector<uint8_t> destinations;
+	const uint8_t* flash = nullptr;
+
+	entry_t entries[c_instructions] = {};
+	uint64_t index = 0;
+	pin_t pins[c_pins] = {};
+	uint64_t pinIndex = 0;
+
+	std::mutex mutex;
+	capture_t capture;
+	std::atomic<uint32_t> captures = 0;
+};
@@ -0,0 +1,118 @@
+#include "InterruptProfiler.h"
+#include "Emulator.h"
+#include <algorithm>
+#include <bit>
+#include <fstream>
+
+void InterruptProfiler::Attach(Emulator& emulator) {
+	this->emulator = &emulator;
+	// vector 0 is the reset
+	for (uint8_t vector = 1; vector < c_vectors; vector++) {
+		avr_irq_t* irq = emulator.GetInterruptIrq(vector);
+		if (!irq)
+			continue;
+		states[vector] = { this, vector, true, NoCycle, NoCycle };
+		emulator.AddCallback(irq + AVR_INT_IRQ_PENDING, [](avr_irq_t* irq, uint32_t value, void* param) {
+			state_t* state = (state_t*)param;
+			state->owner->OnPending(state->vector, !irq->value && value);
+			}, &states[vector]);
+		emulator.AddCallback(irq + AVR_INT_IRQ_RUNNING, [](avr_irq_t* irq, uint32_t value, void* param) {
+			state_t* state = (state_t*)param;
+			state->owner->OnRunning(state->vector, value != 0);
+			}, &states[vector]);
+	}
+}
+
+void InterruptProfiler::Clear() {
+	std::fill(std::begin(vectors), std::end(vectors), vector_t{});
+	maxNesting = 0;
+	totalCycles = 0;
+	disabledCycles = 0;
+}
+
+void InterruptProfiler::OnReset() {
+	for (state_t& state : states) {
+		state.pendingSince = NoCycle;
+		state.entryCycle = NoCycle;
+	}
+	running = 0;
+}
+
+uint32_t InterruptProfiler::GetBucket(uint64_t value) {
+	return std::min((uint32_t)std::bit_width(value), c_buckets - 1);
+}
+
+void InterruptProfiler::OnPending(uint8_t vector, bool raised) {
+	if (!IsEnabled() || !raised)
+		return;
+	states[vector].pendingSince = emulator->GetCycle();
+}
+
+void InterruptProfiler::OnRunning(uint8_t vector, bool is_running) {
+	if (!IsEnabled())
+		return;
+	state_t& state = states[vector];
+	vector_t& stats = vectors[vector];
+	const uint64_t cycle = emulator->GetCycle();
+
+	if (is_running) {
+		running++;
+		maxNesting = std::max(maxNesting, running);
+		stats.maxNesting = std::max(stats.maxNesting, running);
+		stats.count++;
+		if (state.pendingSince != NoCycle) {
+			const uint64_t latency = cycle - state.pendingSince;
+			stats.latency += latency;
+			stats.latencyCount++;
+			stats.maxLatency = std::max(stats.maxLatency, latency);
+			stats.latencyHistogram[GetBucket(latency)]++;
+			state.pendingSince = NoCycle;
+		}
+		state.entryCycle = cycle;
+		return;
+	}
+
+	// RETI. entries seen before enabling have no start
+	if (state.entryCycle == NoCycle)
+		return;
+	running = running ? running - 1 : 0;
+	const uint64_t duration = cycle - state.entryCycle;
+	stats.cycles += duration;
+	stats.maxCycles = std::max(stats.maxCycles, duration);
+	stats.durationHistogram[GetBucket(duration)]++;
+	state.entryCycle = NoCycle;
+}
+
+bool InterruptProfiler::Export(const std::filesystem::path& path) const {
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	file << "total cycles," << totalCycles << "\ninterrupts disabled cycles," << disabledCycles << "\nmax nesting," << maxNesting << "\n\n";
+	file << "vector,count,cycles,max cycles,average latency,max latency,max nesting\n";
+	for (uint32_t i = 0; i < c_vectors; i++) {
+		const vector_t& v = vectors[i];
+		if (!v.count)
+			continue;
+		file << i << ',' << v.count << ',' << v.cycles << ',' << v.maxCycles << ',' << (v.latencyCount ? (double)v.latency / v.latencyCount : 0.0) << ',' << v.maxLatency << ',' << v.maxNesting << '\n';
+	}
+
+	// histogram rows: vector, kind, then one column per bucket
+	file << "\nvector,histogram";
+	for (uint32_t bucket = 0; bucket < c_buckets; bucket++)
+		file << ",<" << (1ull << bucket);
+	file << '\n';
+	for (uint32_t i = 0; i < c_vectors; i++) {
+		const vector_t& v = vectors[i];
+		if (!v.count)
+			continue;
+		file << i << ",cycles";
+		for (uint64_t count : v.durationHistogram)
+			file << ',' << count;
+		file << '\n' << i << ",latency";
+		for (uint64_t count : v.latencyHistogram)
+			file << ',' << count;
+		file << '\n';
+	}
+	return (bool)file;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+class Emulator;
+
+// per vector interrupt statistics. entries, returns and flag raises come from simavr's interrupt irqs, only the
+// time spent with interrupts disabled needs the instrumented run loop (one add per instruction while enabled).
+// written by the run thread and read racily by the ui, like the rest of the emulator state
+class InterruptProfiler
+{
+public:
+	static constexpr uint32_t c_vectors = 64;
+	static constexpr uint32_t c_buckets = 24; // log2 histogram, bucket i counts values in [2^(i-1), 2^i), 0 in bucket 0
+
+	struct vector_t
+	{
+		uint64_t count;
+		uint64_t cycles; // inside the isr including nested interrupts
+		uint64_t maxCycles;
+		uint64_t latency; // flag raised -> first isr instruction, summed
+		uint64_t latencyCount; // entries with a latency, the raise of the flag is not seen after enabling or a reset
+		uint64_t maxLatency;
+		uint32_t maxNesting; // interrupts running when this one was entered (itself included)
+		uint64_t durationHistogram[c_buckets];
+		uint64_t latencyHistogram[c_buckets];
+	};
+
+	// registers for the pending and running irqs of every vector the mcu has
+	void Attach(Emulator& emulator);
+	void Clear();
+	void OnReset();
+
+	void Enable(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+	bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	// called by the run loop for every instruction while enabled, interrupts_enabled is the I flag before it
+	void AddCycles(uint32_t cycles, bool interrupts_enabled) {
+		totalCycles += cycles;
+		if (!interrupts_enabled)
+			disabledCycles += cycles;
+	}
+
+	bool HasVector(uint8_t vector) const { return vector < c_vectors && states[vector].attached; }
+	const vector_t& GetVector(uint8_t vector) const { return vectors[vector]; }
+	uint64_t GetTotalCycles() const { return totalCycles; }
+	uint64_t GetDisabledCycles() const { return disabledCycles; }
+	uint32_t GetMaxNesting() const { return maxNesting; }
+
+	static uint32_t GetBucket(uint64_t value);
+
+	// one line per vector that ran plus the histograms, as csv
+	bool Export(const std::filesystem::path& path) const;
+private:
+	static constexpr uint64_t NoCycle = ~0ull;
+
+	struct state_t
+	{
+		InterruptProfiler* owner;
+		uint8_t vector;
+		bool attached;
+		uint64_t pendingSince;
+		uint64_t entryCycle;
+	};
+
+	void OnPending(uint8_t vector, bool raised);
+	void OnRunning(uint8_t vector, bool is_running);
+
+	Emulator* emulator = nullptr;
+	std::atomic_bool enabled = false;
+	state_t states[c_vectors] = {};
+	vector_t vectors[c_vectors] = {};
+	uint32_t running = 0;
+	uint32_t maxNesting = 0;
+	uint64_t totalCycles = 0;
+	uint64_t disabledCycles = 0;
+};
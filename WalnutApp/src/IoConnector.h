@@ -3,6 +3,7 @@
 
 #include <tuple>
 #include <array>
+#include <utility>
 #include "Emulator.h"
 
 // io pins are the indices of the pins of the io module
@@ -11,12 +12,84 @@ using io_pin_t = uint8_t;
 // e.g: PINA3  <=> [ 'A', 3, v ], PINB0 <=> [ 'B', 0, v ] with v = 0 or 1 (default value)
 using connector_t = std::tuple<char, uint8_t, bool>;
 
+// straight-line accessors for a wiring that is known at compile time (e.g. the constexpr default connections of the layers).
+// e.g. LEDs on PORTC bits 0..7 turn GetPinMask into a single register read instead of 8 lookups
+template <int NUM_PINS, const std::array<connector_t, NUM_PINS>& WIRING>
+struct StaticWiring {
+	static constexpr char Port(int i) { return std::get<0>(WIRING[i]); }
+	static constexpr uint8_t Pin(int i) { return std::get<1>(WIRING[i]); }
+
+	static constexpr bool SinglePort() {
+		for (int i = 1; i < NUM_PINS; i++)
+			if (Port(i) != Port(0))
+				return false;
+		return true;
+	}
+	// io pin i is port pin (first + i)
+	static constexpr bool Contiguous() {
+		if (!SinglePort())
+			return false;
+		for (int i = 1; i < NUM_PINS; i++)
+			if (Pin(i) != Pin(0) + i)
+				return false;
+		return true;
+	}
+
+	static std::bitset<NUM_PINS> GetPinMask(Emulator& emulator) {
+		if constexpr (Contiguous()) {
+			return (emulator.ReadPort(Port(0)) >> Pin(0)) & ((1u << NUM_PINS) - 1);
+		} else {
+			return Gather(emulator, std::make_integer_sequence<int, NUM_PINS>{});
+		}
+	}
+
+	// maps io pin bits to the bits of the (single) port they are wired to
+	static std::bitset<8> Scatter(std::bitset<NUM_PINS> io_bits) {
+		static_assert(SinglePort());
+		if constexpr (Contiguous()) {
+			return (io_bits.to_ulong() << Pin(0)) & 0xFF;
+		} else {
+			return Scatter(io_bits.to_ulong(), std::make_integer_sequence<int, NUM_PINS>{});
+		}
+	}
+private:
+	template <int... I>
+	static std::bitset<NUM_PINS> Gather(Emulator& emulator, std::integer_sequence<int, I...>) {
+		if constexpr (SinglePort()) {
+			uint32_t port = emulator.ReadPort(Port(0));
+			return ((((port >> Pin(I)) & 1u) << I) | ...);
+		} else {
+			return (((((uint32_t)emulator.ReadPort(Port(I)) >> Pin(I)) & 1u) << I) | ...);
+		}
+	}
+
+	template <int... I>
+	static std::bitset<8> Scatter(uint32_t io_bits, std::integer_sequence<int, I...>) {
+		return ((((io_bits >> I) & 1u) << Pin(I)) | ...);
+	}
+};
+
 template <int NUM_PINS>
 class IoConnector {
 	Emulator& emulator;
 
 	std::array<connector_t, NUM_PINS> m_pins;
 	avr_irq_t* m_irqs;
+
+	// compile-time specialized path, only used while m_pins matches m_static_wiring (see SetStaticWiring)
+	const std::array<connector_t, NUM_PINS>* m_static_wiring = nullptr;
+	std::bitset<NUM_PINS>(*m_static_get_pin_mask)(Emulator&) = nullptr;
+	std::bitset<8>(*m_static_scatter)(std::bitset<NUM_PINS>) = nullptr; // nullptr if the wiring spans multiple ports
+	bool m_use_static = false;
+
+	void UpdateStaticPath() {
+		m_use_static = m_static_wiring != nullptr;
+		for (int i = 0; i < NUM_PINS && m_use_static; i++) {
+			auto& [name, pin, _] = m_pins[i];
+			auto& [static_name, static_pin, __] = (*m_static_wiring)[i];
+			m_use_static = name == static_name && pin == static_pin;
+		}
+	}
 public:
 	IoConnector(Emulator& emulator, const char* names[NUM_PINS]) : emulator(emulator) {
 		m_irqs = emulator.AllocateIrq(NUM_PINS, names);
@@ -42,6 +115,21 @@ public:
 			emulator.io_manager.SetPin(name, pin, val);
 		}
 		emulator.io_manager.OnFinishedConnect();
+		UpdateStaticPath();
+	}
+
+	// registers a wiring known at compile time. as long as the connector is wired exactly like this the
+	// specialized accessors are used, once the user rewires the pins the generic table driven path takes over.
+	template <const std::array<connector_t, NUM_PINS>& WIRING>
+	void SetStaticWiring() {
+		using wiring_t = StaticWiring<NUM_PINS, WIRING>;
+		m_static_wiring = &WIRING;
+		m_static_get_pin_mask = &wiring_t::GetPinMask;
+		if constexpr (wiring_t::SinglePort())
+			m_static_scatter = &wiring_t::Scatter;
+		else
+			m_static_scatter = nullptr;
+		UpdateStaticPath();
 	}
 
 	void AddCallback(io_pin_t io_pin, avr_irq_notify_t callback, void* param) {
@@ -56,6 +144,15 @@ public:
 	}
 
 	void SetPinMask(std::bitset<NUM_PINS> pins, std::bitset<NUM_PINS> values) {
+		if (m_use_static && m_static_scatter) {
+			// all pins are on the same port so the pullups only have to be updated once
+			emulator.io_manager.SetPins(std::get<0>(m_pins[0]), m_static_scatter(pins), m_static_scatter(values));
+			for (int i = 0; i < NUM_PINS; i++) {
+				if (pins[i])
+					emulator.RaiseIrq(m_irqs + i, values[i]);
+			}
+			return;
+		}
 		for (int i = 0; i < NUM_PINS; i++) {
 			if (pins[i])
 				SetPin(i, values[i]);
@@ -68,6 +165,9 @@ public:
 	}
 
 	std::bitset<NUM_PINS> GetPinMask() {
+		if (m_use_static)
+			return m_static_get_pin_mask(emulator);
+
 		std::bitset<NUM_PINS> mask;
 		for (int i = 0; i < NUM_PINS; i++) {
 			auto& [name, pin, _] = m_pins[i];
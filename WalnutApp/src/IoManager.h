@@ -44,4 +44,11 @@ public:
 		s_pullup_values[GetPortIndex(name)][pin] = value;
 		UpdatePullupValues();
 	}
+
+	// sets multiple pins of one port at once
+	void SetPins(char name, std::bitset<8> mask, std::bitset<8> values) {
+		auto& pullup = s_pullup_values[GetPortIndex(name)];
+		pullup = (pullup & ~mask) | (values & mask);
+		UpdatePullupValues();
+	}
 };
\ No newline at end of file
@@ -1,14 +1,8 @@
 #include "LCD.h"
 #include <cstring>
-#include <bit>
-
-#if defined(_WIN32) || defined(_WIN64)
-#define bswap_64(x) _byteswap_uint64(x)
-#else
-#define bswap_64(x) __builtin_bswap64(x)
-#endif
 
 LCDEmulator::LCDEmulator(Emulator& emulator, IoConnector<7>& io) : io(io), emulator(emulator) {
+	memset(text, ' ', sizeof(text));
 	io.AddCallback((io_pin_t)Port::EN, EnablePulse, this);
 }
 
@@ -23,16 +17,20 @@ void LCDEmulator::EnablePulse(avr_irq_t* irq, uint32_t value, void* param) {
 }
 
 void LCDEmulator::Reset() {
+	std::lock_guard lock(displayMutex);
 	// set all registers to 0
 	memset(DDRAM, 0, sizeof(DDRAM));
 	memset(CGRAM, 0, sizeof(CGRAM));
+	DecodeCGRAM(0, (uint8_t)CGRAMGlyphs.size() - 1);
 	DDRAMAddress = 0;
 	setCGRAMAddress = false;
 	cursorAddress = 0;
 	displayShift = 0;
 	setCGRAMAddress = false;
 	initCounter = 0;
-	busy = false;
+	waiting = false;
+	readyCycle = 0;
+	lastCycle = 0;
 	fourBitMode = false;
 	twoLineMode = false;
 	fiveBySevenDots = false;
@@ -49,31 +47,64 @@ void LCDEmulator::Reset() {
 	EN = false;
 	lowNibbleToWrite = 0;
 	pendingWrite = false;
+	log.OnReset();
+	cleanSinceClear = false;
+	hasBeforeClear = false;
+	MarkDirty(~cell_mask_t());
 
 	// when reset the callbacks are cleared so we need to add them again
 	io.AddCallback((io_pin_t)Port::EN, EnablePulse, this);
 }
 
 void LCDEmulator::Tick() {
-	// dont care about timings atm so just do everything in one tick
+	// instructions take effect immediately, only the busy flag follows the execution times
 
 	ReadPort();
+	const uint64_t cycle = emulator.GetCycle();
+	if (cycle < lastCycle) {
+		// the cpu was reset inside the run (watchdog), the cycle counter started over without a Reset
+		readyCycle = 0;
+		waiting = false;
+	}
+	lastCycle = cycle;
+	const bool busy = IsBusy(cycle);
+	if (waiting && !busy) {
+		// the first access after the instruction finished, anything later than readyCycle was not needed
+		waiting = false;
+		log.AddOverWait(cycle - readyCycle);
+	}
+	uint32_t nibbleGap = 0;
 	if (fourBitMode) {
 		nibbleSelect = !nibbleSelect;
 		if (pendingWrite) {
 			io.SetPinMask(0xf, lowNibbleToWrite.to_ulong() & 0xf); // set low nibble to output
 			pendingWrite = false;
 		}
-		if (nibbleSelect && !RW) // when writing, wait for both nibbles to be read before responding
+		if (nibbleSelect && !RW) { // when writing, wait for both nibbles to be read before responding
+			nibbleCycle = cycle;
 			return;
+		}
 		else if (!nibbleSelect && RW) // when reading, respond immediately after reading low nibble
 			return;
+		if (!RW)
+			nibbleGap = (uint32_t)(cycle - nibbleCycle);
 	}
 
 	command_t command = GetCommand();
 	Instruction instruction = GetInstruction(command);
+	emulator.capture.OnLcdCommand((uint16_t)command.to_ulong());
+	// reading the busy flag is the only instruction allowed while busy
+	if (busy && instruction != Instruction::ReadBusyFlagAndAddress) {
+		log.Add(cycle, (uint16_t)command.to_ulong(), LcdCommandLog::WhileBusy | (strictTiming ? 0 : Classify(instruction, command)), nibbleGap);
+		if (strictTiming)
+			return;
+	}
+	else {
+		log.Add(cycle, (uint16_t)command.to_ulong(), Classify(instruction, command), nibbleGap);
+	}
 	if (instruction != Instruction::FunctionSet && initCounter < 3)
 		return emulator.Exception("LCD not initialized");
+	StartExecution(instruction, cycle);
 
 	switch (instruction) {
 	case Instruction::DisplayClear:
@@ -155,19 +186,69 @@ Instruction LCDEmulator::GetInstruction(command_t command) {
 	return static_cast<Instruction>(i);
 }
 
+uint32_t LCDEmulator::GetExecutionTime(Instruction instruction) {
+	switch (instruction) {
+	case Instruction::DisplayClear:
+	case Instruction::ReturnHome:
+		return 1520;
+	case Instruction::ReadBusyFlagAndAddress:
+		return 0;
+	case Instruction::WriteDataToRAM:
+	case Instruction::ReadDataFromRAM:
+		return 37 + 4; // tADD, the address counter is updated after the busy flag clears
+	default:
+		return 37;
+	}
+}
+
+void LCDEmulator::StartExecution(Instruction instruction, uint64_t cycle) {
+	const uint64_t cycles = (uint64_t)GetExecutionTime(instruction) * emulator.GetFrequency() / 1000000;
+	if (!cycles)
+		return;
+	waiting = true;
+	readyCycle = cycle + cycles;
+	log.AddExecution(cycles);
+}
+
+uint8_t LCDEmulator::Classify(Instruction instruction, command_t command) {
+	uint8_t flags = 0;
+	if (instruction == Instruction::DisplayClear) {
+		if (cleanSinceClear)
+			return LcdCommandLog::RedundantClear;
+		cleanSinceClear = true;
+		hasBeforeClear = true;
+		memcpy(beforeClear, DDRAM, sizeof(DDRAM));
+	}
+	else if (instruction == Instruction::WriteDataToRAM && !setCGRAMAddress && IsDDRAMAddress(DDRAMAddress)) {
+		const address_t data = command.to_ulong() & 0xff;
+		cleanSinceClear = false;
+		if (DDRAM[DDRAMAddress] == data)
+			flags |= LcdCommandLog::RedundantWrite;
+		else if (hasBeforeClear && beforeClear[DDRAMAddress] == data && data != ' ')
+			flags |= LcdCommandLog::RestoredWrite;
+	}
+	return flags;
+}
+
 void LCDEmulator::DisplayClear(command_t command) {
+	std::lock_guard lock(displayMutex);
 	memset(DDRAM, ' ', sizeof(DDRAM));
 	DDRAMAddress = 0;
 	setCGRAMAddress = false;
 	cursorAddress = 0;
 	displayShift = 0;
+	MarkDirty(~cell_mask_t());
 }
 
 void LCDEmulator::ReturnHome(command_t command) {
+	std::lock_guard lock(displayMutex);
 	DDRAMAddress = 0;
 	setCGRAMAddress = false;
 	cursorAddress = 0;
+	const bool shifted = displayShift != 0;
 	displayShift = 0;
+	if (shifted)
+		MarkDirty(~cell_mask_t());
 }
 
 void LCDEmulator::EntryModeSet(command_t command) {
@@ -181,15 +262,20 @@ void LCDEmulator::DisplayOnOffControl(command_t command) {
 	bool D = command[static_cast<uint8_t>(Command::D2)];
 	bool C = command[static_cast<uint8_t>(Command::D1)];
 	bool B = command[static_cast<uint8_t>(Command::D0)];
+	std::lock_guard lock(displayMutex);
+	const bool toggled = display != D;
 	display = D;
 	cursor = C;
 	blink = B;
+	if (toggled)
+		MarkDirty(~cell_mask_t());
 }
 
 void LCDEmulator::CursorDisplayShift(command_t command) {
 	bool S_C = command[static_cast<uint8_t>(Command::D3)];
 	bool R_L = command[static_cast<uint8_t>(Command::D2)];
 	if (S_C) {
+		std::lock_guard lock(displayMutex);
 		ShiftDisplay(R_L);
 	}
 	IncCursor(R_L);
@@ -229,47 +315,62 @@ void LCDEmulator::ReadBusyFlagAndAddress(command_t command) {
 	// db 0-6: address counter
 	// db 7: busy flag
 	data_bus_t db;
-	db[7] = busy;
+	db[7] = IsBusy(emulator.GetCycle());
 	db |= DDRAMAddress;
 	WritePin(db);
 }
 
 void LCDEmulator::WriteDataToRAM(command_t command) {
 	uint8_t data = command.to_ulong() & 0xff;
+	if (setCGRAMAddress && CGRAMAddress > 63)
+		return emulator.Exception("CGRAMAddress out of bounds");
+	if (!setCGRAMAddress && !IsDDRAMAddress(DDRAMAddress))
+		return emulator.Exception("DDRAMAddress out of bounds");
+
+	std::lock_guard lock(displayMutex);
 	if (setCGRAMAddress) {
-		if (CGRAMAddress > 63)
-			return emulator.Exception("CGRAMAddress out of bounds");
 		CGRAM[CGRAMAddress] = data;
+		// a byte holds bits of at most 2 glyphs
+		uint8_t first = CGRAMAddress * 8 / 50;
+		uint8_t last = (CGRAMAddress * 8 + 7) / 50;
+		DecodeCGRAM(first, last);
+		MarkCGRAMDirty(first, last);
 	} else {
-		if (DDRAMAddress > 79)
-			return emulator.Exception("DDRAMAddress out of bounds");
 		DDRAM[DDRAMAddress] = data;
+		MarkDDRAMDirty(DDRAMAddress);
 	}
 	IncShift();
 }
 
 void LCDEmulator::ReadDataFromRAM(command_t command) {
-	if (setCGRAMAddress) {
-		if (CGRAMAddress > 63)
-			return emulator.Exception("CGRAMAddress out of bounds");
-		WritePin(CGRAM[CGRAMAddress]);
-	} else {
-		if (DDRAMAddress > 79)
-			return emulator.Exception("DDRAMAddress out of bounds");
-		WritePin(DDRAM[DDRAMAddress]);
+	if (setCGRAMAddress && CGRAMAddress > 63)
+		return emulator.Exception("CGRAMAddress out of bounds");
+	if (!setCGRAMAddress && !IsDDRAMAddress(DDRAMAddress))
+		return emulator.Exception("DDRAMAddress out of bounds");
+
+	uint8_t data;
+	{
+		std::lock_guard lock(displayMutex);
+		data = setCGRAMAddress ? CGRAM[CGRAMAddress] : DDRAM[DDRAMAddress];
+		IncShift();
 	}
-	IncShift();
+	WritePin(data);
 }
 
 void LCDEmulator::IncDDRam(bool R_L) {
+	// the end of the first line continues on the second and the end of the second on the first
 	if (R_L) {
-		if (DDRAMAddress == 79)
+		if (DDRAMAddress == 0x27)
+			DDRAMAddress = 0x40;
+		else if (DDRAMAddress == 0x67)
 			DDRAMAddress = 0;
 		else
 			DDRAMAddress++;
 	} else {
 		if (DDRAMAddress == 0)
-			DDRAMAddress = 79;
+			DDRAMAddress = 0x67;
+		else if (DDRAMAddress == 0x40)
+			DDRAMAddress = 0x27;
 		else
 			DDRAMAddress--;
 	}
@@ -305,16 +406,17 @@ void LCDEmulator::IncCursor(bool R_L) {
 
 void LCDEmulator::ShiftDisplay(bool R_L) {
 	if (R_L) {
-		if (displayShift == 23)
+		if (displayShift == 39)
 			displayShift = 0;
 		else
 			displayShift++;
 	} else {
 		if (displayShift == 0)
-			displayShift = 23;
+			displayShift = 39;
 		else
 			displayShift--;
 	}
+	MarkDirty(~cell_mask_t());
 }
 
 void LCDEmulator::IncShift() {
@@ -328,38 +430,107 @@ void LCDEmulator::IncShift() {
 		IncCursor(increment);
 }
 
-character_t LCDEmulator::ReadCharacterFromData(address_t address, const uint8_t* data) {
-	uint32_t bit = address * 50;
-
-	// read qword from CGRAM and shift to correct position
-	uint64_t qword = *(uint64_t*)&data[bit / 8];
-	uint8_t bit_in_qword = bit % 8;
-	uint8_t bits_left = 64 - 50 - bit_in_qword;
-	qword = bswap_64(qword);
-	qword >>= bits_left;
-	//qword &= (1ull << 50ull) - 1ull;
-	character_t character = qword;
-	// reverse bit order
-	for (size_t i = 0; i < 50; i++) {
-		character[i] = qword & (1ull << (49ull - i));
-	}
+character_t LCDEmulator::ToCharacter(const glyph_t& glyph) {
+	character_t character;
+	for (size_t i = 0; i < 50; i++)
+		character[i] = (glyph[i / 5] >> (i % 5)) & 1;
 	return character;
 }
 
-character_t LCDEmulator::GetCharacter(address_t address) {
-	address_t cg_address = DDRAM[address + displayShift];
+const glyph_t& LCDEmulator::GetGlyph(address_t cg_address) {
 	if (cg_address > 16)
-		return ReadCharacterFromData(cg_address - 16, CGROM);
+		return CGROM_GLYPHS[cg_address - 16];
 	else
-		return ReadCharacterFromData(cg_address, CGRAM);
+		return CGRAMGlyphs[cg_address];
+}
+
+void LCDEmulator::DecodeCGRAM(uint8_t first, uint8_t last) {
+	for (uint8_t i = first; i <= last && i < CGRAMGlyphs.size(); i++)
+		CGRAMGlyphs[i] = DecodeGlyph(CGRAM, sizeof(CGRAM), i);
+}
+
+address_t LCDEmulator::GetCellAddress(uint8_t line, uint8_t column, address_t shift) {
+	return (address_t)(line * 0x40 + (column + shift) % 40);
+}
+
+void LCDEmulator::MarkDirty(cell_mask_t cells) {
+	dirtyCells |= cells;
+	frameVersion++;
+	UpdateText(cells);
+}
+
+void LCDEmulator::UpdateText(cell_mask_t cells) {
+	bool changed = false;
+	for (uint8_t line = 0; line < 2; line++) {
+		for (uint8_t i = 0; i < 16; i++) {
+			if (!cells[line * 16 + i])
+				continue;
+			const char c = display ? (char)DDRAM[GetCellAddress(line, i, displayShift)] : ' ';
+			changed |= text[line][i] != c;
+			text[line][i] = c;
+		}
+	}
+	if (changed) {
+		textVersion++;
+		textChanged.notify_all();
+		emulator.run_conditions.OnLcdText({ text[0], 16 }, { text[1], 16 });
+	}
+}
+
+bool LCDEmulator::WaitForText(uint8_t line, std::string_view expected, std::chrono::milliseconds timeout) {
+	std::unique_lock lock(displayMutex);
+	return textChanged.wait_for(lock, timeout, [&]() {
+		return std::string_view(text[line & 1], 16).find(expected) != std::string_view::npos;
+		});
+}
+
+void LCDEmulator::MarkDDRAMDirty(address_t address) {
+	cell_mask_t cells;
+	for (uint8_t line = 0; line < 2; line++)
+		for (uint8_t i = 0; i < 16; i++)
+			cells[line * 16 + i] = GetCellAddress(line, i, displayShift) == address;
+	if (cells.any())
+		MarkDirty(cells);
+}
+
+void LCDEmulator::MarkCGRAMDirty(uint8_t first, uint8_t last) {
+	// every cell that shows one of the changed CGRAM characters
+	cell_mask_t cells;
+	for (uint8_t line = 0; line < 2; line++) {
+		for (uint8_t i = 0; i < 16; i++) {
+			address_t cg_address = DDRAM[GetCellAddress(line, i, displayShift)];
+			cells[line * 16 + i] = cg_address >= first && cg_address <= last;
+		}
+	}
+	if (cells.any())
+		MarkDirty(cells);
+}
+
+uint32_t LCDEmulator::PullDisplay(const display_t*& fb, cell_mask_t& changed) {
+	std::lock_guard lock(displayMutex);
+	changed = dirtyCells;
+	dirtyCells.reset();
+	fb = &framebuffer;
+	if (changed.none())
+		return frameVersion;
+
+	for (uint8_t line = 0; line < 2; line++) {
+		for (uint8_t i = 0; i < 16; i++) {
+			if (!changed[line * 16 + i])
+				continue;
+			framebuffer[line][i] = display ? GetGlyph(DDRAM[GetCellAddress(line, i, displayShift)]) : glyph_t{};
+		}
+	}
+	return frameVersion;
 }
 
 std::array<std::array<character_t, 16>, 2> LCDEmulator::GetDisplay() {
+	std::lock_guard lock(displayMutex);
 	std::array<std::array<character_t, 16>, 2> display;
 	for (uint8_t line = 0; line < 2; line++) {
 		std::array<character_t, 16> lineArray;
 		for (uint8_t i = 0; i < 16; i++) {
-			lineArray[i] = GetCharacter(line * 0x40 + i);
+			lineArray[i] = ToCharacter(GetGlyph(DDRAM[GetCellAddress(line, i, displayShift)]));
 		}
 		display[line] = lineArray;
 	}
@@ -2,7 +2,13 @@
 #include "Emulator.h"
 #include "LCDROM.h"
 #include "IoConnector.h"
+#include "LcdCommandLog.h"
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string_view>
+#include <utility>
 
 // as per specification https://cdn-reichelt.de/documents/datenblatt/A500/DEM16217SYH-LY.pdf
 // 4 bit mode only bcs im lazy and thats what the RWTH evaluation board uses
@@ -12,6 +18,8 @@ using data_bus_t = std::bitset<8>;
 using command_t = std::bitset<10>;
 using address_t = uint8_t;
 using character_t = std::bitset<5 * 10>;
+using display_t = std::array<std::array<glyph_t, 16>, 2>;
+using cell_mask_t = std::bitset<2 * 16>; // one bit per visible cell (line * 16 + column)
 enum class Port : io_pin_t
 {
 	D4, D5, D6, D7,
@@ -48,16 +56,44 @@ public:
 	LCDEmulator(Emulator& emulator, IoConnector<7>& io);
 
 	std::array<std::array<character_t, 16>, 2> GetDisplay();
+	// renders only the cells that changed since the last call into the framebuffer.
+	// changed receives the re-rendered cells, the returned frame version is bumped on every change.
+	// the framebuffer is owned by the lcd and only written here, its contents are stable until the next
+	// PullDisplay call (on the UI thread).
+	uint32_t PullDisplay(const display_t*& framebuffer, cell_mask_t& changed);
+	uint32_t GetFrameVersion() const { return frameVersion; }
+	// the visible characters of both lines (DDRAM codes, spaces while the display is off), kept up to date on DDRAM
+	// writes, clears and shifts. the views stay valid as long as the lcd, their contents are only stable while the
+	// emulator is stopped or on the run thread
+	std::pair<std::string_view, std::string_view> GetText() const { return { { text[0], 16 }, { text[1], 16 } }; }
+	// bumped whenever a visible character changes
+	uint32_t GetTextVersion() const { return textVersion; }
+	// blocks until line contains text or the timeout passes, woken by text changes instead of polling.
+	// not from the run thread
+	bool WaitForText(uint8_t line, std::string_view text, std::chrono::milliseconds timeout);
+	const LcdCommandLog& GetLog() const { return log; }
+	// the real controller ignores commands sent while it is busy, by default they are executed and only counted
+	void SetStrictTiming(bool strict) { strictTiming = strict; }
+	bool IsStrictTiming() const { return strictTiming; }
+	// only call while the emulator is stopped
+	void ClearLog() { log.Clear(); }
 	void Reset();
 private:
 	static void EnablePulse(avr_irq_t* irq, uint32_t value, void* param);
+	// the busy flag is derived from the cycle, a timer would be dropped by a reset inside the run
+	bool IsBusy(uint64_t cycle) const { return cycle < readyCycle; }
 	void Tick();
+	// datasheet execution time of an instruction at fosc = 270 kHz, in us
+	static uint32_t GetExecutionTime(Instruction instruction);
+	void StartExecution(Instruction instruction, uint64_t cycle);
 
 	void ReadPort();
 	void WritePin(data_bus_t port);
 	command_t GetCommand();
 	data_bus_t GetDataBus();
 	Instruction GetInstruction(command_t command);
+	// LcdCommandLog flags of a command, before it is executed
+	uint8_t Classify(Instruction instruction, command_t command);
 
 	void DisplayClear(command_t command);
 	void ReturnHome(command_t command);
@@ -77,11 +113,22 @@ private:
 	void ShiftDisplay(bool R_L);
 	void IncShift();
 
-	character_t ReadCharacterFromData(address_t address, const uint8_t* data);
-	character_t GetCharacter(address_t address);
+	static character_t ToCharacter(const glyph_t& glyph);
+	const glyph_t& GetGlyph(address_t cg_address);
+	void DecodeCGRAM(uint8_t first, uint8_t last);
+	// two line mode: 40 characters per line at 0x00-0x27 and 0x40-0x67, the shift wraps within each line
+	static address_t GetCellAddress(uint8_t line, uint8_t column, address_t shift);
+	static bool IsDDRAMAddress(address_t address) { return address < 0x68 && (address & 0x3F) < 40; }
 
-	address_t DDRAM[80] = { 0 }; // 80 bytes of DDRAM
+	// must be called with displayMutex held, after the state change
+	void MarkDirty(cell_mask_t cells);
+	void UpdateText(cell_mask_t cells);
+	void MarkDDRAMDirty(address_t address);
+	void MarkCGRAMDirty(uint8_t first, uint8_t last);
+
+	address_t DDRAM[0x68] = { 0 }; // 80 bytes of DDRAM, indexed by address (0x28-0x3F are unused)
 	uint8_t CGRAM[64] = { 0 }; // 64 bytes of CGRAM
+	std::array<glyph_t, 17> CGRAMGlyphs = {}; // decoded CGRAM, refreshed on CGRAM writes
 
 	address_t DDRAMAddress = 0; // DDRAM address counter
 	address_t CGRAMAddress = 0; // CGRAM address counter
@@ -91,7 +138,10 @@ private:
 
 	uint8_t initCounter = 0; // init counter. 0-2 are init, 3 is normal operation
 
-	bool busy = false; // busy flag. always 0 bcs everything is done instantly
+	bool waiting = false; // executed an instruction and nothing was sent since it finished
+	bool strictTiming = false;
+	uint64_t readyCycle = 0; // end of the last execution, busy before it
+	uint64_t lastCycle = 0; // cycle of the last bus access, to notice the counter starting over
 
 	bool fourBitMode = false; // 4 bit mode
 	bool twoLineMode = false; // 2 line mode
@@ -112,4 +162,22 @@ private:
 
 	std::bitset<4> lowNibbleToWrite;
 	bool pendingWrite = false; // true if a write is pending
+
+	LcdCommandLog log;
+	uint64_t nibbleCycle = 0; // enable pulse of the high nibble
+	bool cleanSinceClear = false; // no DDRAM write since the last clear
+	bool hasBeforeClear = false;
+	address_t beforeClear[sizeof(DDRAM)] = { 0 }; // DDRAM before the last clear
+
+	// incremental framebuffer. the emulator thread only marks cells dirty, PullDisplay re-renders them.
+	// guards DDRAM, CGRAM, displayShift and display against the UI thread
+	std::mutex displayMutex;
+	cell_mask_t dirtyCells = ~cell_mask_t();
+	std::atomic<uint32_t> frameVersion = 1;
+	display_t framebuffer;
+
+	// visible text, guarded by displayMutex as well
+	char text[2][16];
+	std::atomic<uint32_t> textVersion = 1;
+	std::condition_variable textChanged;
 };
\ No newline at end of file
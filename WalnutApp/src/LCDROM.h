@@ -1,5 +1,7 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
+#include <array>
 
 // 16x16 character set for 5x10 pixel font
 constexpr uint8_t CGROM[] = {
@@ -97,4 +99,31 @@ constexpr uint8_t CGROM[] = {
 0x00, 0x08, 0xC6, 0x31, 0x78, 0x42, 0xF0, 0x07, 0xC4, 0xF9, 0x08, 0x00, 0x00, 0x00, 0xFB, 0x1E,
 0x9C, 0x80, 0x00, 0x00, 0x3F, 0xFF, 0xC6, 0x20, 0x00, 0x00, 0x02, 0x03, 0xE0, 0x20, 0x00, 0x00,
 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
-};
\ No newline at end of file
+};
+
+// one byte per pixel row of a 5x10 glyph, bit x is the pixel in column x (0 = left)
+using glyph_t = std::array<uint8_t, 10>;
+
+// glyphs are packed as 50 consecutive bits each, msb first (row by row, left to right).
+// bits past the end of data read as 0
+constexpr glyph_t DecodeGlyph(const uint8_t* data, size_t size, size_t index) {
+	glyph_t glyph{};
+	for (size_t y = 0; y < 10; y++) {
+		for (size_t x = 0; x < 5; x++) {
+			size_t bit = index * 50 + y * 5 + x;
+			if (bit / 8 < size && (data[bit / 8] & (0x80 >> (bit % 8))))
+				glyph[y] |= 1 << x;
+		}
+	}
+	return glyph;
+}
+
+constexpr size_t CGROM_GLYPH_COUNT = sizeof(CGROM) * 8 / 50;
+
+// CGROM expanded into row bitmaps at compile time
+constexpr std::array<glyph_t, CGROM_GLYPH_COUNT> CGROM_GLYPHS = [] {
+	std::array<glyph_t, CGROM_GLYPH_COUNT> glyphs{};
+	for (size_t i = 0; i < CGROM_GLYPH_COUNT; i++)
+		glyphs[i] = DecodeGlyph(CGROM, sizeof(CGROM), i);
+	return glyphs;
+}();
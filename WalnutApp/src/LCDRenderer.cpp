@@ -0,0 +1,65 @@
+#include "LCDRenderer.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LCD_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+void LCDRenderer::SetLayout(uint32_t scale, bool pixelGrid) {
+	this->scale = std::clamp(scale, 1u, MaxScale);
+	// below 3 screen pixels per lcd pixel the grid would swallow the pixels
+	this->pixelGrid = pixelGrid && this->scale >= 3;
+	pixels.assign((size_t)GetWidth() * GetHeight(), Background);
+
+	for (uint32_t i = 0; i < MaxSpan; i++) {
+		uint32_t x = i / this->scale;
+		bool grid = this->pixelGrid && i % this->scale == this->scale - 1;
+		spanGrid[i] = grid ? 0xFFFFFFFF : 0;
+		spanBits[i] = (x < 5 && !grid) ? 1u << x : 0;
+	}
+}
+
+void LCDRenderer::ExpandRow(uint8_t row, uint32_t* span) const {
+	const uint32_t width = 5 * scale;
+#ifdef LCD_RENDERER_SSE2
+	const __m128i rowv = _mm_set1_epi32(row);
+	const __m128i on = _mm_set1_epi32((int)PixelOn);
+	const __m128i off = _mm_set1_epi32((int)PixelOff);
+	const __m128i gridColor = _mm_set1_epi32((int)PixelGrid);
+	for (uint32_t i = 0; i < width; i += 4) {
+		const __m128i bits = _mm_load_si128((const __m128i*)&spanBits[i]);
+		const __m128i grid = _mm_load_si128((const __m128i*)&spanGrid[i]);
+		// lit where the row has the sampled bit set. grid lanes sample no bit and are masked below
+		const __m128i lit = _mm_cmpeq_epi32(_mm_and_si128(rowv, bits), bits);
+		__m128i color = _mm_or_si128(_mm_and_si128(lit, on), _mm_andnot_si128(lit, off));
+		color = _mm_or_si128(_mm_and_si128(grid, gridColor), _mm_andnot_si128(grid, color));
+		_mm_store_si128((__m128i*)&span[i], color);
+	}
+#else
+	for (uint32_t i = 0; i < width; i++) {
+		if (spanGrid[i])
+			span[i] = PixelGrid;
+		else
+			span[i] = (row & spanBits[i]) ? PixelOn : PixelOff;
+	}
+#endif
+}
+
+void LCDRenderer::DrawCell(const glyph_t& glyph, uint8_t line, uint8_t column) {
+	const uint32_t stride = GetWidth();
+	const uint32_t width = 5 * scale;
+	alignas(16) uint32_t span[MaxSpan];
+
+	uint32_t* dst = &pixels[(size_t)line * CellHeight * scale * stride + column * CellWidth * scale];
+	for (uint32_t y = 0; y < 10; y++) {
+		ExpandRow(glyph[y], span);
+		for (uint32_t sy = 0; sy < scale; sy++, dst += stride) {
+			if (pixelGrid && sy == scale - 1)
+				std::fill_n(dst, width, PixelGrid);
+			else
+				memcpy(dst, span, width * sizeof(uint32_t));
+		}
+	}
+}
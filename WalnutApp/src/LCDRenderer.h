@@ -0,0 +1,40 @@
+#pragma once
+#include "LCD.h"
+#include <vector>
+
+// composites the LCD framebuffer into an RGBA pixel buffer, e.g. for uploading it as a texture.
+// every lcd pixel is drawn as scale x scale screen pixels, optionally with a grid line between them.
+class LCDRenderer
+{
+public:
+	// lcd pixels per character cell including the 1 pixel gap to the next cell
+	static constexpr uint32_t CellWidth = 6;
+	static constexpr uint32_t CellHeight = 11;
+	static constexpr uint32_t MaxScale = 8;
+
+	static constexpr uint32_t PixelOn = 0xFFFFFFFF;
+	static constexpr uint32_t PixelOff = 0xFF000000;
+	static constexpr uint32_t PixelGrid = 0xFF181818;
+	static constexpr uint32_t Background = 0xFF282828;
+
+	// clears the buffer, every cell has to be drawn again afterwards
+	void SetLayout(uint32_t scale, bool pixelGrid);
+	void DrawCell(const glyph_t& glyph, uint8_t line, uint8_t column);
+
+	const uint32_t* GetPixels() const { return pixels.data(); }
+	uint32_t GetWidth() const { return 16 * CellWidth * scale; }
+	uint32_t GetHeight() const { return 2 * CellHeight * scale; }
+private:
+	// expands one 5 pixel glyph row into 5 * scale screen pixels
+	void ExpandRow(uint8_t row, uint32_t* span) const;
+
+	uint32_t scale = 0;
+	bool pixelGrid = false;
+	std::vector<uint32_t> pixels;
+
+	// per screen pixel of a glyph row: the glyph row bit it shows (0 on grid columns) and whether it is a grid column.
+	// padded to a multiple of 4 so the expansion can always work on whole vectors
+	static constexpr uint32_t MaxSpan = (5 * MaxScale + 3) & ~3u;
+	alignas(16) uint32_t spanBits[MaxSpan] = {};
+	alignas(16) uint32_t spanGrid[MaxSpan] = {};
+};
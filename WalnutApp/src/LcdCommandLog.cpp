@@ -0,0 +1,72 @@
+#include "LcdCommandLog.h"
+
+void LcdCommandLog::Add(uint64_t cycle, uint16_t command, uint8_t flags, uint32_t nibbleGap) {
+	const uint64_t index = count.load(std::memory_order_relaxed);
+	entries[index & (c_capacity - 1)] = { cycle, command, flags, nibbleGap };
+	count.store(index + 1, std::memory_order_release);
+
+	if (!stats.commands)
+		stats.firstCycle = cycle;
+	stats.commands++;
+	stats.lastCycle = cycle;
+	if ((command & 0x300) == 0x200)
+		stats.dataWrites++;
+	if (nibbleGap) {
+		stats.nibblePairs++;
+		stats.nibbleCycles += nibbleGap;
+		if (nibbleGap > stats.maxNibbleGap)
+			stats.maxNibbleGap = nibbleGap;
+	}
+
+	// the busy flag read has the address counter on D0-D6 and the flag on D7
+	const bool poll = (command & 0x300) == c_read_busy;
+	if (poll) {
+		stats.busyPolls++;
+		if (!polling) {
+			polling = true;
+			pollStart = cycle;
+			stats.busyWaits++;
+		}
+	}
+	else if (polling) {
+		polling = false;
+		if (cycle > pollStart)
+			stats.busyWaitCycles += cycle - pollStart;
+	}
+
+	if ((command & 0x3FF) == 0x01)
+		stats.clears++;
+	if (flags & RedundantClear)
+		stats.redundantClears++;
+	if (flags & RedundantWrite)
+		stats.redundantWrites++;
+	if (flags & RestoredWrite)
+		stats.restoredWrites++;
+	if (flags & WhileBusy)
+		stats.busyViolations++;
+}
+
+void LcdCommandLog::Clear() {
+	count = 0;
+	stats = {};
+	polling = false;
+}
+
+double LcdCommandLog::GetRate(uint64_t now, uint64_t window, uint32_t frequency) const {
+	const uint64_t end = GetCount();
+	const uint64_t first = GetFirst();
+	const uint64_t from = now > window ? now - window : 0;
+	uint64_t oldest = now;
+	uint64_t commands = 0;
+	for (uint64_t i = end; i > first; i--) {
+		const uint64_t cycle = Get(i - 1).cycle;
+		// entries from before a reset have later cycles
+		if (cycle < from || cycle > now)
+			break;
+		oldest = cycle;
+		commands++;
+	}
+	// a full ring covers less than the window
+	const uint64_t span = commands && end - first == commands ? now - oldest : now - from;
+	return span ? commands * (double)frequency / span : 0.0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// every command the lcd executed with its cycle, plus where the firmware spends its time on the bus: the gap
+// between the two nibbles of a command, busy flag polling, waiting longer than the controller needs and clears or
+// writes that change nothing.
+// a few compares per command, so it is always on. written by the run thread, read racily by the ui
+class LcdCommandLog
+{
+public:
+	static constexpr uint32_t c_capacity = 4096; // power of two
+
+	enum Flags : uint8_t
+	{
+		RedundantClear = 1 << 0, // nothing was written since the last clear
+		RedundantWrite = 1 << 1, // the character was already there
+		RestoredWrite = 1 << 2, // the character was there before the last clear
+		WhileBusy = 1 << 3, // sent before the previous command finished executing
+	};
+
+	struct entry_t
+	{
+		uint64_t cycle;
+		uint16_t command; // D0-D7, RW (bit 8), RS (bit 9)
+		uint8_t flags;
+		uint32_t nibbleGap; // cycles between the enable pulses of the two nibbles, 0 for reads and 8 bit mode
+	};
+
+	struct stats_t
+	{
+		uint64_t commands;
+		uint64_t dataWrites;
+		uint64_t firstCycle;
+		uint64_t lastCycle;
+		uint64_t nibblePairs;
+		uint64_t nibbleCycles; // summed gaps
+		uint64_t maxNibbleGap;
+		uint64_t busyPolls;
+		uint64_t busyWaits; // runs of consecutive polls
+		uint64_t busyWaitCycles; // first poll of a run to the next command
+		uint64_t clears;
+		uint64_t redundantClears;
+		uint64_t redundantWrites;
+		uint64_t restoredWrites;
+		uint64_t executionCycles; // datasheet execution times of the commands, summed
+		uint64_t overWaits; // commands the firmware waited for
+		uint64_t overWaitCycles; // end of execution to the next bus access, summed
+		uint64_t busyViolations; // commands sent while busy
+	};
+
+	LcdCommandLog() : entries(c_capacity) {}
+
+	void Add(uint64_t cycle, uint16_t command, uint8_t flags, uint32_t nibbleGap);
+	// the lcd is busy for cycles executing a command
+	void AddExecution(uint64_t cycles) { stats.executionCycles += cycles; }
+	// the first bus access after the lcd got ready came cycles later
+	void AddOverWait(uint64_t cycles) { stats.overWaits++; stats.overWaitCycles += cycles; }
+	// the cpu was reset, the cycle counter starts over
+	void OnReset() { polling = false; }
+	void Clear();
+
+	uint64_t GetCount() const { return count.load(std::memory_order_acquire); }
+	// index in [GetFirst(), GetCount())
+	uint64_t GetFirst() const { const uint64_t c = GetCount(); return c > c_capacity ? c - c_capacity + 64 : 0; }
+	const entry_t& Get(uint64_t index) const { return entries[index & (c_capacity - 1)]; }
+	const stats_t& GetStats() const { return stats; }
+	// commands per second over the last window cycles before now (or as far back as the ring goes)
+	double GetRate(uint64_t now, uint64_t window, uint32_t frequency) const;
+private:
+	static constexpr uint16_t c_read_busy = 1 << 8; // RW without RS
+
+	std::vector<entry_t> entries;
+	std::atomic<uint64_t> count = 0;
+	stats_t stats = {};
+	bool polling = false;
+	uint64_t pollStart = 0;
+};
@@ -0,0 +1,180 @@
+#include "LogicAnalyzer.h"
+#include "Emulator.h"
+
+void LogicAnalyzer::Attach(Emulator& emulator) {
+	if (this->emulator)
+		return;
+	this->emulator = &emulator;
+	for (const Emulator::named_irq_t& irq : emulator.GetAllocatedIrqs())
+		AddChannel(irq.irq, irq.name, false);
+	for (char port = 'A'; port <= 'D'; port++) {
+		for (uint8_t pin = 0; pin < 8; pin++)
+			AddChannel(emulator.GetIrq(port, pin), std::string("P") + port + (char)('0' + pin), true);
+	}
+	for (auto& channel : channels)
+		emulator.AddCallback(channel->irq, OnChange, channel.get());
+}
+
+void LogicAnalyzer::AddChannel(avr_irq_t* irq, std::string name, bool port) {
+	std::unique_ptr<channel_t> channel = std::make_unique<channel_t>();
+	channel->owner = this;
+	channel->index = (uint32_t)channels.size();
+	channel->irq = irq;
+	channel->name = std::move(name);
+	channel->port = port;
+	channel->level = irq->value & 1;
+	channels.push_back(std::move(channel));
+}
+
+void LogicAnalyzer::Enable(bool enable) {
+	if (enable && emulator) {
+		const uint64_t time = Stamp(emulator->GetCycle());
+		for (auto& channel : channels) {
+			if (channel->port && !ports)
+				continue;
+			if (channel->transitions.empty())
+				channel->transitions.resize(c_capacity);
+			Add(*channel, time, channel->level);
+		}
+	}
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+void LogicAnalyzer::EnablePorts(bool enable) {
+	ports = enable;
+	if (IsEnabled())
+		Enable(true);
+}
+
+void LogicAnalyzer::Clear() {
+	for (auto& channel : channels)
+		channel->count = 0;
+	if (IsEnabled())
+		Enable(true);
+}
+
+void LogicAnalyzer::OnReset(uint64_t end, uint64_t cycle) {
+	// the time continues from the later of the end of the run and the last event
+	const uint64_t time = std::max(end + offset, lastTime);
+	offset = time > cycle ? time - cycle : 0;
+	for (auto& decoder : decoders)
+		decoder->Reset();
+}
+
+void LogicAnalyzer::OnChange(avr_irq_t* irq, uint32_t value, void* param) {
+	channel_t* channel = (channel_t*)param;
+	LogicAnalyzer* analyzer = channel->owner;
+	const bool level = value & 1;
+	if (level == channel->level)
+		return;
+	channel->level = level;
+
+	const bool recording = analyzer->IsEnabled() && (!channel->port || analyzer->ports);
+	if (!recording && analyzer->decoders.empty())
+		return;
+	const uint64_t time = analyzer->Stamp(analyzer->emulator->GetCycle());
+	if (recording)
+		analyzer->Add(*channel, time, level);
+	for (auto& decoder : analyzer->decoders)
+		decoder->OnEdge(channel->index, level, time);
+}
+
+void LogicAnalyzer::Add(channel_t& channel, uint64_t time, bool level) {
+	const uint64_t count = channel.count.load(std::memory_order_relaxed);
+	// a gap in the recording may have skipped changes, re-enabling only adds a level that differs
+	if (count && (At(channel, count - 1) & 1) == level)
+		return;
+	channel.transitions[count & (c_capacity - 1)] = time << 1 | level;
+	channel.count.store(count + 1, std::memory_order_release);
+}
+
+void LogicAnalyzer::AddDecoder(std::unique_ptr<ProtocolDecoder> decoder, const uint32_t* roles) {
+	for (uint32_t role = 0; role < decoder->GetRoleCount(); role++) {
+		const uint32_t channel = roles[role];
+		decoder->Bind(role, channel, channel != ProtocolDecoder::NoChannel && channels[channel]->level);
+	}
+	decoders.push_back(std::move(decoder));
+}
+
+void LogicAnalyzer::RemoveDecoder(uint32_t index) {
+	decoders.erase(decoders.begin() + index);
+}
+
+uint64_t LogicAnalyzer::UpperBound(const channel_t& channel, uint64_t first, uint64_t count, uint64_t time) {
+	while (first < count) {
+		const uint64_t middle = first + (count - first) / 2;
+		if ((At(channel, middle) >> 1) <= time)
+			first = middle + 1;
+		else
+			count = middle;
+	}
+	return first;
+}
+
+uint64_t LogicAnalyzer::GetFirstTime(uint32_t channel) const {
+	const channel_t& c = *channels[channel];
+	const uint64_t count = c.count.load(std::memory_order_acquire);
+	return count ? At(c, GetFirstIndex(count)) >> 1 : NoTime;
+}
+
+int LogicAnalyzer::GetLevel(uint32_t channel, uint64_t time) const {
+	const channel_t& c = *channels[channel];
+	const uint64_t count = c.count.load(std::memory_order_acquire);
+	const uint64_t first = GetFirstIndex(count);
+	const uint64_t index = UpperBound(c, first, count, time);
+	return index > first ? (int)(At(c, index - 1) & 1) : -1;
+}
+
+void LogicAnalyzer::Summarize(uint32_t channel, uint64_t start, double width, uint64_t end, uint8_t* columns, int count) const {
+	const channel_t& c = *channels[channel];
+	const uint64_t transitions = c.count.load(std::memory_order_acquire);
+	const uint64_t first = GetFirstIndex(transitions);
+	const auto column_start = [&](int column) { return start + (uint64_t)(column * width); };
+
+	int column = 0;
+	while (column < count) {
+		const uint64_t from = column_start(column);
+		const uint64_t to = column_start(column + 1);
+		if (from >= end) {
+			columns[column++] = NoData;
+			continue;
+		}
+		// transitions at or before the start of the column
+		const uint64_t index = UpperBound(c, first, transitions, from);
+		const uint8_t level = index > first ? ((At(c, index - 1) & 1) ? High : Low) : NoData;
+		const uint64_t next = index < transitions ? At(c, index) >> 1 : NoTime;
+		if (next < to) {
+			// an edge inside shows both levels, unless the history only starts in this column
+			columns[column++] = level ? (Low | High) : ((At(c, index) & 1) ? High : Low);
+			continue;
+		}
+		// constant up to the column of the next transition (or the current time)
+		const uint64_t until = next < end ? next : end;
+		do {
+			columns[column++] = level;
+		} while (column < count && column_start(column + 1) <= until);
+	}
+}
+
+uint64_t LogicAnalyzer::FindEdge(uint32_t channel, uint64_t time) const {
+	const channel_t& c = *channels[channel];
+	const uint64_t count = c.count.load(std::memory_order_acquire);
+	const uint64_t first = GetFirstIndex(count);
+	if (first >= count)
+		return NoTime;
+	const uint64_t index = UpperBound(c, first, count, time);
+	const uint64_t before = index > first ? At(c, index - 1) >> 1 : NoTime;
+	const uint64_t after = index < count ? At(c, index) >> 1 : NoTime;
+	if (before == NoTime)
+		return after;
+	if (after == NoTime)
+		return before;
+	return time - before <= after - time ? before : after;
+}
+
+uint64_t LogicAnalyzer::FindNextEdge(uint32_t channel, uint64_t time) const {
+	const channel_t& c = *channels[channel];
+	const uint64_t count = c.count.load(std::memory_order_acquire);
+	const uint64_t index = UpperBound(c, GetFirstIndex(count), count, time);
+	return index < count ? At(c, index) >> 1 : NoTime;
+}
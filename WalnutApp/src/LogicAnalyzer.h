@@ -0,0 +1,97 @@
+#pragma once
+#include "ProtocolDecoder.h"
+#include <simavr/lib_api.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Emulator;
+
+// pin history of every io connector irq (lcd bus, leds, buttons) and, on request, of the port pins for the logic
+// analyzer. the irq callbacks append the transitions to a ring per channel on the run thread, the ui reads the rings
+// racily. the protocol decoders are fed the same transitions, whether recording is enabled or not.
+// times are emulated cycles that keep counting across resets.
+//
+// the transitions of a channel are sorted by time, so the ring itself is the level of detail index: the low/high
+// summary of a pixel column is the level before it plus whether the next transition falls inside it, one binary
+// search per column with transitions and one per run of constant columns, however many transitions are recorded
+class LogicAnalyzer
+{
+public:
+	static constexpr uint32_t c_capacity = 1 << 20; // transitions per channel, power of two
+	static constexpr uint64_t NoTime = ~0ull;
+
+	// column summary bits of Summarize
+	enum Column : uint8_t { NoData = 0, Low = 1 << 0, High = 1 << 1 };
+
+	// creates a channel per irq allocated so far and per port pin and registers the callbacks, once
+	void Attach(Emulator& emulator);
+	// enabling starts every channel with its current level. only call while the emulator is stopped
+	void Enable(bool enable);
+	bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+	// the port pins are only recorded on request, their rings take as much memory as the connector ones.
+	// only call while the emulator is stopped
+	void EnablePorts(bool enable);
+	bool IsPortsEnabled() const { return ports; }
+	bool IsPortPin(uint32_t channel) const { return channels[channel]->port; }
+	// only call while the emulator is stopped
+	void Clear();
+	// the cpu was reset, cycle restarts at cycle after ending at end
+	void OnReset(uint64_t end, uint64_t cycle);
+	uint64_t GetTime(uint64_t cycle) const { return cycle + offset; }
+
+	uint32_t GetChannelCount() const { return (uint32_t)channels.size(); }
+	const std::string& GetName(uint32_t channel) const { return channels[channel]->name; }
+	uint64_t GetTransitions(uint32_t channel) const { return channels[channel]->count.load(std::memory_order_acquire); }
+	// time of the oldest transition still in the ring, NoTime if there is none
+	uint64_t GetFirstTime(uint32_t channel) const;
+	// level at time, -1 before the history
+	int GetLevel(uint32_t channel, uint64_t time) const;
+	// summary of count columns of width cycles each starting at start, nothing after end (the current time)
+	void Summarize(uint32_t channel, uint64_t start, double width, uint64_t end, uint8_t* columns, int count) const;
+	// time of the transition nearest to time, NoTime without transitions
+	uint64_t FindEdge(uint32_t channel, uint64_t time) const;
+	// time of the first transition after time, NoTime if there is none
+	uint64_t FindNextEdge(uint32_t channel, uint64_t time) const;
+
+	// binds the roles of the decoder to channels (NoChannel for unbound optional ones). only call while the emulator
+	// is stopped
+	void AddDecoder(std::unique_ptr<ProtocolDecoder> decoder, const uint32_t* roles);
+	void RemoveDecoder(uint32_t index);
+	uint32_t GetDecoderCount() const { return (uint32_t)decoders.size(); }
+	const ProtocolDecoder& GetDecoder(uint32_t index) const { return *decoders[index]; }
+private:
+	struct channel_t
+	{
+		LogicAnalyzer* owner;
+		uint32_t index;
+		avr_irq_t* irq;
+		std::string name;
+		bool port; // PA0-PD7
+		bool level; // connectors raise their irqs on every write, only real changes are transitions
+		std::vector<uint64_t> transitions; // time << 1 | level
+		std::atomic<uint64_t> count = 0; // transitions ever written, the ring holds the last c_capacity
+	};
+
+	static void OnChange(avr_irq_t* irq, uint32_t value, void* param);
+	void AddChannel(avr_irq_t* irq, std::string name, bool port);
+	void Add(channel_t& channel, uint64_t time, bool level);
+	// oldest readable index, keeps some distance to the slots the run thread is about to overwrite
+	static uint64_t GetFirstIndex(uint64_t count) { return count > c_capacity ? count - c_capacity + 1024 : 0; }
+	// time of an event at cycle, never before an earlier one (pins change inside avr_run before a reset is seen)
+	uint64_t Stamp(uint64_t cycle) { lastTime = std::max(lastTime, cycle + offset); return lastTime; }
+	static uint64_t At(const channel_t& channel, uint64_t index) { return channel.transitions[index & (c_capacity - 1)]; }
+	// first index in [first, count) with a time after time, count if there is none
+	static uint64_t UpperBound(const channel_t& channel, uint64_t first, uint64_t count, uint64_t time);
+
+	Emulator* emulator = nullptr;
+	std::atomic_bool enabled = false;
+	bool ports = false;
+	uint64_t offset = 0;
+	uint64_t lastTime = 0;
+	std::vector<std::unique_ptr<channel_t>> channels;
+	std::vector<std::unique_ptr<ProtocolDecoder>> decoders;
+};
@@ -0,0 +1,14 @@
+#include "MemoryTracker.h"
+#include <algorithm>
+
+void MemoryTracker::Resize(uint32_t size) {
+	reads.assign(size, 0);
+	writes.assign(size, 0);
+	lowestStackPointer = NoStackPointer;
+}
+
+void MemoryTracker::Clear() {
+	std::fill(reads.begin(), reads.end(), 0);
+	std::fill(writes.begin(), writes.end(), 0);
+	lowestStackPointer = NoStackPointer;
+}
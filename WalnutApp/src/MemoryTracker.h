@@ -0,0 +1,47 @@
+#pragma once
+#include "AvrDecoder.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// read and write counters per data space byte (registers, io and sram) and the stack high-water mark.
+// the run loop reports the accesses of every instruction while enabled, the ui samples the dense arrays racily
+class MemoryTracker
+{
+public:
+	static constexpr uint16_t NoStackPointer = 0xFFFF;
+
+	// size of the data space (ramend + 1), clears the counters
+	void Resize(uint32_t size);
+	void Clear();
+	// a new run starts, the high-water mark is per run
+	void OnReset() { lowestStackPointer = NoStackPointer; }
+
+	void Enable(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+	bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	void Record(const data_access_t* accesses, int count) {
+		for (int i = 0; i < count; i++) {
+			uint32_t* counters = accesses[i].write ? writes.data() : reads.data();
+			for (uint32_t address = accesses[i].address; address < accesses[i].address + accesses[i].size; address++) {
+				if (address < reads.size())
+					counters[address]++;
+			}
+		}
+	}
+	void UpdateStackPointer(uint16_t sp) {
+		if (sp < lowestStackPointer)
+			lowestStackPointer = sp;
+	}
+
+	uint32_t GetSize() const { return (uint32_t)reads.size(); }
+	uint32_t GetReads(uint32_t address) const { return reads[address]; }
+	uint32_t GetWrites(uint32_t address) const { return writes[address]; }
+	// lowest stack pointer since the last reset, NoStackPointer if nothing ran yet
+	uint16_t GetLowestStackPointer() const { return lowestStackPointer; }
+private:
+	std::atomic_bool enabled = false;
+	std::vector<uint32_t> reads;
+	std::vector<uint32_t> writes;
+	uint16_t lowestStackPointer = NoStackPointer;
+};
@@ -0,0 +1,282 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+void Profiler::Resize(uint32_t words) {
+	wordCycles.assign(words, 0);
+	wordInstructions.assign(words, 0);
+	wordSamples.assign(words, 0);
+	Clear();
+}
+
+void Profiler::Clear() {
+	std::fill(wordCycles.begin(), wordCycles.end(), 0);
+	std::fill(wordInstructions.begin(), wordInstructions.end(), 0);
+	totalCycles = 0;
+	std::fill(wordSamples.begin(), wordSamples.end(), 0);
+	std::fill(std::begin(depthSamples), std::end(depthSamples), 0);
+	lowestStackPointer = 0xFFFF;
+	samples = 0;
+	ClearCalls();
+}
+
+void Profiler::Aggregate(const DebugInfo& debug_info, std::vector<function_t>& functions) const {
+	functions.clear();
+	const DebugInfo::SymbolTable& symbols = debug_info.GetFunctions();
+
+	// symbols are sorted by address, so a single pass over the counters finds every function
+	function_t current = { DebugInfo::NoSymbol, 0, 0, 0 };
+	function_t unknown = { DebugInfo::NoSymbol, 0, 0, 0 };
+	uint32_t next = 0; // next symbol to start
+	uint32_t end = symbols.GetCount() ? symbols.GetAddress(0) : 0xFFFFFFFF; // end of the current range
+	const auto flush = [&]() {
+		if (current.symbol == DebugInfo::NoSymbol) {
+			unknown.cycles += current.cycles;
+			unknown.instructions += current.instructions;
+			unknown.samples += current.samples;
+		} else if (current.instructions || current.samples) {
+			functions.push_back(current);
+		}
+	};
+
+	for (uint32_t address = 0; address < wordCycles.size(); address++) {
+		if (address >= end) {
+			// either the next symbol starts here or the current sized symbol ended
+			if (next < symbols.GetCount() && symbols.GetAddress(next) <= address) {
+				flush();
+				current = { next, 0, 0, 0 };
+				const uint32_t size = symbols.GetSize(next);
+				next++;
+				const uint32_t next_start = next < symbols.GetCount() ? symbols.GetAddress(next) : 0xFFFFFFFF;
+				end = size ? std::min(symbols.GetAddress(current.symbol) + size, next_start) : next_start;
+			} else {
+				flush();
+				current = { DebugInfo::NoSymbol, 0, 0, 0 };
+				end = next < symbols.GetCount() ? symbols.GetAddress(next) : 0xFFFFFFFF;
+			}
+		}
+		current.cycles += wordCycles[address];
+		current.instructions += wordInstructions[address];
+		current.samples += wordSamples[address];
+	}
+	flush();
+
+	// code outside of any symbol is reported as one entry
+	if (unknown.instructions || unknown.samples)
+		functions.push_back(unknown);
+}
+
+bool Profiler::ExportCollapsed(const std::filesystem::path& path, const DebugInfo& debug_info) const {
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	const uint32_t node_count = GetNodeCount();
+	if (node_count <= 1) {
+		std::vector<function_t> functions;
+		Aggregate(debug_info, functions);
+		// sampled estimates if the exact profiler did not run
+		for (const function_t& function : functions) {
+			const uint64_t cycles = totalCycles ? function.cycles : function.samples * sampleInterval;
+			if (!cycles)
+				continue;
+			if (function.symbol == DebugInfo::NoSymbol)
+				file << "[unknown]";
+			else
+				file << debug_info.GetFunctions().GetName(function.symbol);
+			file << ' ' << cycles << '\n';
+		}
+		return (bool)file;
+	}
+
+	// one line per call path, the path is collected leaf to root and written reversed
+	uint32_t path_nodes[c_max_depth + 1];
+	char name[128];
+	for (uint32_t index = 0; index < node_count; index++) {
+		if (!nodes[index].exclusive)
+			continue;
+		uint32_t depth = 0;
+		for (uint32_t node = index; node != NoNode && depth <= c_max_depth; node = nodes[node].parent)
+			path_nodes[depth++] = node;
+		for (uint32_t i = depth; i-- > 0;) {
+			FormatNode(path_nodes[i], debug_info, name, sizeof(name));
+			file << name << (i ? ';' : ' ');
+		}
+		file << nodes[index].exclusive << '\n';
+	}
+	return (bool)file;
+}
+
+void Profiler::EnableCalls(bool enable, uint64_t cycle) {
+	if (enable && nodes.empty()) {
+		// first use, the run thread does not touch these before trackCalls is set
+		nodes.resize(c_max_nodes);
+		spans.resize(c_max_spans);
+		stack.reserve(c_max_depth);
+		stackStarts.reserve(c_max_depth);
+		ClearCalls();
+	}
+	lastCycle = cycle;
+	trackCalls.store(enable, std::memory_order_release);
+}
+
+void Profiler::ClearCalls() {
+	stack.clear();
+	stackStarts.clear();
+	overflow = 0;
+	pendingVector = 0;
+	droppedSpans = 0;
+	spanCount.store(0, std::memory_order_release);
+	if (nodes.empty()) {
+		nodeCount.store(0, std::memory_order_release);
+		return;
+	}
+	nodes[RootNode] = { 0, NoNode, NoNode, NoNode, false, 1, 0 };
+	nodeCount.store(1, std::memory_order_release);
+}
+
+void Profiler::OnReset(uint64_t end, uint64_t cycle) {
+	// open frames are closed so their spans end at the reset
+	while (!stack.empty())
+		Pop(end);
+	overflow = 0;
+	pendingVector = 0;
+	lastCycle = cycle;
+}
+
+void Profiler::OnInstruction(const instruction_t& instruction, uint32_t z, uint64_t cycle) {
+	// if an interrupt was entered right after the instruction its cycles already belong to the isr
+	const uint64_t end = pendingVector ? pendingCycle : cycle;
+	if (instruction.Is(InstructionFlags::Call)) {
+		Push(instruction.Is(InstructionFlags::Indirect) ? z : instruction.target, false, end);
+	} else if (instruction.Is(InstructionFlags::Return)) {
+		Pop(end);
+		// RETI reports the vector that is running again (if any), that is not an entry. simavr executes one more
+		// instruction after RETI before it services the next interrupt, so no entry is lost here
+		if (instruction.mnemonic == Mnemonic::RETI)
+			pendingVector = 0;
+	}
+
+	if (pendingVector) {
+		Push(pendingVector, true, pendingCycle);
+		pendingVector = 0;
+	}
+}
+
+void Profiler::Charge(uint64_t cycle) {
+	const uint32_t top = stack.empty() ? RootNode : stack.back();
+	// a frame closed at the end of a run that was reset has nothing left to charge
+	if (cycle > lastCycle)
+		nodes[top].exclusive += cycle - lastCycle;
+	lastCycle = cycle;
+}
+
+void Profiler::Push(uint32_t function, bool interrupt, uint64_t cycle) {
+	Charge(cycle);
+	if (overflow || stack.size() >= c_max_depth) {
+		overflow++;
+		return;
+	}
+	const uint32_t child = GetChild(stack.empty() ? RootNode : stack.back(), function, interrupt);
+	if (child == NoNode) {
+		overflow++;
+		return;
+	}
+	nodes[child].calls++;
+	stack.push_back(child);
+	stackStarts.push_back(cycle);
+}
+
+void Profiler::Pop(uint64_t cycle) {
+	Charge(cycle);
+	if (overflow) {
+		overflow--;
+		return;
+	}
+	// returns without a tracked frame (frames entered before tracking, stack manipulation) stay in the root
+	if (stack.empty())
+		return;
+
+	const uint32_t count = spanCount.load(std::memory_order_relaxed);
+	if (count < spans.size()) {
+		spans[count] = { stackStarts.back(), cycle, stack.back() };
+		spanCount.store(count + 1, std::memory_order_release);
+	} else {
+		droppedSpans++;
+	}
+	stack.pop_back();
+	stackStarts.pop_back();
+}
+
+uint32_t Profiler::GetChild(uint32_t parent, uint32_t function, bool interrupt) {
+	// few callees per call site, a linear search over the siblings is fine
+	uint32_t* link = &nodes[parent].firstChild;
+	while (*link != NoNode) {
+		const node_t& node = nodes[*link];
+		if (node.function == function && node.interrupt == interrupt)
+			return *link;
+		link = &nodes[*link].nextSibling;
+	}
+
+	const uint32_t count = nodeCount.load(std::memory_order_relaxed);
+	if (count >= nodes.size())
+		return NoNode;
+	nodes[count] = { function, parent, NoNode, NoNode, interrupt, 0, 0 };
+	*link = count;
+	nodeCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+void Profiler::ComputeInclusive(std::vector<uint64_t>& inclusive) const {
+	const uint32_t node_count = GetNodeCount();
+	inclusive.resize(node_count);
+	for (uint32_t i = 0; i < node_count; i++)
+		inclusive[i] = nodes[i].exclusive;
+	// children are always created after their parent
+	for (uint32_t i = node_count; i-- > 1;) {
+		if (nodes[i].parent < i)
+			inclusive[nodes[i].parent] += inclusive[i];
+	}
+}
+
+int Profiler::FormatNode(uint32_t index, const DebugInfo& debug_info, char* buffer, size_t size) const {
+	const node_t& node = nodes[index];
+	if (index == RootNode)
+		return snprintf(buffer, size, "[reset]");
+	if (node.interrupt)
+		return snprintf(buffer, size, "__vector_%u", node.function);
+	const std::string_view name = debug_info.GetFunctionName(node.function);
+	if (name.empty())
+		return snprintf(buffer, size, "0x%04X", node.function);
+	return snprintf(buffer, size, "%.*s", (int)name.size(), name.data());
+}
+
+bool Profiler::ExportTrace(const std::filesystem::path& path, const DebugInfo& debug_info, uint32_t frequency, uint64_t cycle) const {
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	const double us_per_cycle = 1e6 / frequency;
+	char name[128];
+	char event[256];
+	bool first = true;
+	const auto write = [&](uint32_t node, uint64_t start, uint64_t end) {
+		// symbol names are c identifiers, nothing to escape
+		FormatNode(node, debug_info, name, sizeof(name));
+		snprintf(event, sizeof(event), "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+			first ? "" : ",", name, nodes[node].interrupt ? "interrupt" : "function", start * us_per_cycle, (end - start) * us_per_cycle);
+		file << event;
+		first = false;
+	};
+
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	const uint32_t span_count = spanCount.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < span_count; i++)
+		write(spans[i].node, spans[i].start, spans[i].end);
+	// the stack is owned by the run thread, open frames are only exported while it is stopped
+	for (size_t i = 0; i < stack.size(); i++)
+		write(stack[i], stackStarts[i], cycle);
+	file << "\n]}\n";
+	return (bool)file;
+}
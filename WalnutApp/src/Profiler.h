@@ -0,0 +1,161 @@
+#pragma once
+#include "AvrDecoder.h"
+#include "DebugInfo.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// exact cycle profiler. while enabled the run loop charges the cycles of every executed instruction to the
+// counter of its flash word, everything else (functions, flamegraph) is derived from these counters on demand.
+// the counters are written by the run thread only and read racily by the ui, like the rest of the emulator state.
+//
+// with call tracking a shadow call stack follows CALL/RCALL/ICALL/RET/RETI and interrupt entries and builds a
+// call tree (one node per call path) and a timeline of function spans on emulated time.
+class Profiler
+{
+public:
+	static constexpr uint32_t NoNode = 0xFFFFFFFF;
+	static constexpr uint32_t RootNode = 0; // code that was not called from a tracked frame (reset, startup code)
+
+	struct function_t
+	{
+		uint32_t symbol; // index into DebugInfo::GetFunctions(), NoSymbol for code outside of any function
+		uint64_t cycles;
+		uint64_t instructions;
+		uint64_t samples;
+	};
+
+	struct node_t
+	{
+		uint32_t function; // word address of the callee, vector number for interrupts
+		uint32_t parent;
+		uint32_t firstChild;
+		uint32_t nextSibling;
+		bool interrupt;
+		uint64_t calls;
+		uint64_t exclusive; // cycles spent in the frame itself, callees excluded
+	};
+
+	// sizes the counters for a program of words flash words and clears them
+	void Resize(uint32_t words);
+	// only call while the emulator is stopped, the call tree is not safe to reset under the run thread
+	void Clear();
+
+	void Enable(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+	bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	// called by the run loop for every instruction while enabled
+	void Add(uint32_t address, uint32_t cycles) {
+		if (address < wordCycles.size()) {
+			wordCycles[address] += cycles;
+			wordInstructions[address]++;
+		}
+		totalCycles += cycles;
+	}
+
+	uint64_t GetCycles(uint32_t address) const { return address < wordCycles.size() ? wordCycles[address] : 0; }
+	uint64_t GetInstructions(uint32_t address) const { return address < wordInstructions.size() ? wordInstructions[address] : 0; }
+	uint64_t GetTotalCycles() const { return totalCycles; }
+
+	// sampling mode: the emulator calls Sample every interval cycles from a cycle timer, so it costs nothing per
+	// instruction. samples * interval estimates the cycles the exact counters measure
+	void SetSampleInterval(uint32_t interval) { sampleInterval = interval; }
+	uint32_t GetSampleInterval() const { return sampleInterval; }
+	void Sample(uint32_t address, uint16_t stack_pointer) {
+		if (address < wordSamples.size())
+			wordSamples[address]++;
+		// shadow stack depth is only known while calls are tracked
+		const uint32_t depth = GetDepth();
+		depthSamples[depth < c_max_depth ? depth : c_max_depth]++;
+		lowestStackPointer = stack_pointer < lowestStackPointer ? stack_pointer : lowestStackPointer;
+		samples++;
+	}
+	uint64_t GetSamples() const { return samples; }
+	uint64_t GetSamples(uint32_t address) const { return address < wordSamples.size() ? wordSamples[address] : 0; }
+	// number of samples taken at each shadow stack depth, depth is 0..GetMaxDepth()
+	uint64_t GetDepthSamples(uint32_t depth) const { return depthSamples[depth]; }
+	static constexpr uint32_t GetMaxDepth() { return c_max_depth; }
+	// lowest stack pointer seen by a sample, 0xFFFF before the first one
+	uint16_t GetLowestStackPointer() const { return lowestStackPointer; }
+
+	// sums the counters per function. functions is reused between calls, only functions that executed are added
+	void Aggregate(const DebugInfo& debug_info, std::vector<function_t>& functions) const;
+	// collapsed stacks ("frame;frame cycles" per line) as read by flamegraph.pl, speedscope and similar tools.
+	// uses the call tree if there is one, otherwise every function is its own stack
+	bool ExportCollapsed(const std::filesystem::path& path, const DebugInfo& debug_info) const;
+
+	// call tracking. cycle is the current cycle of the emulator, frames entered before enabling are not known
+	void EnableCalls(bool enable, uint64_t cycle);
+	bool IsTrackingCalls() const { return trackCalls.load(std::memory_order_relaxed); }
+
+	// called by the run loop after every instruction while call tracking is enabled. z is the Z register for ICALL
+	void OnInstruction(const instruction_t& instruction, uint32_t z, uint64_t cycle);
+	// current depth of the shadow call stack
+	uint32_t GetDepth() const { return (uint32_t)stack.size() + overflow; }
+	// interrupt entry reported by simavr while the last instruction was executed
+	void OnInterrupt(uint8_t vector, uint64_t cycle) {
+		pendingVector = vector;
+		pendingCycle = cycle;
+	}
+	// the cpu was reset, all frames end at end. cycle is the (possibly restarted) cycle after the reset
+	void OnReset(uint64_t end, uint64_t cycle);
+
+	uint32_t GetNodeCount() const { return nodeCount.load(std::memory_order_acquire); }
+	const node_t& GetNode(uint32_t index) const { return nodes[index]; }
+	// inclusive cycles per node (exclusive cycles of the node and all of its descendants)
+	void ComputeInclusive(std::vector<uint64_t>& inclusive) const;
+	// name of the function of a node ("main", "__vector_3", "0x01A4" without symbols), returns the number of characters written
+	int FormatNode(uint32_t index, const DebugInfo& debug_info, char* buffer, size_t size) const;
+	// spans that did not fit into the timeline
+	uint64_t GetDroppedSpans() const { return droppedSpans; }
+
+	// chrome trace event format (chrome://tracing, https://ui.perfetto.dev), timestamps in emulated microseconds.
+	// frames that are still open end at cycle
+	bool ExportTrace(const std::filesystem::path& path, const DebugInfo& debug_info, uint32_t frequency, uint64_t cycle) const;
+private:
+	static constexpr uint32_t c_max_nodes = 1 << 14;
+	static constexpr uint32_t c_max_spans = 1 << 20;
+	static constexpr uint32_t c_max_depth = 256;
+
+	struct span_t
+	{
+		uint64_t start;
+		uint64_t end;
+		uint32_t node;
+	};
+
+	void Charge(uint64_t cycle);
+	void Push(uint32_t function, bool interrupt, uint64_t cycle);
+	void Pop(uint64_t cycle);
+	uint32_t GetChild(uint32_t parent, uint32_t function, bool interrupt);
+	void ClearCalls();
+
+	std::atomic_bool enabled = false;
+	std::vector<uint64_t> wordCycles;
+	std::vector<uint64_t> wordInstructions;
+	uint64_t totalCycles = 0;
+
+	uint32_t sampleInterval = 0;
+	std::vector<uint64_t> wordSamples;
+	uint64_t depthSamples[c_max_depth + 1] = {};
+	uint16_t lowestStackPointer = 0xFFFF;
+	uint64_t samples = 0;
+
+	std::atomic_bool trackCalls = false;
+	uint8_t pendingVector = 0;
+	uint64_t pendingCycle = 0;
+	uint64_t lastCycle = 0; // cycles since the last push or pop belong to the top frame
+
+	// shadow call stack, frames beyond c_max_depth (or without a free node) are only counted
+	std::vector<uint32_t> stack;
+	std::vector<uint64_t> stackStarts;
+	uint32_t overflow = 0;
+
+	// allocated once up front so the ui never sees a reallocation, published through nodeCount/spanCount
+	std::vector<node_t> nodes;
+	std::atomic<uint32_t> nodeCount = 0;
+	std::vector<span_t> spans;
+	std::atomic<uint32_t> spanCount = 0;
+	uint64_t droppedSpans = 0;
+};
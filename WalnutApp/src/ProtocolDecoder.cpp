@@ -0,0 +1,217 @@
+#include "ProtocolDecoder.h"
+#include <cstdarg>
+#include <cstdio>
+#include <fstream>
+
+ProtocolDecoder::ProtocolDecoder() : annotations(c_annotations) {
+	for (uint32_t& channel : channels)
+		channel = NoChannel;
+}
+
+void ProtocolDecoder::Bind(uint32_t role, uint32_t channel, bool level) {
+	channels[role] = channel;
+	levels = (levels & ~(1u << role)) | ((uint32_t)level << role);
+}
+
+void ProtocolDecoder::Emit(uint64_t start, uint64_t end, const char* format, ...) {
+	const uint64_t index = count.load(std::memory_order_relaxed);
+	annotation_t& annotation = annotations[index & (c_annotations - 1)];
+	annotation.start = start;
+	annotation.end = end;
+	va_list args;
+	va_start(args, format);
+	vsnprintf(annotation.text, sizeof(annotation.text), format, args);
+	va_end(args);
+	count.store(index + 1, std::memory_order_release);
+}
+
+bool ProtocolDecoder::Export(const std::filesystem::path& path, uint32_t frequency) const {
+	std::ofstream file(path);
+	if (!file)
+		return false;
+	const double us = 1e6 / frequency;
+	file << "start_us,end_us,text\n";
+	const uint64_t count = GetAnnotationCount();
+	for (uint64_t i = GetFirstAnnotation(); i < count; i++) {
+		const annotation_t& annotation = GetAnnotation(i);
+		file << annotation.start * us << ',' << annotation.end * us << ",\"";
+		// decoded bytes can be quotes, csv doubles them inside a quoted field
+		for (const char* c = annotation.text; *c; c++) {
+			if (*c == '"')
+				file << '"';
+			file << *c;
+		}
+		file << "\"\n";
+	}
+	return (bool)file;
+}
+
+const char* Hd44780Decoder::GetRoleName(uint32_t role) const {
+	static const char* names[] = { "D4", "D5", "D6", "D7", "RS", "RW", "EN" };
+	return names[role];
+}
+
+void Hd44780Decoder::OnRole(uint32_t role, bool level, uint64_t time) {
+	if (role != EN)
+		return;
+	if (level) {
+		pulseStart = time;
+		return;
+	}
+	// the bus is latched on the falling edge of EN
+	const uint8_t nibble = (uint8_t)(Level(D4) | Level(D5) << 1 | Level(D6) << 2 | Level(D7) << 3);
+	if (!fourBit) {
+		Decode(nibble << 4, Level(RS), Level(RW), pulseStart, time);
+		return;
+	}
+	if (!highNibble) {
+		high = nibble;
+		highNibble = true;
+		byteStart = pulseStart;
+		return;
+	}
+	highNibble = false;
+	Decode(high << 4 | nibble, Level(RS), Level(RW), byteStart, time);
+}
+
+void Hd44780Decoder::Decode(uint8_t byte, bool rs, bool rw, uint64_t start, uint64_t end) {
+	char text[sizeof(annotation_t::text)];
+	Format(byte, rs, rw, text, sizeof(text));
+	Emit(start, end, "%s", text);
+	if (!rs && !rw && (byte & 0xE0) == 0x20)
+		fourBit = !(byte & 0x10);
+}
+
+void Hd44780Decoder::Format(uint8_t byte, bool rs, bool rw, char* text, size_t size) {
+	if (rw) {
+		if (rs)
+			snprintf(text, size, "Read 0x%02X", byte);
+		else
+			snprintf(text, size, "ReadBusy BF=%d AC=0x%02X", byte >> 7, byte & 0x7F);
+	}
+	else if (rs) {
+		if (byte >= 0x20 && byte < 0x7F)
+			snprintf(text, size, "Write '%c'", byte);
+		else
+			snprintf(text, size, "Write 0x%02X", byte);
+	}
+	else if (byte & 0x80)
+		snprintf(text, size, "SetDDRAMAddress 0x%02X", byte & 0x7F);
+	else if (byte & 0x40)
+		snprintf(text, size, "SetCGRAMAddress 0x%02X", byte & 0x3F);
+	else if (byte & 0x20)
+		snprintf(text, size, "FunctionSet DL=%d N=%d F=%d", (byte >> 4) & 1, (byte >> 3) & 1, (byte >> 2) & 1);
+	else if (byte & 0x10)
+		snprintf(text, size, "Shift S/C=%d R/L=%d", (byte >> 3) & 1, (byte >> 2) & 1);
+	else if (byte & 0x08)
+		snprintf(text, size, "DisplayControl D=%d C=%d B=%d", (byte >> 2) & 1, (byte >> 1) & 1, byte & 1);
+	else if (byte & 0x04)
+		snprintf(text, size, "EntryModeSet I/D=%d S=%d", (byte >> 1) & 1, byte & 1);
+	else if (byte & 0x02)
+		snprintf(text, size, "ReturnHome");
+	else if (byte & 0x01)
+		snprintf(text, size, "ClearDisplay");
+	else
+		snprintf(text, size, "Nop");
+}
+
+void UartDecoder::OnRole(uint32_t role, bool level, uint64_t time) {
+	// the line was at the other level up to this edge
+	Advance(time, !level);
+	if (idle && !level) {
+		idle = false;
+		start = time;
+		bit = 0;
+		byte = 0;
+	}
+}
+
+void UartDecoder::Advance(uint64_t time, bool level) {
+	while (!idle) {
+		// data bits in the middle of bits 1-8, the stop bit in the middle of bit 9
+		const uint64_t sample = start + (uint64_t)((bit + 1.5) * cyclesPerBit);
+		if (sample >= time)
+			return;
+		if (bit < 8) {
+			byte |= (uint8_t)level << bit;
+			bit++;
+			continue;
+		}
+		const uint64_t end = start + (uint64_t)(10 * cyclesPerBit);
+		if (!level)
+			Emit(start, end, "0x%02X framing error", byte);
+		else if (byte >= 0x20 && byte < 0x7F)
+			Emit(start, end, "0x%02X '%c'", byte, byte);
+		else
+			Emit(start, end, "0x%02X", byte);
+		idle = true;
+	}
+}
+
+const char* SpiDecoder::GetRoleName(uint32_t role) const {
+	static const char* names[] = { "SCK", "MOSI", "MISO", "CS" };
+	return names[role];
+}
+
+void SpiDecoder::OnRole(uint32_t role, bool level, uint64_t time) {
+	if (role == CS) {
+		// a partial byte is dropped when the chip select changes
+		bits = 0;
+		return;
+	}
+	if (role != SCK)
+		return;
+	if (GetChannel(CS) != NoChannel && Level(CS))
+		return;
+	// the leading edge leaves the idle level, CPHA = 0 samples on it and CPHA = 1 on the trailing edge
+	const bool leading = level != cpol;
+	if (leading == cpha)
+		return;
+	if (!bits)
+		start = time;
+	mosi = (uint8_t)(mosi << 1 | Level(MOSI));
+	miso = (uint8_t)(miso << 1 | Level(MISO));
+	if (++bits < 8)
+		return;
+	bits = 0;
+	if (GetChannel(MISO) != NoChannel)
+		Emit(start, time, "MOSI 0x%02X MISO 0x%02X", mosi, miso);
+	else
+		Emit(start, time, "0x%02X", mosi);
+}
+
+void I2cDecoder::OnRole(uint32_t role, bool level, uint64_t time) {
+	if (role == SDA) {
+		// SDA only changes while SCL is high for start and stop conditions
+		if (!Level(SCL))
+			return;
+		if (!level) {
+			Emit(time, time, state == State::Idle ? "Start" : "Repeated start");
+			state = State::Address;
+			bits = 0;
+		}
+		else if (state != State::Idle) {
+			Emit(time, time, "Stop");
+			state = State::Idle;
+		}
+		return;
+	}
+	// bits are sampled on the rising edge of SCL
+	if (!level || state == State::Idle)
+		return;
+	const bool sda = Level(SDA);
+	if (bits < 8) {
+		if (!bits)
+			start = time;
+		byte = (uint8_t)(byte << 1 | sda);
+		bits++;
+		return;
+	}
+	const char* ack = sda ? "NACK" : "ACK";
+	if (state == State::Address)
+		Emit(start, time, "Address 0x%02X %s %s", byte >> 1, byte & 1 ? "R" : "W", ack);
+	else
+		Emit(start, time, "Data 0x%02X %s", byte, ack);
+	state = State::Data;
+	bits = 0;
+}
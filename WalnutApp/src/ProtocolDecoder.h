@@ -0,0 +1,158 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// streaming protocol decoders on the pin transitions of the logic analyzer. every decoder binds its roles (e.g. SCL
+// and SDA) to logic analyzer channels and is fed their edges on the run thread. state is a few bytes per decoder,
+// the decoded transactions go into a fixed size ring of annotations the ui reads racily.
+// times are logic analyzer times (cycles)
+class ProtocolDecoder
+{
+public:
+	static constexpr uint32_t NoChannel = 0xFFFFFFFF;
+	static constexpr uint32_t c_max_roles = 8;
+	static constexpr uint32_t c_annotations = 4096; // power of two
+
+	struct annotation_t
+	{
+		uint64_t start;
+		uint64_t end;
+		char text[32];
+	};
+
+	ProtocolDecoder();
+	virtual ~ProtocolDecoder() = default;
+
+	virtual const char* GetName() const = 0;
+	virtual uint32_t GetRoleCount() const = 0;
+	virtual const char* GetRoleName(uint32_t role) const = 0;
+	// optional roles may stay unbound (the SPI chip select and MISO)
+	virtual bool IsOptional(uint32_t role) const { return false; }
+	// the decoder starts over, e.g. the cpu was reset
+	virtual void Reset() {}
+
+	// level is the current level of the channel
+	void Bind(uint32_t role, uint32_t channel, bool level);
+	uint32_t GetChannel(uint32_t role) const { return channels[role]; }
+	// called for every transition of a logic analyzer channel
+	void OnEdge(uint32_t channel, bool level, uint64_t time) {
+		for (uint32_t role = 0; role < GetRoleCount(); role++) {
+			if (channels[role] != channel)
+				continue;
+			levels = (levels & ~(1u << role)) | ((uint32_t)level << role);
+			OnRole(role, level, time);
+		}
+	}
+
+	uint64_t GetAnnotationCount() const { return count.load(std::memory_order_acquire); }
+	// index in [GetFirstAnnotation(), GetAnnotationCount())
+	uint64_t GetFirstAnnotation() const { const uint64_t c = GetAnnotationCount(); return c > c_annotations ? c - c_annotations + 64 : 0; }
+	const annotation_t& GetAnnotation(uint64_t index) const { return annotations[index & (c_annotations - 1)]; }
+	// "start_us,end_us,text" per annotation for reports
+	bool Export(const std::filesystem::path& path, uint32_t frequency) const;
+protected:
+	virtual void OnRole(uint32_t role, bool level, uint64_t time) = 0;
+	bool Level(uint32_t role) const { return (levels >> role) & 1; }
+	void Emit(uint64_t start, uint64_t end, const char* format, ...);
+private:
+	uint32_t channels[c_max_roles];
+	uint32_t levels = 0;
+	std::vector<annotation_t> annotations;
+	std::atomic<uint64_t> count = 0;
+};
+
+// HD44780 in 4 bit mode (as on the evaluation board) or 8 bit mode with only D4-D7 wired during initialization.
+// bytes are latched on the falling edge of EN, the function set with DL = 0 switches to nibble pairs
+class Hd44780Decoder : public ProtocolDecoder
+{
+public:
+	enum Role : uint32_t { D4, D5, D6, D7, RS, RW, EN, Count };
+
+	const char* GetName() const override { return "HD44780"; }
+	uint32_t GetRoleCount() const override { return Count; }
+	const char* GetRoleName(uint32_t role) const override;
+	void Reset() override { fourBit = false; highNibble = false; }
+	// "SetDDRAMAddress 0x40", "Write 'H'"
+	static void Format(uint8_t byte, bool rs, bool rw, char* text, size_t size);
+protected:
+	void OnRole(uint32_t role, bool level, uint64_t time) override;
+private:
+	void Decode(uint8_t byte, bool rs, bool rw, uint64_t start, uint64_t end);
+
+	bool fourBit = false;
+	bool highNibble = false; // the high nibble of a pair was latched
+	uint8_t high = 0;
+	uint64_t pulseStart = 0; // rising edge of EN
+	uint64_t byteStart = 0;
+};
+
+// 8N1, idle high. sample points are derived from the edges, so a byte shows up with the first edge after its stop bit
+class UartDecoder : public ProtocolDecoder
+{
+public:
+	enum Role : uint32_t { RX, Count };
+
+	UartDecoder(uint32_t frequency, uint32_t baud) : cyclesPerBit((double)frequency / baud) {}
+	const char* GetName() const override { return "UART"; }
+	uint32_t GetRoleCount() const override { return Count; }
+	const char* GetRoleName(uint32_t role) const override { return "RX"; }
+	void Reset() override { idle = true; }
+protected:
+	void OnRole(uint32_t role, bool level, uint64_t time) override;
+private:
+	// evaluates the sample points before time, the line was at level since the last edge
+	void Advance(uint64_t time, bool level);
+
+	double cyclesPerBit;
+	bool idle = true;
+	uint64_t start = 0;
+	uint32_t bit = 0;
+	uint8_t byte = 0;
+};
+
+// mode 0-3 (CPOL, CPHA), msb first, chip select active low
+class SpiDecoder : public ProtocolDecoder
+{
+public:
+	enum Role : uint32_t { SCK, MOSI, MISO, CS, Count };
+
+	SpiDecoder(uint8_t mode) : cpol((mode >> 1) & 1), cpha(mode & 1) {}
+	const char* GetName() const override { return "SPI"; }
+	uint32_t GetRoleCount() const override { return Count; }
+	const char* GetRoleName(uint32_t role) const override;
+	bool IsOptional(uint32_t role) const override { return role == MISO || role == CS; }
+	void Reset() override { bits = 0; }
+protected:
+	void OnRole(uint32_t role, bool level, uint64_t time) override;
+private:
+	bool cpol;
+	bool cpha;
+	uint32_t bits = 0;
+	uint8_t mosi = 0;
+	uint8_t miso = 0;
+	uint64_t start = 0;
+};
+
+// start, address + direction, data bytes with their acknowledge bit, stop
+class I2cDecoder : public ProtocolDecoder
+{
+public:
+	enum Role : uint32_t { SCL, SDA, Count };
+
+	const char* GetName() const override { return "I2C"; }
+	uint32_t GetRoleCount() const override { return Count; }
+	const char* GetRoleName(uint32_t role) const override { return role == SCL ? "SCL" : "SDA"; }
+	void Reset() override { state = State::Idle; }
+protected:
+	void OnRole(uint32_t role, bool level, uint64_t time) override;
+private:
+	enum class State : uint8_t { Idle, Address, Data };
+
+	State state = State::Idle;
+	uint32_t bits = 0;
+	uint8_t byte = 0;
+	uint64_t start = 0;
+};
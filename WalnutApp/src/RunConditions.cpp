@@ -0,0 +1,172 @@
+#include "RunConditions.h"
+#include "Emulator.h"
+#include <cstdio>
+#include <cstring>
+
+RunConditions::RunConditions() {
+	memset(lcd, ' ', sizeof(lcd));
+}
+
+bool RunConditions::Arm(Emulator& emulator, std::vector<condition_t> conditions, uint64_t timeout, std::string& error) {
+	Disarm(false);
+	// resolve the pins first so nothing is registered on an error
+	std::vector<avr_irq_t*> irqs(conditions.size(), nullptr);
+	for (size_t i = 0; i < conditions.size(); i++) {
+		if (conditions[i].kind == Kind::Pc && !emulator.breakpoints.Covers(conditions[i].address)) {
+			char text[64];
+			snprintf(text, sizeof(text), "address 0x%04X outside the program", conditions[i].address);
+			error = text;
+			return false;
+		}
+		if (conditions[i].kind != Kind::Pin)
+			continue;
+		const std::string& name = conditions[i].pin;
+		for (const Emulator::named_irq_t& irq : emulator.GetAllocatedIrqs()) {
+			if (irq.name == name)
+				irqs[i] = irq.irq;
+		}
+		if (!irqs[i] && name.size() == 3 && name[0] == 'P' && name[1] >= 'A' && name[1] <= 'D' && name[2] >= '0' && name[2] <= '7')
+			irqs[i] = emulator.GetIrq(name[1], name[2] - '0');
+		if (!irqs[i]) {
+			error = "unknown pin " + name;
+			return false;
+		}
+	}
+
+	this->emulator = &emulator;
+	this->conditions = std::move(conditions);
+	this->timeout = timeout;
+	startCycle = emulator.GetCycle();
+	elapsed = 0;
+	met = NoCondition;
+	result.store(Result::Running, std::memory_order_release);
+
+	// a single timer for the earliest Time condition, registering the same timer again would replace it
+	timeCondition = NoCondition;
+	for (uint32_t i = 0; i < (uint32_t)this->conditions.size(); i++) {
+		const condition_t& condition = this->conditions[i];
+		switch (condition.kind) {
+		case Kind::Pin: {
+			pins.push_back(std::make_unique<pin_watch_t>(pin_watch_t{ this, i, irqs[i], condition.level }));
+			emulator.AddCallback(irqs[i], OnPin, pins.back().get());
+			if ((bool)(irqs[i]->value & 1) == condition.level)
+				Finish(Result::Met, i);
+			break;
+		}
+		case Kind::LcdText:
+			watchesLcd = true;
+			if (MatchesLcd(condition))
+				Finish(Result::Met, i);
+			break;
+		case Kind::Pc:
+			emulator.breakpoints.AddStop(condition.address);
+			if (emulator.GetPc().to_ulong() == condition.address)
+				Finish(Result::Met, i);
+			break;
+		case Kind::Time:
+			if (timeCondition == NoCondition || condition.cycles < this->conditions[timeCondition].cycles)
+				timeCondition = i;
+			break;
+		}
+	}
+	RegisterTimers();
+	return true;
+}
+
+void RunConditions::RegisterTimers() {
+	if (timeCondition != NoCondition) {
+		const uint64_t cycles = conditions[timeCondition].cycles;
+		if (cycles <= elapsed)
+			Finish(Result::Met, timeCondition);
+		else
+			emulator->RegisterTimer(cycles - elapsed, TimeTimer, this);
+	}
+	if (timeout) {
+		if (timeout <= elapsed)
+			Finish(Result::Timeout, NoCondition);
+		else
+			emulator->RegisterTimer(timeout - elapsed, TimeoutTimer, this);
+	}
+}
+
+void RunConditions::OnReset(uint64_t end, uint64_t cycle) {
+	if (!emulator || GetResult() != Result::Running)
+		return;
+	if (end > startCycle)
+		elapsed += end - startCycle;
+	startCycle = cycle;
+	RegisterTimers();
+}
+
+void RunConditions::Disarm(bool breakpoint) {
+	if (!emulator)
+		return;
+	for (auto& pin : pins)
+		emulator->RemoveCallback(pin->irq, OnPin, pin.get());
+	pins.clear();
+	for (const condition_t& condition : conditions) {
+		if (condition.kind == Kind::Pc)
+			emulator->breakpoints.RemoveStop(condition.address);
+	}
+	emulator->CancelTimer(TimeTimer, this);
+	emulator->CancelTimer(TimeoutTimer, this);
+	watchesLcd = false;
+	if (GetResult() == Result::Running)
+		result.store(breakpoint ? Result::Breakpoint : Result::Stopped, std::memory_order_release);
+	emulator = nullptr;
+}
+
+bool RunConditions::OnPc(uint32_t pc) {
+	if (GetResult() != Result::Running)
+		return false;
+	for (uint32_t i = 0; i < (uint32_t)conditions.size(); i++) {
+		if (conditions[i].kind == Kind::Pc && conditions[i].address == pc) {
+			Finish(Result::Met, i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void RunConditions::OnLcdText(std::string_view line0, std::string_view line1) {
+	memcpy(lcd[0], line0.data(), sizeof(lcd[0]));
+	memcpy(lcd[1], line1.data(), sizeof(lcd[1]));
+	if (!watchesLcd || GetResult() != Result::Running)
+		return;
+	for (uint32_t i = 0; i < (uint32_t)conditions.size(); i++) {
+		if (conditions[i].kind == Kind::LcdText && MatchesLcd(conditions[i])) {
+			Finish(Result::Met, i);
+			return;
+		}
+	}
+}
+
+void RunConditions::OnPin(avr_irq_t* irq, uint32_t value, void* param) {
+	pin_watch_t* watch = (pin_watch_t*)param;
+	if ((bool)(value & 1) == watch->level)
+		watch->owner->Finish(Result::Met, watch->condition);
+}
+
+avr_cycle_count_t RunConditions::TimeTimer(avr_t* avr, avr_cycle_count_t when, void* param) {
+	RunConditions* conditions = (RunConditions*)param;
+	conditions->Finish(Result::Met, conditions->timeCondition);
+	return 0;
+}
+
+avr_cycle_count_t RunConditions::TimeoutTimer(avr_t* avr, avr_cycle_count_t when, void* param) {
+	((RunConditions*)param)->Finish(Result::Timeout, NoCondition);
+	return 0;
+}
+
+bool RunConditions::MatchesLcd(const condition_t& condition) const {
+	return std::string_view(lcd[condition.line & 1], sizeof(lcd[0])).find(condition.text) != std::string_view::npos;
+}
+
+void RunConditions::Finish(Result result, uint32_t condition) {
+	if (GetResult() != Result::Running)
+		return;
+	met = condition;
+	this->result.store(result, std::memory_order_release);
+	// from the run thread this only ends the loop after the current instruction
+	emulator->Stop();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <simavr/lib_api.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Emulator;
+
+// conditions a run stops on (headless tests: "until LED3 is on", "until the lcd shows X", "until main", "for 2 s"),
+// plus a cycle timeout. every condition is evaluated by the event source of its input only: the irq callback of the
+// pin, the lcd when its text changes, the breakpoint bitmap for code addresses and a cycle timer for the emulated
+// time. nothing is polled, a met condition stops the run from the run thread
+class RunConditions
+{
+public:
+	static constexpr uint32_t NoCondition = 0xFFFFFFFF;
+
+	enum class Kind : uint8_t { Pin, LcdText, Pc, Time };
+	enum class Result : uint8_t { Idle, Running, Met, Timeout, Breakpoint, Stopped };
+
+	struct condition_t
+	{
+		Kind kind = Kind::Pin;
+		std::string pin; // Pin: connector irq ("LED3", "lcd.EN") or port pin ("PB3")
+		bool level = true; // Pin
+		uint8_t line = 0; // LcdText
+		std::string text; // LcdText, anywhere in the visible line
+		uint32_t address = 0; // Pc, word address
+		uint64_t cycles = 0; // Time, emulated cycles from the start of the run
+	};
+
+	RunConditions();
+
+	// registers the sources of every condition. false with error if a pin or code address does not exist, conditions already true
+	// are met right away. only call while the emulator is stopped
+	bool Arm(Emulator& emulator, std::vector<condition_t> conditions, uint64_t timeout, std::string& error);
+	// called by the run thread once the run ended, unregisters everything
+	void Disarm(bool breakpoint);
+	bool IsArmed() const { return emulator != nullptr; }
+
+	Result GetResult() const { return result.load(std::memory_order_acquire); }
+	// index of the condition that was met, NoCondition if none was
+	uint32_t GetMetCondition() const { return met; }
+
+	// the cpu was reset inside the run, which dropped the cycle timers. Time conditions and the timeout keep
+	// counting from the start of the run
+	void OnReset(uint64_t end, uint64_t cycle);
+	// called by the run loop when the breakpoint bit of pc is set, true if a Pc condition is met
+	bool OnPc(uint32_t pc);
+	// called by the lcd whenever a visible character changed, lines are 16 characters
+	void OnLcdText(std::string_view line0, std::string_view line1);
+private:
+	struct pin_watch_t
+	{
+		RunConditions* owner;
+		uint32_t condition;
+		avr_irq_t* irq;
+		bool level;
+	};
+
+	static void OnPin(avr_irq_t* irq, uint32_t value, void* param);
+	static avr_cycle_count_t TimeTimer(avr_t* avr, avr_cycle_count_t when, void* param);
+	static avr_cycle_count_t TimeoutTimer(avr_t* avr, avr_cycle_count_t when, void* param);
+	bool MatchesLcd(const condition_t& condition) const;
+	// registers the timers for what is left of the earliest Time condition and the timeout
+	void RegisterTimers();
+	// stops the run with result, only the first call counts
+	void Finish(Result result, uint32_t condition);
+
+	Emulator* emulator = nullptr;
+	std::vector<condition_t> conditions;
+	std::vector<std::unique_ptr<pin_watch_t>> pins;
+	bool watchesLcd = false;
+	uint32_t timeCondition = NoCondition; // the earliest Time condition, the one the timer is registered for
+	uint64_t timeout = 0;
+	uint64_t startCycle = 0; // cycle the run started at, or the last reset inside it
+	uint64_t elapsed = 0; // cycles of the run before startCycle
+	char lcd[2][16]; // last text the lcd reported, for conditions that are already true when armed
+	std::atomic<Result> result = Result::Idle;
+	uint32_t met = NoCondition;
+};
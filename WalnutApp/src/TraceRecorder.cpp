@@ -0,0 +1,114 @@
+#include "TraceRecorder.h"
+#include <cstring>
+
+bool TraceRecorder::Start(const std::filesystem::path& path, uint8_t options, uint32_t frequency) {
+	Stop();
+	if (!writer.Open(path))
+		return false;
+
+	uint8_t header[17];
+	const uint32_t version = 1;
+	memcpy(header, "AVRTRACE", 8);
+	memcpy(header + 8, &version, sizeof(version));
+	memcpy(header + 12, &frequency, sizeof(frequency));
+	header[16] = options;
+	writer.Write(header, sizeof(header));
+
+	this->options = options;
+	synced = false;
+	pendingDrops = 0;
+	instructions = 0;
+	dropped = 0;
+	enabled = true;
+	return true;
+}
+
+void TraceRecorder::Stop() {
+	enabled = false;
+	writer.Close();
+}
+
+void TraceRecorder::Record(uint64_t cycle, uint32_t pc, const uint8_t* registers, const uint8_t* data, const data_access_t* accesses, int count) {
+	instructions++;
+	uint8_t record[c_max_record];
+	uint8_t* out = record;
+
+	if (!synced || pendingDrops) {
+		if (pendingDrops) {
+			*out++ = 0x81;
+			out = PutVarint(out, pendingDrops);
+		}
+		*out++ = 0x80;
+		out = PutVarint(out, cycle);
+		out = PutVarint(out, pc);
+		lastCycle = cycle;
+		lastPc = pc;
+	}
+
+	uint8_t* header = out++;
+	*header = 0;
+
+	const uint64_t cycles = cycle - lastCycle;
+	if (cycles >= 1 && cycles <= 3)
+		*header |= (uint8_t)cycles;
+	else
+		out = PutVarint(out, cycles);
+
+	const int32_t delta = (int32_t)(pc - lastPc);
+	const uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+	if (zigzag < 7) {
+		*header |= zigzag << 2;
+	}
+	else {
+		*header |= 7 << 2;
+		out = PutVarint(out, zigzag);
+	}
+
+	if (Has(Memory)) {
+		for (int i = 0; i < count; i++) {
+			if (!accesses[i].write)
+				continue;
+			// one write per instruction at most (ST, STS, PUSH, OUT, CALL pushing the return address)
+			*header |= 1 << 5;
+			out = PutVarint(out, accesses[i].address);
+			*out++ = accesses[i].size;
+			for (uint8_t j = 0; j < accesses[i].size; j++)
+				*out++ = data[accesses[i].address + j];
+			break;
+		}
+	}
+
+	if (Has(Registers)) {
+		uint8_t* last = nullptr;
+		for (uint8_t i = 0; i < 32; i++) {
+			if (registers[i] == data[i])
+				continue;
+			if (last)
+				*last |= 0x80;
+			last = out;
+			*out++ = i;
+			*out++ = data[i];
+		}
+		if (last)
+			*header |= 1 << 6;
+	}
+
+	if (!writer.Write(record, (uint32_t)(out - record))) {
+		pendingDrops++;
+		dropped++;
+		return;
+	}
+	synced = true;
+	pendingDrops = 0;
+	lastCycle = cycle;
+	lastPc = pc;
+}
+
+uint8_t* TraceRecorder::PutVarint(uint8_t* out, uint64_t value) {
+	while (value >= 0x80) {
+		*out++ = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
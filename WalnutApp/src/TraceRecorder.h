@@ -0,0 +1,64 @@
+#pragma once
+#include "AsyncFileWriter.h"
+#include "AvrDecoder.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+// execution trace for post-mortem analysis. the run loop encodes one record per instruction into the lock-free ring
+// of an AsyncFileWriter. if the writer falls behind, records are dropped (and counted) instead of stalling the emulator.
+//
+// file format: the header "AVRTRACE", u32 version, u32 cpu frequency, u8 options (little endian), then records.
+// record header byte:
+//   bit 7 clear: an instruction
+//     bits 0-1: cycle delta 1..3 to the previous instruction, 0 = unsigned varint follows
+//     bits 2-4: zigzag pc delta (words) 0..6 to the previous instruction, 7 = zigzag varint follows
+//     bit 5:    a data space write follows: varint address, u8 size, size bytes as written
+//     bit 6:    register writes follow: u8 register (bit 7 set if another one follows), u8 value
+//   0x80: sync, varint cycle and varint pc the deltas of the next instruction are relative to
+//   0x81: varint number of dropped instructions, a sync always follows
+// varints are little endian base 128 (leb128). sequential code without writes takes one byte per instruction.
+class TraceRecorder
+{
+public:
+	enum Options : uint8_t
+	{
+		Registers = 1 << 0, // changed registers r0-r31 (compared before and after every instruction)
+		Memory = 1 << 1, // data space writes of sram, io and the stack
+	};
+
+	// opens the file and starts the writer thread. only call while the emulator is stopped
+	bool Start(const std::filesystem::path& path, uint8_t options, uint32_t frequency);
+	// drains the ring, closes the file. only call while the emulator is stopped
+	void Stop();
+
+	bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+	bool Has(uint8_t option) const { return (options & option) != 0; }
+	// the cycle counter may restart, the next record is written with absolute values
+	void OnReset() { synced = false; }
+
+	// called by the run loop after every instruction while enabled. cycle and pc are from before the instruction,
+	// registers the register file before it (Registers only), data the data space after it
+	void Record(uint64_t cycle, uint32_t pc, const uint8_t* registers, const uint8_t* data, const data_access_t* accesses, int count);
+
+	uint64_t GetInstructions() const { return instructions; }
+	uint64_t GetDropped() const { return dropped; }
+	uint64_t GetBytesWritten() const { return writer.GetBytesWritten(); }
+private:
+	static constexpr uint32_t c_max_record = 128;
+
+	static uint8_t* PutVarint(uint8_t* out, uint64_t value);
+
+	std::atomic_bool enabled = false;
+	uint8_t options = 0;
+
+	// producer state, run thread only
+	bool synced = false;
+	uint64_t lastCycle = 0;
+	uint32_t lastPc = 0;
+	uint64_t pendingDrops = 0;
+	uint64_t instructions = 0;
+	uint64_t dropped = 0;
+
+	AsyncFileWriter writer;
+};
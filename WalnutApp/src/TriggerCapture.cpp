@@ -0,0 +1,195 @@
+#include "TriggerCapture.h"
+#include "Emulator.h"
+#include "Vcd.h"
+#include <array>
+#include <cstdio>
+#include <fstream>
+
+void TriggerCapture::Attach(Emulator& emulator) {
+	if (this->emulator)
+		return;
+	this->emulator = &emulator;
+	for (const Emulator::named_irq_t& irq : emulator.GetAllocatedIrqs())
+		channels.push_back(std::make_unique<channel_t>(channel_t{ this, (uint32_t)channels.size(), irq.irq, irq.name, (uint8_t)(irq.irq->value & 1) }));
+	for (auto& channel : channels)
+		emulator.AddCallback(channel->irq, OnPin, channel.get());
+}
+
+void TriggerCapture::Arm(const trigger_t& trigger, uint64_t pre, uint64_t post) {
+	state = State::Idle;
+	if (instructions.empty()) {
+		instructions.resize(c_instructions);
+		pinEvents.resize(c_pin_events);
+	}
+	this->trigger = trigger;
+	this->pre = pre;
+	this->post = post;
+	triggerTime = NoTime;
+	armTime = GetTime();
+	instructionCount = 0;
+	pinEventCount = 0;
+	baseLevels.resize(channels.size());
+	levels = 0;
+	for (uint32_t i = 0; i < channels.size(); i++) {
+		baseLevels[i] = channels[i]->level;
+		if (i < 64 && baseLevels[i])
+			levels |= 1ull << i;
+	}
+	state.store(State::Armed, std::memory_order_release);
+}
+
+uint64_t TriggerCapture::GetTime() {
+	return Stamp(emulator ? emulator->GetCycle() : 0);
+}
+
+void TriggerCapture::OnReset(uint64_t end, uint64_t cycle) {
+	const uint64_t time = std::max(end + offset, lastTime);
+	offset = time > cycle ? time - cycle : 0;
+}
+
+void TriggerCapture::Fire(uint64_t time) {
+	triggerTime = time;
+	state.store(post ? State::Triggered : State::Done, std::memory_order_release);
+}
+
+void TriggerCapture::OnInstruction(uint64_t cycle, uint32_t pc, const data_access_t* accesses, int count, const uint8_t* data) {
+	const uint64_t time = Stamp(cycle);
+	instructions[instructionCount & (c_instructions - 1)] = time << 16 | (pc & 0xFFFF);
+	instructionCount++;
+	if (GetState() != State::Armed) {
+		Update(time);
+		return;
+	}
+	if (trigger.kind == Trigger::Pc && pc == trigger.address) {
+		Fire(time);
+	}
+	else if (trigger.kind == Trigger::MemoryWrite) {
+		for (int i = 0; i < count; i++) {
+			const data_access_t& access = accesses[i];
+			if (access.write && trigger.address >= access.address && trigger.address < access.address + access.size &&
+				(data[trigger.address] & trigger.mask) == (trigger.value & trigger.mask)) {
+				Fire(time);
+				break;
+			}
+		}
+	}
+}
+
+void TriggerCapture::OnLcdCommand(uint16_t command) {
+	const State s = GetState();
+	if (s == State::Armed && trigger.kind == Trigger::LcdCommand && (command & trigger.mask) == (trigger.value & trigger.mask))
+		Fire(GetTime());
+	else if (s == State::Triggered)
+		Update(GetTime());
+}
+
+void TriggerCapture::OnPin(avr_irq_t* irq, uint32_t value, void* param) {
+	channel_t* channel = (channel_t*)param;
+	TriggerCapture* capture = channel->owner;
+	const uint8_t level = value & 1;
+	if (level == channel->level)
+		return;
+	channel->level = level;
+	if (!capture->IsRecording())
+		return;
+	const uint64_t time = capture->GetTime();
+
+	// the evicted event becomes the level the ring starts with
+	pin_event_t& slot = capture->pinEvents[capture->pinEventCount & (c_pin_events - 1)];
+	if (capture->pinEventCount >= c_pin_events)
+		capture->baseLevels[slot.channel] = slot.level;
+	slot = { time, channel->index, level };
+	capture->pinEventCount++;
+
+	if (channel->index < 64)
+		capture->levels = (capture->levels & ~(1ull << channel->index)) | ((uint64_t)level << channel->index);
+
+	if (capture->GetState() != State::Armed) {
+		capture->Update(time);
+		return;
+	}
+	const trigger_t& trigger = capture->trigger;
+	if (trigger.kind == Trigger::PinEdge && trigger.channel == channel->index) {
+		if (trigger.edge == Edge::Any || (trigger.edge == Edge::Rising) == (level != 0))
+			capture->Fire(time);
+	}
+	else if (trigger.kind == Trigger::PinPattern && (trigger.mask >> channel->index & 1) && ((capture->levels ^ trigger.value) & trigger.mask) == 0) {
+		capture->Fire(time);
+	}
+}
+
+bool TriggerCapture::Save(const std::filesystem::path& path, uint32_t frequency) const {
+	if (GetState() != State::Done)
+		return false;
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	const uint64_t start = triggerTime - armTime > pre ? triggerTime - pre : armTime;
+	const uint64_t end = triggerTime + post;
+	// identifiers: 0 is the pc, 1 the trigger marker, the channels follow
+	std::vector<std::array<char, 4>> codes(channels.size() + 2);
+	for (uint32_t i = 0; i < codes.size(); i++)
+		Vcd::FormatCode(i, codes[i].data());
+	const char* pc_code = codes[0].data();
+	const char* trigger_code = codes[1].data();
+
+	Vcd::Definitions definitions("RWTH PSP Emulator capture");
+	definitions.Scope("capture");
+	definitions.Var(16, pc_code, "pc");
+	definitions.Var(1, trigger_code, "trigger");
+	for (uint32_t i = 0; i < channels.size(); i++)
+		definitions.Var(1, codes[i + 2].data(), channels[i]->name);
+	file << definitions.End();
+
+	// levels at the start of the window from the ring's base levels and the events before it
+	std::vector<uint8_t> levels = baseLevels;
+	uint64_t pin = pinEventCount > c_pin_events ? pinEventCount - c_pin_events : 0;
+	for (; pin < pinEventCount && pinEvents[pin & (c_pin_events - 1)].time < start; pin++)
+		levels[pinEvents[pin & (c_pin_events - 1)].channel] = pinEvents[pin & (c_pin_events - 1)].level;
+	uint64_t instruction = instructionCount > c_instructions ? instructionCount - c_instructions : 0;
+	while (instruction < instructionCount && (instructions[instruction & (c_instructions - 1)] >> 16) < start)
+		instruction++;
+
+	char value[24];
+	file << "#0\n$dumpvars\nbxxxxxxxxxxxxxxxx " << pc_code << '\n';
+	Vcd::FormatValue(0, 1, trigger_code, value);
+	file << value;
+	for (uint32_t i = 0; i < channels.size(); i++) {
+		Vcd::FormatValue(levels[i], 1, codes[i + 2].data(), value);
+		file << value;
+	}
+	file << "$end\n";
+
+	// merge the instructions, the pin events and the trigger by time
+	uint64_t last = NoTime;
+	bool marked = false;
+	const auto timestamp = [&](uint64_t time) {
+		if (time != last)
+			file << '#' << Vcd::ToNs(time - start, frequency) << '\n';
+		last = time;
+	};
+	for (;;) {
+		const uint64_t instruction_time = instruction < instructionCount ? instructions[instruction & (c_instructions - 1)] >> 16 : NoTime;
+		const uint64_t pin_time = pin < pinEventCount ? pinEvents[pin & (c_pin_events - 1)].time : NoTime;
+		const uint64_t trigger_time = marked ? NoTime : triggerTime;
+		const uint64_t time = std::min(instruction_time, std::min(pin_time, trigger_time));
+		if (time == NoTime || time > end)
+			break;
+		timestamp(time);
+		if (time == trigger_time) {
+			Vcd::FormatValue(1, 1, trigger_code, value);
+			marked = true;
+		}
+		else if (time == pin_time) {
+			const pin_event_t& event = pinEvents[pin++ & (c_pin_events - 1)];
+			Vcd::FormatValue(event.level, 1, codes[event.channel + 2].data(), value);
+		}
+		else {
+			Vcd::FormatValue(instructions[instruction++ & (c_instructions - 1)] & 0xFFFF, 16, pc_code, value);
+		}
+		file << value;
+	}
+	timestamp(end);
+	return (bool)file;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "AvrDecoder.h"
+#include <simavr/lib_api.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Emulator;
+
+// logic analyzer style capture. while armed the pin transitions of the connector irqs and the executed pcs go into
+// circular buffers, once the trigger fires recording continues for the post-trigger window and stops. only the
+// window around the trigger is saved, as a vcd with the pins, the pc and a trigger marker.
+// the buffers are written by the run thread, the ui only reads them (and saves) once the capture is done
+class TriggerCapture
+{
+public:
+	static constexpr uint32_t c_instructions = 1 << 20; // power of two
+	static constexpr uint32_t c_pin_events = 1 << 16; // power of two
+	static constexpr uint64_t NoTime = ~0ull;
+
+	enum class State : uint8_t { Idle, Armed, Triggered, Done };
+	enum class Trigger : uint8_t { PinEdge, PinPattern, Pc, MemoryWrite, LcdCommand };
+	enum class Edge : uint8_t { Rising, Falling, Any };
+
+	struct trigger_t
+	{
+		Trigger kind = Trigger::PinEdge;
+		uint32_t channel = 0; // PinEdge
+		Edge edge = Edge::Rising; // PinEdge
+		// PinPattern: bit i is channel i. MemoryWrite: the written byte. LcdCommand: D0-D7, RW (bit 8), RS (bit 9)
+		uint64_t mask = 0;
+		uint64_t value = 0;
+		uint32_t address = 0; // Pc (word address), MemoryWrite (data address)
+	};
+
+	// creates the channels from the irqs allocated so far and registers their callbacks, once
+	void Attach(Emulator& emulator);
+	// starts recording and waits for the trigger. pre and post are the cycles kept before and after it.
+	// only call while the emulator is stopped
+	void Arm(const trigger_t& trigger, uint64_t pre, uint64_t post);
+	void Disarm() { state.store(State::Idle, std::memory_order_release); }
+	State GetState() const { return state.load(std::memory_order_acquire); }
+	// the run loop only has to report instructions while armed or triggered
+	bool IsRecording() const { const State s = GetState(); return s == State::Armed || s == State::Triggered; }
+	// the cpu was reset, cycle restarts at cycle after ending at end
+	void OnReset(uint64_t end, uint64_t cycle);
+
+	uint32_t GetChannelCount() const { return (uint32_t)channels.size(); }
+	const std::string& GetName(uint32_t channel) const { return channels[channel]->name; }
+	const trigger_t& GetTrigger() const { return trigger; }
+	uint64_t GetTriggerTime() const { return triggerTime; }
+
+	// called by the run loop for every instruction while recording. cycle and pc are from before the instruction,
+	// accesses its data accesses and data the data space after it
+	void OnInstruction(uint64_t cycle, uint32_t pc, const data_access_t* accesses, int count, const uint8_t* data);
+	// called by the lcd for every command it executes, command as in trigger_t
+	void OnLcdCommand(uint16_t command);
+
+	// the window around the trigger as vcd, only once the capture is done
+	bool Save(const std::filesystem::path& path, uint32_t frequency) const;
+private:
+	struct channel_t
+	{
+		TriggerCapture* owner;
+		uint32_t index;
+		avr_irq_t* irq;
+		std::string name;
+		uint8_t level; // tracked while not recording too, irqs also report writes that do not change the level
+	};
+
+	struct pin_event_t
+	{
+		uint64_t time;
+		uint32_t channel;
+		uint8_t level;
+	};
+
+	static void OnPin(avr_irq_t* irq, uint32_t value, void* param);
+	void Fire(uint64_t time);
+	// ends the capture once the post-trigger window is over
+	void Update(uint64_t time) {
+		if (GetState() == State::Triggered && time >= triggerTime + post)
+			state.store(State::Done, std::memory_order_release);
+	}
+	// time of an event now, never before an earlier one (pins change inside avr_run before a reset is seen)
+	uint64_t GetTime();
+	uint64_t Stamp(uint64_t cycle) { lastTime = std::max(lastTime, cycle + offset); return lastTime; }
+
+	Emulator* emulator = nullptr;
+	std::vector<std::unique_ptr<channel_t>> channels;
+	std::atomic<State> state = State::Idle;
+	trigger_t trigger;
+	uint64_t pre = 0;
+	uint64_t post = 0;
+	uint64_t triggerTime = NoTime;
+	uint64_t armTime = 0;
+	uint64_t offset = 0;
+	uint64_t lastTime = 0;
+	uint64_t levels = 0; // current level of the first 64 channels for PinPattern
+
+	std::vector<uint64_t> instructions; // time << 16 | pc
+	uint64_t instructionCount = 0;
+	std::vector<pin_event_t> pinEvents;
+	uint64_t pinEventCount = 0;
+	std::vector<uint8_t> baseLevels; // levels before the oldest pin event still in the ring
+};
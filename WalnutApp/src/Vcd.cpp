@@ -0,0 +1,63 @@
+#include "Vcd.h"
+#include <cstring>
+
+void Vcd::FormatCode(uint32_t index, char* code) {
+	int length = 0;
+	do {
+		code[length++] = (char)('!' + index % 94);
+		index /= 94;
+	} while (index && length < 3);
+	code[length] = '\0';
+}
+
+int Vcd::FormatValue(uint32_t value, uint8_t width, const char* code, char* buffer) {
+	int length = 0;
+	if (width == 1) {
+		buffer[length++] = (value & 1) ? '1' : '0';
+	}
+	else {
+		buffer[length++] = 'b';
+		for (int bit = width - 1; bit >= 0; bit--)
+			buffer[length++] = ((value >> bit) & 1) ? '1' : '0';
+		buffer[length++] = ' ';
+	}
+	const size_t size = strlen(code);
+	memcpy(buffer + length, code, size);
+	length += (int)size;
+	buffer[length++] = '\n';
+	buffer[length] = '\0';
+	return length;
+}
+
+uint64_t Vcd::ToNs(uint64_t cycles, uint32_t frequency) {
+	return (cycles / frequency) * 1000000000ull + (cycles % frequency) * 1000000000ull / frequency;
+}
+
+Vcd::Definitions::Definitions(std::string_view version) {
+	text += "$version ";
+	text += version;
+	text += " $end\n$timescale 1ns $end\n";
+}
+
+void Vcd::Definitions::Scope(std::string_view name) {
+	if (scoped)
+		text += "$upscope $end\n";
+	text += "$scope module ";
+	text += name;
+	text += " $end\n";
+	scoped = true;
+}
+
+void Vcd::Definitions::Var(uint8_t width, const char* code, std::string_view name) {
+	text += "$var wire " + std::to_string(width) + " " + code + " ";
+	text += name;
+	text += " $end\n";
+}
+
+std::string& Vcd::Definitions::End() {
+	if (scoped)
+		text += "$upscope $end\n";
+	scoped = false;
+	text += "$enddefinitions $end\n";
+	return text;
+}
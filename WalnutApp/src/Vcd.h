@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// the value change dump format shared by VcdRecorder and TriggerCapture::Save, times are in ns (timescale 1ns)
+namespace Vcd
+{
+	// identifier of the signal with index, base 94 numbers of the printable characters. code needs 4 characters,
+	// up to 3 and the terminator
+	void FormatCode(uint32_t index, char* code);
+	// "b0101 !" for vectors, "1!" for single bits, each with a newline. returns the number of characters written,
+	// buffer needs width + 7
+	int FormatValue(uint32_t value, uint8_t width, const char* code, char* buffer);
+	// cycles at frequency in ns, without overflowing on long runs
+	uint64_t ToNs(uint64_t cycles, uint32_t frequency);
+
+	// the definitions section: version, timescale, scopes and their variables
+	class Definitions
+	{
+	public:
+		explicit Definitions(std::string_view version);
+		// the variables added after it belong to scope, the previous scope is closed
+		void Scope(std::string_view name);
+		void Var(uint8_t width, const char* code, std::string_view name);
+		// closes the last scope and the definitions, the initial values follow
+		std::string& End();
+	private:
+		std::string text;
+		bool scoped = false;
+	};
+}
@@ -0,0 +1,97 @@
+#include "VcdRecorder.h"
+#include "Emulator.h"
+#include "Vcd.h"
+#include <cstdio>
+
+bool VcdRecorder::Start(const std::filesystem::path& path, Emulator& emulator) {
+	Stop();
+	if (!writer.Open(path, 1 << 20))
+		return false;
+
+	// every connector irq, "=lcd.D4" is D4 in the scope lcd
+	signals.clear();
+	for (const Emulator::named_irq_t& irq : emulator.GetAllocatedIrqs()) {
+		std::string name = irq.name;
+		std::string scope = "board";
+		if (const size_t dot = name.find('.'); dot != std::string::npos) {
+			scope = name.substr(0, dot);
+			name.erase(0, dot + 1);
+		}
+		AddSignal(irq.irq, scope, name, 1);
+	}
+	for (char port = 'A'; port <= 'D'; port++) {
+		const std::string scope = std::string("port") + port;
+		AddSignal(emulator.GetIrq(port, IOPORT_IRQ_REG_PORT), scope, std::string("PORT") + port, 8);
+		AddSignal(emulator.GetIrq(port, IOPORT_IRQ_DIRECTION_ALL), scope, std::string("DDR") + port, 8);
+		AddSignal(emulator.GetIrq(port, IOPORT_IRQ_PIN_ALL), scope, std::string("PIN") + port, 8);
+	}
+
+	Vcd::Definitions definitions("RWTH PSP Emulator");
+	for (size_t i = 0; i < signals.size(); i++) {
+		if (i == 0 || signals[i].scope != signals[i - 1].scope)
+			definitions.Scope(signals[i].scope);
+		definitions.Var(signals[i].width, signals[i].code, signals[i].name);
+	}
+	std::string& header = definitions.End();
+	header += "#0\n$dumpvars\n";
+	for (const signal_t& signal : signals) {
+		char value[16];
+		Vcd::FormatValue(signal.irq->value, signal.width, signal.code, value);
+		header += value;
+	}
+	header += "$end\n";
+	writer.Write(header.data(), (uint32_t)header.size());
+
+	this->emulator = &emulator;
+	frequency = emulator.GetFrequency();
+	lastTime = 0;
+	timeOffset = 0;
+	changes = 0;
+	dropped = 0;
+	for (signal_t& signal : signals)
+		emulator.AddCallback(signal.irq, OnChange, &signal);
+	return true;
+}
+
+void VcdRecorder::Stop() {
+	if (emulator) {
+		for (signal_t& signal : signals)
+			emulator->RemoveCallback(signal.irq, OnChange, &signal);
+		emulator = nullptr;
+	}
+	writer.Close();
+}
+
+void VcdRecorder::AddSignal(avr_irq_t* irq, std::string scope, std::string name, uint8_t width) {
+	if (!irq)
+		return;
+	signal_t signal = { this, irq, std::move(scope), std::move(name), width, {} };
+	Vcd::FormatCode((uint32_t)signals.size(), signal.code);
+	signals.push_back(std::move(signal));
+}
+
+void VcdRecorder::OnChange(avr_irq_t* irq, uint32_t value, void* param) {
+	const signal_t* signal = (const signal_t*)param;
+	signal->owner->Change(*signal, value);
+}
+
+void VcdRecorder::Change(const signal_t& signal, uint32_t value) {
+	const uint64_t cycle = emulator->GetCycle();
+	uint64_t time = Vcd::ToNs(cycle, frequency) + timeOffset;
+	if (time < lastTime) {
+		timeOffset += lastTime - time;
+		time = lastTime;
+	}
+
+	char text[48];
+	int length = 0;
+	if (time != lastTime)
+		length = snprintf(text, sizeof(text), "#%llu\n", (unsigned long long)time);
+	length += Vcd::FormatValue(value, signal.width, signal.code, text + length);
+	if (!writer.Write(text, (uint32_t)length)) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	lastTime = time;
+	changes.fetch_add(1, std::memory_order_relaxed);
+}
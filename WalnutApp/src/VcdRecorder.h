@@ -0,0 +1,52 @@
+#pragma once
+#include "AsyncFileWriter.h"
+#include <simavr/lib_api.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class Emulator;
+
+// value change dump (gtkwave, pulseview) of the io connector irqs (lcd bus, leds, buttons) and the PORT, DDR and PIN
+// registers of every port. changes are reported by simavr's irq callbacks, so nothing is added to the run loop.
+// the run thread formats the changes into an AsyncFileWriter, changes that do not fit are dropped and counted
+class VcdRecorder
+{
+public:
+	// registers the callbacks and writes the header. only call while the emulator is stopped
+	bool Start(const std::filesystem::path& path, Emulator& emulator);
+	// unregisters the callbacks and closes the file. only call while the emulator is stopped
+	void Stop();
+	bool IsRecording() const { return emulator != nullptr; }
+
+	uint32_t GetSignalCount() const { return (uint32_t)signals.size(); }
+	uint64_t GetChanges() const { return changes.load(std::memory_order_relaxed); }
+	uint64_t GetDropped() const { return dropped.load(std::memory_order_relaxed); }
+	uint64_t GetBytesWritten() const { return writer.GetBytesWritten(); }
+private:
+	struct signal_t
+	{
+		VcdRecorder* owner;
+		avr_irq_t* irq;
+		std::string scope;
+		std::string name;
+		uint8_t width;
+		char code[4]; // vcd identifier
+	};
+
+	void AddSignal(avr_irq_t* irq, std::string scope, std::string name, uint8_t width);
+	static void OnChange(avr_irq_t* irq, uint32_t value, void* param);
+	void Change(const signal_t& signal, uint32_t value);
+
+	Emulator* emulator = nullptr;
+	std::vector<signal_t> signals; // not resized while recording, the callbacks point into it
+	uint32_t frequency = 1;
+	uint64_t lastTime = ~0ull; // ns
+	uint64_t timeOffset = 0; // keeps the time going forward when a reset restarts the cycle counter
+
+	std::atomic<uint64_t> changes = 0;
+	std::atomic<uint64_t> dropped = 0;
+	AsyncFileWriter writer;
+};
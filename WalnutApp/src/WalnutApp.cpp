@@ -5,10 +5,11 @@
 #include "Walnut/UI/UI.h"
 #include "Emulator.h"
 #include "LCD.h"
+#include "LCDRenderer.h"
 #include "IoConnector.h"
+#include "AllocationCounter.h"
 
 #include <optional>
-#include <format>
 #include <GLFW/glfw3.h>
 #if defined(_WIN32) || defined(_WIN64)
 #define NOMINMAX
@@ -24,6 +25,16 @@
 
 Emulator g_emulator;
 
+std::string SaveFileName(const char* filter);
+
+// formats into a caller provided buffer so the per frame ui code does not allocate
+static const char* ToBinary(std::bitset<8> value, char(&buffer)[9]) {
+	for (int i = 0; i < 8; i++)
+		buffer[i] = value.test(7 - i) ? '1' : '0';
+	buffer[8] = '\0';
+	return buffer;
+}
+
 class MainLayer : public Walnut::Layer
 {
 public:
@@ -32,6 +43,8 @@ public:
 
 		ImGui::BeginGroupPanel("Emulator");
 		if (ImGui::Button("Single step")) g_emulator.SingleStep(); ImGui::SameLine();
+		if (ImGui::Button("Step over")) g_emulator.StepOver();	   ImGui::SameLine();
+		if (ImGui::Button("Step out")) g_emulator.StepOut();	   ImGui::SameLine();
 		if (ImGui::Button("Run")) g_emulator.Run();				   ImGui::SameLine();
 		if (ImGui::Button("Stop")) g_emulator.Stop();			   ImGui::SameLine();
 		if (ImGui::Button("Reset")) g_emulator.Reset();
@@ -39,13 +52,33 @@ public:
 
 
 		ImGui::BeginGroupPanel("Registers");
-		ImGui::Text("PC: %02X", (uint16_t)g_emulator.GetPc().to_ulong());
+		const uint32_t pc = g_emulator.GetPc().to_ulong();
+		const std::string_view function = g_emulator.debug_info.GetFunctionName(pc);
+		if (function.empty())
+			ImGui::Text("PC: %02X", (uint16_t)pc);
+		else
+			ImGui::Text("PC: %02X <%.*s>", (uint16_t)pc, (int)function.size(), function.data());
+		if (g_emulator.breakpoints.GetLastHit() != Breakpoints::NoAddress && !g_emulator.IsRunning())
+			ImGui::TextColored({ 1.f, 0.4f, 0.4f, 1.f }, "Stopped at breakpoint %04X", g_emulator.breakpoints.GetLastHit());
+		Watchpoints::hit_t watch_hit;
+		if (g_emulator.watchpoints.GetLastHit(watch_hit) && !g_emulator.IsRunning()) {
+			static constexpr const char* c_kinds[] = { "", "read", "write", "", "change" };
+			ImGui::TextColored({ 1.f, 0.4f, 0.4f, 1.f }, "Watchpoint %s of %04X at %04X: %02X -> %02X",
+				c_kinds[watch_hit.kind], watch_hit.address, watch_hit.pc, watch_hit.oldValue, watch_hit.newValue);
+		}
+		char binary[9];
 		for (int i = 0; i < 32; i++) {
-			ImGui::Text("R%d: %s", i, g_emulator.GetRegister(i).to_string().c_str());
+			ImGui::Text("R%d: %s", i, ToBinary(g_emulator.GetRegister(i), binary));
 			if (i % 2 == 0) ImGui::SameLine();
 		}
 		ImGui::EndGroupPanel();
 
+#ifndef WL_DIST
+		// allocations of the ui thread during the previous frame, should stay 0 in steady state
+		uint64_t allocations = AllocationCounter::GetThreadAllocations();
+		ImGui::Text("Heap allocations per frame: %llu", (unsigned long long)(allocations - m_LastAllocations));
+		m_LastAllocations = allocations;
+#endif
 
 		ImGui::End();
 
@@ -104,6 +137,7 @@ public:
 private:
 	bool m_AboutModalOpen = false;
 	bool m_FailedToLoadProgram = false;
+	uint64_t m_LastAllocations = 0;
 };
 
 class PortsLayer : public Walnut::Layer
@@ -126,11 +160,12 @@ public:
 
 			ImGui::TableNextColumn();
 
+			char binary[9];
 			for (uint8_t i = 0; i < 4; i++) { // A - D
 				ImGui::Text("port %c", 'A' + i); ImGui::TableNextColumn();
 				for (uint8_t j = 0; j < 3; j++) { // PORT - DDR - PIN
 					uint8_t port_num = i * 3 + j;
-					ImGui::Text("%s", g_emulator.GetIORegister(port_num).to_string().c_str());
+					ImGui::Text("%s", ToBinary(g_emulator.GetIORegister(port_num), binary));
 					ImGui::TableNextColumn();
 				}
 			}
@@ -175,6 +210,7 @@ private:
 			return;
 
 		bool last_row_is_partial = g_emulator.flashend % num_bytes_per_row != 0;
+		const uint32_t pc = g_emulator.GetPc().to_ulong();
 
 		ImGuiListClipper clipper;
 		clipper.Begin((g_emulator.flashend / num_bytes_per_row) + last_row_is_partial);
@@ -204,7 +240,7 @@ private:
 					for (int i = 0; i < num_bytes_per_row; i++) {
 						ImGui::SetColumnWidth(-1, byte_width);
 						// as 2 byte bcs IDA does so...
-						if (g_emulator.GetPc().to_ulong() == (address + i))
+						if (pc == (address + i))
 							ImGui::TextColored({ 1.f, 0, 0, 1.f }, "%04X", *((uint16_t*)g_emulator.memory + (address + i)));
 						else
 							ImGui::Text("%04X", *((uint16_t*)g_emulator.memory + (address + i)));
@@ -223,11 +259,1672 @@ private:
 	}
 };
 
+class SramLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	SramLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("SRAM", &m_open);
+
+		MemoryTracker& tracker = g_emulator.memory_tracker;
+		bool enabled = tracker.IsEnabled();
+		if (ImGui::Checkbox("Track accesses", &enabled))
+			tracker.Enable(enabled);
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			tracker.Clear();
+		ImGui::SameLine();
+		static constexpr const char* c_modes[] = { "Reads + writes", "Reads", "Writes" };
+		ImGui::SetNextItemWidth(150.f);
+		ImGui::Combo("Heatmap", &m_mode, c_modes, (int)std::size(c_modes));
+
+		DrawStack(tracker);
+		DrawHeatmap(tracker);
+
+		ImGui::End();
+	}
+private:
+	static constexpr int c_bytes_per_row = 32;
+	int m_mode = 0;
+
+	uint32_t GetCount(const MemoryTracker& tracker, uint32_t address) const {
+		switch (m_mode) {
+		case 1: return tracker.GetReads(address);
+		case 2: return tracker.GetWrites(address);
+		default: return tracker.GetReads(address) + tracker.GetWrites(address);
+		}
+	}
+
+	// end of the heap as avr-libc's malloc sees it: __brkval once something was allocated, __heap_start before
+	static uint16_t GetHeapEnd() {
+		const DebugInfo::SymbolTable& objects = g_emulator.debug_info.GetObjects();
+		const uint32_t brkval = objects.Find(std::string_view("__brkval"));
+		if (brkval != DebugInfo::NoSymbol) {
+			const uint16_t address = (uint16_t)objects.GetAddress(brkval);
+			const uint16_t value = g_emulator.ReadData(address) | (g_emulator.ReadData(address + 1) << 8);
+			if (value)
+				return value;
+		}
+		const uint32_t heap_start = objects.Find(std::string_view("__heap_start"));
+		return heap_start != DebugInfo::NoSymbol ? (uint16_t)objects.GetAddress(heap_start) : 0;
+	}
+
+	void DrawStack(const MemoryTracker& tracker) {
+		const uint32_t ramend = g_emulator.GetDataSize() - 1;
+		const uint16_t sp = g_emulator.GetStackPointer();
+		const uint16_t lowest = tracker.GetLowestStackPointer();
+		const uint16_t heap_end = GetHeapEnd();
+
+		ImGui::Text("SP: 0x%04X (%u bytes)", sp, ramend - sp);
+		ImGui::SameLine();
+		if (lowest != MemoryTracker::NoStackPointer)
+			ImGui::Text("High-water mark: 0x%04X (%u bytes)", lowest, ramend - lowest);
+		else
+			ImGui::TextDisabled("High-water mark: enable tracking");
+		if (heap_end) {
+			ImGui::SameLine();
+			ImGui::Text("Heap end: 0x%04X", heap_end);
+			// the stack grew into the heap (or the static data if nothing was allocated). the stack is (SP, RAMEND],
+			// the heap [__heap_start, __brkval)
+			const uint16_t lowest_sp = std::min<uint16_t>(sp, lowest);
+			if (lowest_sp + 1 < heap_end)
+				ImGui::TextColored({ 1.f, 0.2f, 0.2f, 1.f }, "Stack/heap collision: the stack reached 0x%04X, below the heap end", lowest_sp + 1);
+		}
+	}
+
+	void DrawHeatmap(const MemoryTracker& tracker) {
+		const uint32_t size = tracker.GetSize();
+		uint32_t max_count = 0;
+		for (uint32_t address = 0; address < size; address++)
+			max_count = std::max(max_count, GetCount(tracker, address));
+		const float log_max = std::log2((float)max_count + 1.f);
+
+		const float cell = ImGui::GetTextLineHeight();
+		const float label_width = ImGui::CalcTextSize("0000 ").x;
+		const uint16_t sp = g_emulator.GetStackPointer();
+		const uint16_t lowest = tracker.GetLowestStackPointer();
+
+		ImGui::BeginChild("Heatmap", ImVec2(0.f, 0.f), false, ImGuiWindowFlags_HorizontalScrollbar);
+		ImDrawList* draw_list = ImGui::GetWindowDrawList();
+		ImGuiListClipper clipper;
+		clipper.Begin((int)((size + c_bytes_per_row - 1) / c_bytes_per_row), cell);
+		while (clipper.Step()) {
+			for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				const uint32_t row_address = row * c_bytes_per_row;
+				const ImVec2 origin = ImGui::GetCursorScreenPos();
+				char label[8];
+				sprintf_s(label, "%04X", row_address);
+				draw_list->AddText(origin, IM_COL32(200, 200, 200, 255), label);
+
+				for (uint32_t i = 0; i < c_bytes_per_row && row_address + i < size; i++) {
+					const uint32_t address = row_address + i;
+					// log scale so rarely touched bytes are still visible next to the hot ones
+					const float heat = log_max > 0.f ? std::log2((float)GetCount(tracker, address) + 1.f) / log_max : 0.f;
+					const ImVec2 min(origin.x + label_width + i * cell, origin.y);
+					const ImVec2 max(min.x + cell - 1.f, min.y + cell - 1.f);
+					draw_list->AddRectFilled(min, max, IM_COL32((int)(40 + 215 * heat), (int)(40 + 80 * heat), (int)(60 * (1.f - heat)), 255));
+					if (address == sp)
+						draw_list->AddRect(min, max, IM_COL32(80, 160, 255, 255));
+					else if (address == lowest)
+						draw_list->AddRect(min, max, IM_COL32(255, 255, 0, 255));
+				}
+
+				ImGui::Dummy(ImVec2(label_width + c_bytes_per_row * cell, cell));
+				if (ImGui::IsItemHovered()) {
+					const float x = ImGui::GetIO().MousePos.x - origin.x - label_width;
+					if (x >= 0.f && x < c_bytes_per_row * cell)
+						DrawTooltip(tracker, row_address + (uint32_t)(x / cell));
+				}
+			}
+		}
+		clipper.End();
+		ImGui::EndChild();
+	}
+
+	static void DrawTooltip(const MemoryTracker& tracker, uint32_t address) {
+		if (address >= tracker.GetSize())
+			return;
+		const DebugInfo::SymbolTable& objects = g_emulator.debug_info.GetObjects();
+		const uint32_t object = objects.Find(address);
+		ImGui::BeginTooltip();
+		ImGui::Text("0x%04X = 0x%02X", address, g_emulator.ReadData((uint16_t)address));
+		if (object != DebugInfo::NoSymbol) {
+			const std::string_view name = objects.GetName(object);
+			ImGui::Text("%.*s+%u", (int)name.size(), name.data(), address - objects.GetAddress(object));
+		}
+		ImGui::Text("Reads: %u Writes: %u", tracker.GetReads(address), tracker.GetWrites(address));
+		ImGui::EndTooltip();
+	}
+};
+
+class DisassemblyLayer : public Walnut::Layer
+{
+public:
+	bool m_open = true;
+
+	DisassemblyLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Disassembly", &m_open);
+
+		const Disassembler& disassembler = g_emulator.disassembler;
+		ImGui::Checkbox("Follow PC", &m_follow_pc);
+		if (!disassembler.IsReady() && disassembler.GetWordCount()) {
+			ImGui::SameLine();
+			ImGui::ProgressBar(disassembler.GetProgress(), ImVec2(200.f, 0.f), "Decoding...");
+		}
+
+		DrawDisassembly(disassembler);
+
+		ImGui::End();
+	}
+private:
+	bool m_follow_pc = true;
+	uint32_t m_last_pc = Disassembler::NoRow;
+
+	void DrawDisassembly(const Disassembler& disassembler) {
+		// the pc is read once per frame and mapped to its row through the index
+		const uint32_t pc = g_emulator.GetPc().to_ulong();
+		const uint32_t pc_row = disassembler.GetRow(pc);
+
+		const DebugInfo& debug_info = g_emulator.debug_info;
+		const DebugInfo::SymbolTable& functions = debug_info.GetFunctions();
+
+		if (!ImGui::BeginTable("Disassembly", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Label", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("0000000000000000").x);
+		ImGui::TableSetupColumn("Address", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("000000").x);
+		ImGui::TableSetupColumn("Data", ImGuiTableColumnFlags_WidthFixed, ImGui::CalcTextSize("0000 0000").x);
+		ImGui::TableSetupColumn("Instruction", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableHeadersRow();
+
+		const float row_height = ImGui::GetTextLineHeightWithSpacing();
+		if (m_follow_pc && pc != m_last_pc && pc_row != Disassembler::NoRow) {
+			ImGui::SetScrollY(pc_row * row_height);
+			m_last_pc = pc;
+		}
+
+		// only the visible rows are formatted
+		ImGuiListClipper clipper;
+		clipper.Begin(disassembler.GetRowCount(), row_height);
+		while (clipper.Step()) {
+			for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				const uint32_t address = disassembler.GetRowAddress(row);
+				const instruction_t& instruction = disassembler.GetInstruction(address);
+
+				ImGui::TableNextRow();
+				if ((uint32_t)row == pc_row)
+					ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, IM_COL32(120, 30, 30, 255));
+
+				// label on the first instruction of a function, the source line as tooltip
+				ImGui::TableNextColumn();
+				const uint32_t function = functions.Find(address);
+				if (function != DebugInfo::NoSymbol && functions.GetAddress(function) == address) {
+					const std::string_view name = functions.GetName(function);
+					ImGui::TextUnformatted(name.data(), name.data() + name.size());
+				}
+
+				// clicking the address toggles a breakpoint
+				ImGui::TableNextColumn();
+				if (g_emulator.breakpoints.Test(address))
+					ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, IM_COL32(200, 40, 40, 255));
+				ImGui::Text("%04X", address);
+				if (ImGui::IsItemClicked())
+					g_emulator.breakpoints.Toggle(address);
+				DebugInfo::line_t line;
+				if (ImGui::IsItemHovered() && debug_info.FindLine(address, line))
+					ImGui::SetTooltip("%.*s:%u", (int)line.file.size(), line.file.data(), line.line);
+
+				ImGui::TableNextColumn();
+				if (instruction.length == 2)
+					ImGui::Text("%04X %04X", disassembler.GetWord(address), disassembler.GetWord(address + 1));
+				else
+					ImGui::Text("%04X", disassembler.GetWord(address));
+
+				// double clicking the instruction runs to it
+				ImGui::TableNextColumn();
+				char text[128];
+				int length = FormatInstruction(instruction, text, sizeof(text));
+				const std::string_view target = debug_info.GetFunctionName(instruction.target);
+				if (instruction.target != instruction_t::NoTarget && !target.empty() && length < (int)sizeof(text))
+					snprintf(text + length, sizeof(text) - length, " <%.*s>", (int)target.size(), target.data());
+				ImGui::TextUnformatted(text);
+				if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+					g_emulator.RunTo(address);
+			}
+		}
+		clipper.End();
+
+		ImGui::EndTable();
+	}
+};
+
+class BreakpointsLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	BreakpointsLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Breakpoints", &m_open);
+
+		if (ImGui::BeginTabBar("Kinds")) {
+			if (ImGui::BeginTabItem("Code")) {
+				DrawCode();
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Data")) {
+				DrawData();
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Run until")) {
+				DrawRunUntil();
+				ImGui::EndTabItem();
+			}
+			ImGui::EndTabBar();
+		}
+
+		ImGui::End();
+	}
+private:
+	char m_location[128] = {};
+	char m_condition[256] = {};
+	std::string m_error;
+	std::vector<Breakpoints::breakpoint_t> m_breakpoints; // copy for drawing, reused every frame
+
+	char m_watch_location[128] = {};
+	int m_watch_kinds = Watchpoints::Write;
+	std::string m_watch_error;
+	std::vector<Watchpoints::watchpoint_t> m_watchpoints;
+
+	std::vector<RunConditions::condition_t> m_until; // any of them stops the run
+	int m_until_kind = 0;
+	int m_until_pin = 0;
+	int m_until_level = 1;
+	int m_until_line = 0;
+	char m_until_text[64] = {};
+	int m_until_ms = 1000;
+	int m_until_timeout_ms = 0;
+	std::string m_until_error;
+	char m_until_description[128] = {}; // Describe writes here, no string per frame
+
+	void DrawRunUntil() {
+		for (size_t i = 0; i < m_until.size(); i++) {
+			ImGui::PushID((int)i);
+			const bool remove = ImGui::SmallButton("Remove");
+			ImGui::SameLine();
+			const bool met = g_emulator.run_conditions.GetResult() == RunConditions::Result::Met && g_emulator.run_conditions.GetMetCondition() == i;
+			if (met)
+				ImGui::TextColored({ 0.4f, 1.f, 0.4f, 1.f }, "%s", Describe(m_until[i]));
+			else
+				ImGui::TextUnformatted(Describe(m_until[i]));
+			ImGui::PopID();
+			if (remove) {
+				m_until.erase(m_until.begin() + i);
+				break;
+			}
+		}
+
+		static constexpr const char* c_kinds[] = { "Pin", "LCD text", "PC", "Emulated time" };
+		ImGui::SetNextItemWidth(120.f);
+		ImGui::Combo("##kind", &m_until_kind, c_kinds, (int)std::size(c_kinds));
+		ImGui::SameLine();
+		const auto& irqs = g_emulator.GetAllocatedIrqs();
+		switch ((RunConditions::Kind)m_until_kind) {
+		case RunConditions::Kind::Pin: {
+			if (irqs.empty())
+				break;
+			m_until_pin = std::min(m_until_pin, (int)irqs.size() - 1);
+			ImGui::SetNextItemWidth(120.f);
+			if (ImGui::BeginCombo("##pin", irqs[m_until_pin].name.c_str())) {
+				for (int i = 0; i < (int)irqs.size(); i++) {
+					if (ImGui::Selectable(irqs[i].name.c_str(), i == m_until_pin))
+						m_until_pin = i;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::SameLine();
+			static constexpr const char* c_levels[] = { "is 0", "is 1" };
+			ImGui::SetNextItemWidth(70.f);
+			ImGui::Combo("##level", &m_until_level, c_levels, (int)std::size(c_levels));
+			break;
+		}
+		case RunConditions::Kind::LcdText: {
+			static constexpr const char* c_lines[] = { "Line 0", "Line 1" };
+			ImGui::SetNextItemWidth(80.f);
+			ImGui::Combo("##line", &m_until_line, c_lines, (int)std::size(c_lines));
+			ImGui::SameLine();
+			ImGui::SetNextItemWidth(160.f);
+			ImGui::InputText("contains", m_until_text, sizeof(m_until_text));
+			break;
+		}
+		case RunConditions::Kind::Pc:
+			ImGui::SetNextItemWidth(200.f);
+			ImGui::InputText("##location", m_until_text, sizeof(m_until_text));
+			if (ImGui::IsItemHovered())
+				ImGui::SetTooltip("Function name, function+offset or word address (0x...)");
+			break;
+		case RunConditions::Kind::Time:
+			ImGui::SetNextItemWidth(120.f);
+			ImGui::InputInt("ms", &m_until_ms, 10, 100);
+			m_until_ms = std::max(m_until_ms, 0);
+			break;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Add##until"))
+			AddCondition(irqs);
+
+		ImGui::SetNextItemWidth(120.f);
+		ImGui::InputInt("Timeout (ms, 0 for none)", &m_until_timeout_ms, 10, 100);
+		m_until_timeout_ms = std::max(m_until_timeout_ms, 0);
+		if (ImGui::Button("Run until") && !m_until.empty()) {
+			m_until_error.clear();
+			g_emulator.RunUntil(m_until, (uint64_t)m_until_timeout_ms * g_emulator.GetFrequency() / 1000, m_until_error);
+		}
+
+		static constexpr const char* c_results[] = { "", "Running", "Condition met", "Timed out", "Stopped at a breakpoint", "Stopped" };
+		const RunConditions::Result result = g_emulator.run_conditions.GetResult();
+		if (result != RunConditions::Result::Idle)
+			ImGui::Text("Result: %s", c_results[(int)result]);
+		if (!m_until_error.empty())
+			ImGui::TextColored({ 1.f, 0.4f, 0.4f, 1.f }, "%s", m_until_error.c_str());
+	}
+
+	void AddCondition(const std::vector<Emulator::named_irq_t>& irqs) {
+		m_until_error.clear();
+		RunConditions::condition_t condition;
+		condition.kind = (RunConditions::Kind)m_until_kind;
+		switch (condition.kind) {
+		case RunConditions::Kind::Pin:
+			if (irqs.empty())
+				return;
+			condition.pin = irqs[m_until_pin].name;
+			condition.level = m_until_level != 0;
+			break;
+		case RunConditions::Kind::LcdText:
+			condition.line = (uint8_t)m_until_line;
+			condition.text = m_until_text;
+			break;
+		case RunConditions::Kind::Pc:
+			condition.address = Breakpoints::ResolveLocation(m_until_text, g_emulator.debug_info);
+			if (condition.address == Breakpoints::NoAddress) {
+				m_until_error = "unknown location";
+				return;
+			}
+			break;
+		case RunConditions::Kind::Time:
+			condition.cycles = (uint64_t)m_until_ms * g_emulator.GetFrequency() / 1000;
+			break;
+		}
+		m_until.push_back(condition);
+	}
+
+	const char* Describe(const RunConditions::condition_t& condition) {
+		switch (condition.kind) {
+		case RunConditions::Kind::Pin:
+			snprintf(m_until_description, sizeof(m_until_description), "%s is %d", condition.pin.c_str(), condition.level);
+			break;
+		case RunConditions::Kind::LcdText:
+			snprintf(m_until_description, sizeof(m_until_description), "LCD line %u contains \"%s\"", condition.line, condition.text.c_str());
+			break;
+		case RunConditions::Kind::Pc: {
+			const std::string_view function = g_emulator.debug_info.GetFunctionName(condition.address);
+			snprintf(m_until_description, sizeof(m_until_description), "PC is %04X <%.*s>", condition.address, (int)function.size(), function.data());
+			break;
+		}
+		case RunConditions::Kind::Time:
+			snprintf(m_until_description, sizeof(m_until_description), "after %.3f ms", condition.cycles * 1e3 / g_emulator.GetFrequency());
+			break;
+		}
+		return m_until_description;
+	}
+
+	void DrawCode() {
+		Breakpoints& breakpoints = g_emulator.breakpoints;
+		ImGui::SetNextItemWidth(200.f);
+		ImGui::InputText("Location", m_location, sizeof(m_location));
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Function name, function+offset or word address (0x...)");
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(250.f);
+		ImGui::InputText("Condition", m_condition, sizeof(m_condition));
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Optional, e.g. r24 == 3 && [counter] > 10");
+		ImGui::SameLine();
+		if (ImGui::Button("Add")) {
+			m_error.clear();
+			if (breakpoints.Add(m_location, m_condition, g_emulator.debug_info, m_error))
+				m_location[0] = m_condition[0] = '\0';
+		}
+		if (!m_error.empty())
+			ImGui::TextColored({ 1.f, 0.4f, 0.4f, 1.f }, "%s", m_error.c_str());
+
+		DrawBreakpoints(breakpoints);
+	}
+
+	static bool KindCheckbox(const char* label, int& kinds, int kind) {
+		bool set = (kinds & kind) != 0;
+		if (!ImGui::Checkbox(label, &set))
+			return false;
+		kinds = set ? kinds | kind : kinds & ~kind;
+		return true;
+	}
+
+	void DrawData() {
+		Watchpoints& watchpoints = g_emulator.watchpoints;
+		ImGui::SetNextItemWidth(200.f);
+		ImGui::InputText("Location##watch", m_watch_location, sizeof(m_watch_location));
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Data symbol or data space address (0x25 is PORTB)");
+		ImGui::SameLine();
+		KindCheckbox("Read", m_watch_kinds, Watchpoints::Read);
+		ImGui::SameLine();
+		KindCheckbox("Write", m_watch_kinds, Watchpoints::Write);
+		ImGui::SameLine();
+		KindCheckbox("Change", m_watch_kinds, Watchpoints::Change);
+		ImGui::SameLine();
+		if (ImGui::Button("Add##watch")) {
+			m_watch_error.clear();
+			if (!m_watch_kinds)
+				m_watch_error = "select at least one kind of access";
+			else if (watchpoints.Add(m_watch_location, (uint8_t)m_watch_kinds, g_emulator.debug_info, m_watch_error))
+				m_watch_location[0] = '\0';
+		}
+		if (!m_watch_error.empty())
+			ImGui::TextColored({ 1.f, 0.4f, 0.4f, 1.f }, "%s", m_watch_error.c_str());
+
+		watchpoints.GetAll(m_watchpoints);
+		if (!ImGui::BeginTable("Watchpoints", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("On", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Location", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Value", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Kinds", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Hits", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableHeadersRow();
+
+		for (size_t i = 0; i < m_watchpoints.size(); i++) {
+			const Watchpoints::watchpoint_t& watchpoint = m_watchpoints[i];
+			ImGui::PushID((int)i);
+			ImGui::TableNextRow();
+
+			ImGui::TableNextColumn();
+			bool enabled = watchpoint.enabled;
+			if (ImGui::Checkbox("##enabled", &enabled))
+				watchpoints.SetEnabled(i, enabled);
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%s (%04X, %u bytes)", watchpoint.name.c_str(), watchpoint.address, watchpoint.size);
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%02X", g_emulator.ReadData(watchpoint.address));
+
+			ImGui::TableNextColumn();
+			int kinds = watchpoint.kinds;
+			bool changed = KindCheckbox("R", kinds, Watchpoints::Read);
+			ImGui::SameLine();
+			changed |= KindCheckbox("W", kinds, Watchpoints::Write);
+			ImGui::SameLine();
+			changed |= KindCheckbox("C", kinds, Watchpoints::Change);
+			if (changed)
+				watchpoints.SetKinds(i, (uint8_t)kinds);
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)watchpoint.hits);
+
+			ImGui::TableNextColumn();
+			if (ImGui::SmallButton("Remove"))
+				watchpoints.Remove(i);
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+
+	void DrawBreakpoints(Breakpoints& breakpoints) {
+		breakpoints.GetAll(m_breakpoints);
+		if (ImGui::Button("Reset hit counts"))
+			breakpoints.ClearHits();
+
+		if (!ImGui::BeginTable("Breakpoints", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("On", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Location", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Condition", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Hits", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Ignore", ImGuiTableColumnFlags_WidthFixed, 100.f);
+		ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableHeadersRow();
+
+		for (const Breakpoints::breakpoint_t& breakpoint : m_breakpoints) {
+			ImGui::PushID((int)breakpoint.address);
+			ImGui::TableNextRow();
+			if (breakpoint.address == breakpoints.GetLastHit())
+				ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, IM_COL32(120, 30, 30, 255));
+
+			ImGui::TableNextColumn();
+			bool enabled = breakpoint.enabled;
+			if (ImGui::Checkbox("##enabled", &enabled))
+				breakpoints.SetEnabled(breakpoint.address, enabled);
+
+			ImGui::TableNextColumn();
+			const std::string_view function = g_emulator.debug_info.GetFunctionName(breakpoint.address);
+			const uint32_t symbol = g_emulator.debug_info.FindFunction(breakpoint.address);
+			if (function.empty())
+				ImGui::Text("%04X", breakpoint.address);
+			else
+				ImGui::Text("%04X <%.*s+%u>", breakpoint.address, (int)function.size(), function.data(), breakpoint.address - g_emulator.debug_info.GetFunctions().GetAddress(symbol));
+
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(breakpoint.conditionText.c_str());
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)breakpoint.hits);
+
+			ImGui::TableNextColumn();
+			int ignore = (int)breakpoint.ignore;
+			ImGui::SetNextItemWidth(-1.f);
+			if (ImGui::InputInt("##ignore", &ignore, 1, 10))
+				breakpoints.SetIgnoreCount(breakpoint.address, (uint64_t)std::max(ignore, 0));
+
+			ImGui::TableNextColumn();
+			if (ImGui::SmallButton("Remove"))
+				breakpoints.Remove(breakpoint.address);
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+};
+
+class ProfilerLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	ProfilerLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Profiler", &m_open);
+
+		Profiler& profiler = g_emulator.profiler;
+		bool enabled = profiler.IsEnabled();
+		if (ImGui::Checkbox("Enabled", &enabled))
+			profiler.Enable(enabled);
+		ImGui::SameLine();
+		bool calls = profiler.IsTrackingCalls();
+		if (ImGui::Checkbox("Call graph", &calls))
+			profiler.EnableCalls(calls, g_emulator.GetCycle());
+		ImGui::SameLine();
+		if (ImGui::Button("Clear")) {
+			// the call tree belongs to the run thread
+			const bool running = g_emulator.IsRunning();
+			g_emulator.Stop();
+			profiler.Clear();
+			if (running)
+				g_emulator.Run();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Export flamegraph")) {
+			std::string path = SaveFileName("Collapsed stacks\0*.folded;*.txt\0");
+			if (!path.empty())
+				profiler.ExportCollapsed(path, g_emulator.debug_info);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Export trace")) {
+			std::string path = SaveFileName("Chrome trace\0*.json\0");
+			if (!path.empty()) {
+				const bool running = g_emulator.IsRunning();
+				g_emulator.Stop();
+				profiler.ExportTrace(path, g_emulator.debug_info, g_emulator.GetFrequency(), g_emulator.GetCycle());
+				if (running)
+					g_emulator.Run();
+			}
+		}
+
+		// sampling runs from a cycle timer and works without the exact profiler
+		bool sampling = profiler.GetSampleInterval() != 0;
+		if (ImGui::Checkbox("Sampling", &sampling))
+			g_emulator.SetSampling(sampling ? m_sample_interval : 0);
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(120.f);
+		if (ImGui::InputInt("Interval (cycles)", &m_sample_interval, 100, 1000, ImGuiInputTextFlags_EnterReturnsTrue)) {
+			m_sample_interval = std::max(m_sample_interval, 1);
+			if (sampling)
+				g_emulator.SetSampling(m_sample_interval);
+		}
+
+		// emulated clock while running, compare with profiling on and off to see its overhead
+		UpdateSpeed();
+		ImGui::Text("Speed: %.2f MHz", m_speed);
+		ImGui::SameLine();
+		ImGui::Text("Profiled cycles: %llu", (unsigned long long)profiler.GetTotalCycles());
+		ImGui::SameLine();
+		ImGui::Text("Samples: %llu", (unsigned long long)profiler.GetSamples());
+		if (profiler.GetLowestStackPointer() != 0xFFFF) {
+			ImGui::SameLine();
+			ImGui::Text("Lowest sampled SP: 0x%04X", profiler.GetLowestStackPointer());
+		}
+
+		// aggregating walks the whole flash and call tree, a few times per second is enough
+		const double now = ImGui::GetTime();
+		const bool refresh = now - m_last_refresh > 0.25;
+		if (refresh)
+			m_last_refresh = now;
+
+		if (ImGui::BeginTabBar("Views")) {
+			if (ImGui::BeginTabItem("Functions")) {
+				DrawHotFunctions(profiler, refresh);
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Call tree")) {
+				DrawCallTree(profiler, refresh);
+				ImGui::EndTabItem();
+			}
+			ImGui::EndTabBar();
+		}
+
+		ImGui::End();
+	}
+private:
+	std::vector<Profiler::function_t> m_functions; // reused every refresh
+	std::vector<uint64_t> m_inclusive; // per call tree node
+	int m_sample_interval = 1000;
+	double m_last_refresh = 0.0;
+	double m_speed_time = 0.0;
+	uint64_t m_speed_cycle = 0;
+	double m_speed = 0.0;
+
+	void UpdateSpeed() {
+		const double now = ImGui::GetTime();
+		if (now - m_speed_time < 0.5)
+			return;
+		const uint64_t cycle = g_emulator.GetCycle();
+		m_speed = cycle >= m_speed_cycle ? (cycle - m_speed_cycle) / (now - m_speed_time) / 1e6 : 0.0;
+		m_speed_cycle = cycle;
+		m_speed_time = now;
+	}
+
+	void DrawHotFunctions(const Profiler& profiler, bool refresh) {
+		const DebugInfo& debug_info = g_emulator.debug_info;
+		if (refresh)
+			profiler.Aggregate(debug_info, m_functions);
+
+		// the sampled share next to the exact one shows how close the statistical profile gets
+		if (!ImGui::BeginTable("Functions", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Sortable | ImGuiTableFlags_Resizable))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Function", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Cycles", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+		ImGui::TableSetupColumn("%", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoSort);
+		ImGui::TableSetupColumn("Instructions", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending);
+		ImGui::TableSetupColumn("Samples", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending);
+		ImGui::TableSetupColumn("Sampled %", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoSort);
+		ImGui::TableHeadersRow();
+
+		ImGuiTableSortSpecs* sort_specs = ImGui::TableGetSortSpecs();
+		if (sort_specs && sort_specs->SpecsCount && (sort_specs->SpecsDirty || refresh)) {
+			SortFunctions(sort_specs->Specs[0]);
+			sort_specs->SpecsDirty = false;
+		}
+
+		const DebugInfo::SymbolTable& functions = debug_info.GetFunctions();
+		const uint64_t total = profiler.GetTotalCycles();
+		const uint64_t samples = profiler.GetSamples();
+		ImGuiListClipper clipper;
+		clipper.Begin((int)m_functions.size());
+		while (clipper.Step()) {
+			for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				const Profiler::function_t& function = m_functions[row];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				if (function.symbol == DebugInfo::NoSymbol) {
+					ImGui::TextUnformatted("[unknown]");
+				} else {
+					const std::string_view name = functions.GetName(function.symbol);
+					ImGui::TextUnformatted(name.data(), name.data() + name.size());
+				}
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)function.cycles);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", total ? 100.0 * function.cycles / total : 0.0);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)function.instructions);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)function.samples);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", samples ? 100.0 * function.samples / samples : 0.0);
+			}
+		}
+		clipper.End();
+
+		ImGui::EndTable();
+	}
+
+	void DrawCallTree(const Profiler& profiler, bool refresh) {
+		if (!profiler.IsTrackingCalls() && profiler.GetNodeCount() <= 1) {
+			ImGui::TextUnformatted("Enable the call graph (ideally before running) to build the call tree.");
+			return;
+		}
+		if (refresh || m_inclusive.size() < profiler.GetNodeCount())
+			profiler.ComputeInclusive(m_inclusive);
+		if (profiler.GetSamples() && profiler.IsTrackingCalls()) {
+			uint64_t depth_sum = 0;
+			uint32_t max_depth = 0;
+			for (uint32_t depth = 0; depth <= Profiler::GetMaxDepth(); depth++) {
+				depth_sum += depth * profiler.GetDepthSamples(depth);
+				if (profiler.GetDepthSamples(depth))
+					max_depth = depth;
+			}
+			ImGui::Text("Sampled call depth: %.2f average, %u max", (double)depth_sum / profiler.GetSamples(), max_depth);
+		}
+		if (profiler.GetDroppedSpans())
+			ImGui::Text("Timeline full, %llu spans dropped", (unsigned long long)profiler.GetDroppedSpans());
+
+		if (!ImGui::BeginTable("Call tree", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Function", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Inclusive", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Exclusive", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableHeadersRow();
+		DrawCallNode(profiler, Profiler::RootNode, m_inclusive.empty() ? 0 : m_inclusive[Profiler::RootNode]);
+		ImGui::EndTable();
+	}
+
+	void DrawCallNode(const Profiler& profiler, uint32_t index, uint64_t total) {
+		// nodes created after the last refresh show up with the next one
+		if (index >= m_inclusive.size())
+			return;
+		const Profiler::node_t& node = profiler.GetNode(index);
+		char name[128];
+		profiler.FormatNode(index, g_emulator.debug_info, name, sizeof(name));
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		const int flags = ImGuiTreeNodeFlags_SpanFullWidth | (node.firstChild == Profiler::NoNode ? ImGuiTreeNodeFlags_Leaf : 0) | (index == Profiler::RootNode ? ImGuiTreeNodeFlags_DefaultOpen : 0);
+		const bool open = ImGui::TreeNodeEx((const void*)(uintptr_t)index, flags, "%s", name);
+		ImGui::TableNextColumn();
+		ImGui::Text("%llu", (unsigned long long)node.calls);
+		ImGui::TableNextColumn();
+		ImGui::Text("%llu (%.1f%%)", (unsigned long long)m_inclusive[index], total ? 100.0 * m_inclusive[index] / total : 0.0);
+		ImGui::TableNextColumn();
+		ImGui::Text("%llu", (unsigned long long)node.exclusive);
+		if (!open)
+			return;
+		for (uint32_t child = node.firstChild; child != Profiler::NoNode; child = profiler.GetNode(child).nextSibling)
+			DrawCallNode(profiler, child, total);
+		ImGui::TreePop();
+	}
+
+	void SortFunctions(const ImGuiTableColumnSortSpecs& spec) {
+		const DebugInfo::SymbolTable& functions = g_emulator.debug_info.GetFunctions();
+		const bool ascending = spec.SortDirection == ImGuiSortDirection_Ascending;
+		std::sort(m_functions.begin(), m_functions.end(), [&](const Profiler::function_t& a, const Profiler::function_t& b) {
+			switch (spec.ColumnIndex) {
+			case 0: {
+				const std::string_view name_a = a.symbol == DebugInfo::NoSymbol ? std::string_view() : functions.GetName(a.symbol);
+				const std::string_view name_b = b.symbol == DebugInfo::NoSymbol ? std::string_view() : functions.GetName(b.symbol);
+				return ascending ? name_a < name_b : name_b < name_a;
+			}
+			case 3: return ascending ? a.instructions < b.instructions : b.instructions < a.instructions;
+			case 4: return ascending ? a.samples < b.samples : b.samples < a.samples;
+			default: return ascending ? a.cycles < b.cycles : b.cycles < a.cycles;
+			}
+			});
+	}
+};
+
+class InterruptsLayer : public Walnut::Layer
+{
+	// atmega644 vector names as in the datasheet
+	static constexpr const char* m_vector_names[] = {
+		"RESET", "INT0", "INT1", "INT2", "PCINT0", "PCINT1", "PCINT2", "PCINT3", "WDT", "TIMER2_COMPA", "TIMER2_COMPB",
+		"TIMER2_OVF", "TIMER1_CAPT", "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA", "TIMER0_COMPB",
+		"TIMER0_OVF", "SPI_STC", "USART0_RX", "USART0_UDRE", "USART0_TX", "ANALOG_COMP", "ADC", "EE_READY", "TWI", "SPM_READY",
+	};
+public:
+	bool m_open = false;
+
+	InterruptsLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Interrupts", &m_open);
+
+		InterruptProfiler& profiler = g_emulator.interrupt_profiler;
+		bool enabled = profiler.IsEnabled();
+		if (ImGui::Checkbox("Enabled", &enabled))
+			profiler.Enable(enabled);
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			profiler.Clear();
+		ImGui::SameLine();
+		if (ImGui::Button("Export")) {
+			std::string path = SaveFileName("CSV\0*.csv\0");
+			if (!path.empty())
+				profiler.Export(path);
+		}
+
+		const uint64_t total = profiler.GetTotalCycles();
+		ImGui::Text("Interrupts disabled: %.2f%% of %llu cycles", total ? 100.0 * profiler.GetDisabledCycles() / total : 0.0, (unsigned long long)total);
+		ImGui::SameLine();
+		ImGui::Text("Max nesting: %u", profiler.GetMaxNesting());
+
+		DrawVectors(profiler);
+		DrawHistograms(profiler);
+
+		ImGui::End();
+	}
+private:
+	int m_selected = -1;
+
+	static const char* GetVectorName(uint32_t vector) {
+		return vector < std::size(m_vector_names) ? m_vector_names[vector] : "";
+	}
+
+	void DrawVectors(const InterruptProfiler& profiler) {
+		const float height = ImGui::GetContentRegionAvail().y * 0.5f;
+		if (!ImGui::BeginTable("Vectors", 8, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable, ImVec2(0.f, height)))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Vector", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Cycles avg", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Cycles max", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Latency avg", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Latency max", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Nesting max", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Time", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableHeadersRow();
+
+		const uint64_t total = profiler.GetTotalCycles();
+		for (uint32_t vector = 1; vector < InterruptProfiler::c_vectors; vector++) {
+			const InterruptProfiler::vector_t& stats = profiler.GetVector(vector);
+			if (!profiler.HasVector(vector) || !stats.count)
+				continue;
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			char label[32];
+			sprintf_s(label, "%u %s", vector, GetVectorName(vector));
+			if (ImGui::Selectable(label, m_selected == (int)vector, ImGuiSelectableFlags_SpanAllColumns))
+				m_selected = vector;
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)stats.count);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", (double)stats.cycles / stats.count);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)stats.maxCycles);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", stats.latencyCount ? (double)stats.latency / stats.latencyCount : 0.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)stats.maxLatency);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", stats.maxNesting);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2f%%", total ? 100.0 * stats.cycles / total : 0.0);
+		}
+		ImGui::EndTable();
+	}
+
+	void DrawHistograms(const InterruptProfiler& profiler) {
+		if (m_selected < 0 || !profiler.HasVector((uint8_t)m_selected)) {
+			ImGui::TextUnformatted("Select a vector to see its histograms.");
+			return;
+		}
+		// log2 buckets, bucket i holds values in [2^(i-1), 2^i)
+		const InterruptProfiler::vector_t& stats = profiler.GetVector((uint8_t)m_selected);
+		float values[InterruptProfiler::c_buckets];
+		const float width = ImGui::GetContentRegionAvail().x;
+
+		for (uint32_t i = 0; i < InterruptProfiler::c_buckets; i++)
+			values[i] = (float)stats.durationHistogram[i];
+		ImGui::PlotHistogram("##cycles", values, InterruptProfiler::c_buckets, 0, "cycles in isr (log2)", 0.f, 3.4e38f, ImVec2(width, 80.f));
+
+		for (uint32_t i = 0; i < InterruptProfiler::c_buckets; i++)
+			values[i] = (float)stats.latencyHistogram[i];
+		ImGui::PlotHistogram("##latency", values, InterruptProfiler::c_buckets, 0, "latency (log2)", 0.f, 3.4e38f, ImVec2(width, 80.f));
+	}
+};
+
+class LogicAnalyzerLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	LogicAnalyzerLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Logic analyzer", &m_open);
+
+		const LogicAnalyzer& analyzer = g_emulator.logic_analyzer;
+		bool enabled = analyzer.IsEnabled();
+		if (ImGui::Checkbox("Record", &enabled))
+			g_emulator.EnableLogicAnalyzer(enabled);
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			g_emulator.ClearLogicAnalyzer();
+		ImGui::SameLine();
+		ImGui::Checkbox("Follow", &m_follow);
+		ImGui::SameLine();
+		if (ImGui::Button("Zoom to fit"))
+			ZoomToFit(analyzer);
+		ImGui::SameLine();
+		bool ports = analyzer.IsPortsEnabled();
+		if (ImGui::Checkbox("Port pins", &ports))
+			g_emulator.EnableLogicAnalyzerPorts(ports);
+
+		const uint64_t now = analyzer.GetTime(g_emulator.GetCycle());
+		if (m_follow)
+			m_start = std::max(0.0, (double)now - m_span);
+
+		char start[32], span[32];
+		FormatTime((uint64_t)m_start, start, sizeof(start));
+		FormatTime((uint64_t)m_span, span, sizeof(span));
+		ImGui::Text("View: %s + %s", start, span);
+		DrawCursors();
+		ImGui::TextDisabled("Wheel zooms, drag pans, click places cursor A (snaps to edges), right click cursor B.");
+
+		DrawWaveforms(analyzer, now);
+		DrawDecoders(analyzer);
+
+		ImGui::End();
+	}
+private:
+	static constexpr float c_row_height = 20.f;
+	static constexpr float c_snap_pixels = 6.f;
+	static constexpr const char* c_decoders[] = { "HD44780", "UART", "SPI", "I2C" };
+
+	double m_start = 0.0; // cycles
+	double m_span = 20000.0; // cycles in the view
+	bool m_follow = true;
+	bool m_dragged = false;
+	uint64_t m_cursors[2] = { LogicAnalyzer::NoTime, LogicAnalyzer::NoTime };
+	std::vector<uint8_t> m_columns;
+	std::vector<uint32_t> m_rows; // channels shown
+	int m_decoder = -1;
+	int m_roles[ProtocolDecoder::c_max_roles] = {}; // channel per role, -1 for none
+	int m_baud = 9600;
+	int m_spi_mode = 0;
+	std::string m_status;
+
+	static void FormatTime(uint64_t cycles, char* buffer, size_t size) {
+		const double us = cycles * 1e6 / g_emulator.GetFrequency();
+		if (us >= 1e6)
+			snprintf(buffer, size, "%.6f s", us / 1e6);
+		else if (us >= 1e3)
+			snprintf(buffer, size, "%.3f ms", us / 1e3);
+		else
+			snprintf(buffer, size, "%.3f us", us);
+	}
+
+	void DrawCursors() {
+		char text[32];
+		for (int i = 0; i < 2; i++) {
+			if (i)
+				ImGui::SameLine();
+			if (m_cursors[i] == LogicAnalyzer::NoTime) {
+				ImGui::TextDisabled("%c: -", 'A' + i);
+				continue;
+			}
+			FormatTime(m_cursors[i], text, sizeof(text));
+			ImGui::Text("%c: %s", 'A' + i, text);
+		}
+		if (m_cursors[0] != LogicAnalyzer::NoTime && m_cursors[1] != LogicAnalyzer::NoTime) {
+			const uint64_t delta = m_cursors[0] > m_cursors[1] ? m_cursors[0] - m_cursors[1] : m_cursors[1] - m_cursors[0];
+			FormatTime(delta, text, sizeof(text));
+			ImGui::SameLine();
+			ImGui::Text("B-A: %s (%llu cycles", text, (unsigned long long)delta);
+			ImGui::SameLine(0.f, 0.f);
+			if (delta)
+				ImGui::Text(", %.3f kHz)", g_emulator.GetFrequency() / (double)delta / 1e3);
+			else
+				ImGui::TextUnformatted(")");
+		}
+	}
+
+	void ZoomToFit(const LogicAnalyzer& analyzer) {
+		uint64_t first = LogicAnalyzer::NoTime;
+		for (uint32_t channel = 0; channel < analyzer.GetChannelCount(); channel++)
+			first = std::min(first, analyzer.GetFirstTime(channel));
+		if (first == LogicAnalyzer::NoTime)
+			return;
+		const uint64_t now = analyzer.GetTime(g_emulator.GetCycle());
+		m_start = (double)first;
+		m_span = std::max(100.0, (double)(now - first));
+		m_follow = false;
+	}
+
+	void DrawWaveforms(const LogicAnalyzer& analyzer, uint64_t now) {
+		if (!analyzer.GetChannelCount()) {
+			ImGui::TextUnformatted("Start recording to see the connector pins.");
+			return;
+		}
+		m_rows.clear();
+		for (uint32_t channel = 0; channel < analyzer.GetChannelCount(); channel++) {
+			if (!analyzer.IsPortPin(channel) || analyzer.IsPortsEnabled())
+				m_rows.push_back(channel);
+		}
+		const uint32_t channels = (uint32_t)m_rows.size();
+		const uint32_t decoders = analyzer.GetDecoderCount();
+		float label_width = 0.f;
+		for (uint32_t channel : m_rows)
+			label_width = std::max(label_width, ImGui::CalcTextSize(analyzer.GetName(channel).c_str()).x);
+		for (uint32_t decoder = 0; decoder < decoders; decoder++)
+			label_width = std::max(label_width, ImGui::CalcTextSize(analyzer.GetDecoder(decoder).GetName()).x);
+		label_width += 8.f;
+
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		const float width = std::max(ImGui::GetContentRegionAvail().x - label_width, 16.f);
+		const float height = (channels + decoders) * c_row_height;
+		const int columns = (int)width;
+		const double cycles_per_column = m_span / columns;
+		ImGui::InvisibleButton("##waveforms", ImVec2(label_width + width, height), ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+		const bool hovered = ImGui::IsItemHovered();
+		const ImGuiIO& io = ImGui::GetIO();
+		const float mouse_x = io.MousePos.x - origin.x - label_width;
+		const double mouse_time = m_start + mouse_x * cycles_per_column;
+
+		if (hovered && io.MouseWheel != 0.f) {
+			// zoom around the time under the mouse
+			const double span = std::clamp(m_span * std::pow(0.8, io.MouseWheel), (double)columns / 16.0, 1e13);
+			m_start = std::max(0.0, mouse_time - (mouse_time - m_start) * span / m_span);
+			m_span = span;
+			m_follow = false;
+		}
+		if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+			m_start = std::max(0.0, m_start - io.MouseDelta.x * cycles_per_column);
+			m_follow = false;
+			m_dragged = true;
+		}
+		if (hovered && mouse_x >= 0.f && channels) {
+			const uint32_t channel = m_rows[std::min((uint32_t)((io.MousePos.y - origin.y) / c_row_height), channels - 1)];
+			if (ImGui::IsMouseReleased(ImGuiMouseButton_Left) && !m_dragged)
+				m_cursors[0] = Snap(analyzer, channel, mouse_time, cycles_per_column);
+			if (ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+				m_cursors[1] = Snap(analyzer, channel, mouse_time, cycles_per_column);
+		}
+		if (!ImGui::IsMouseDown(ImGuiMouseButton_Left))
+			m_dragged = false;
+
+		ImDrawList* draw_list = ImGui::GetWindowDrawList();
+		m_columns.resize(columns);
+		const ImU32 color = IM_COL32(80, 220, 120, 255);
+		for (uint32_t row = 0; row < channels; row++) {
+			const uint32_t channel = m_rows[row];
+			const float top = origin.y + row * c_row_height;
+			const float high = top + 3.f;
+			const float low = top + c_row_height - 3.f;
+			const float left = origin.x + label_width;
+			draw_list->AddText(ImVec2(origin.x, top + 2.f), IM_COL32(200, 200, 200, 255), analyzer.GetName(channel).c_str());
+			draw_list->AddLine(ImVec2(left, top + c_row_height - 0.5f), ImVec2(left + width, top + c_row_height - 0.5f), IM_COL32(60, 60, 60, 255));
+
+			// runs of equal columns become one line, columns with edges a filled bar
+			analyzer.Summarize(channel, (uint64_t)m_start, cycles_per_column, now, m_columns.data(), columns);
+			uint8_t previous = LogicAnalyzer::NoData;
+			for (int x = 0; x < columns;) {
+				const uint8_t value = m_columns[x];
+				int end = x + 1;
+				while (end < columns && m_columns[end] == value)
+					end++;
+				const float x0 = left + x, x1 = left + end;
+				if (value == LogicAnalyzer::Low || value == LogicAnalyzer::High) {
+					const float y = value == LogicAnalyzer::High ? high : low;
+					draw_list->AddLine(ImVec2(x0, y), ImVec2(x1, y), color);
+					if ((previous == LogicAnalyzer::Low || previous == LogicAnalyzer::High) && previous != value)
+						draw_list->AddLine(ImVec2(x0, high), ImVec2(x0, low), color);
+				}
+				else if (value == (LogicAnalyzer::Low | LogicAnalyzer::High)) {
+					draw_list->AddRectFilled(ImVec2(x0, high), ImVec2(x1, low + 1.f), color);
+				}
+				previous = value;
+				x = end;
+			}
+		}
+		for (uint32_t decoder = 0; decoder < decoders; decoder++)
+			DrawAnnotations(analyzer.GetDecoder(decoder), origin.x, origin.y + (channels + decoder) * c_row_height, label_width, width, cycles_per_column);
+
+		// cursors across all channels
+		for (int i = 0; i < 2; i++) {
+			if (m_cursors[i] == LogicAnalyzer::NoTime || m_cursors[i] < m_start)
+				continue;
+			const float x = (float)((m_cursors[i] - m_start) / cycles_per_column);
+			if (x > width)
+				continue;
+			const ImU32 cursor_color = i ? IM_COL32(80, 200, 255, 255) : IM_COL32(255, 220, 60, 255);
+			draw_list->AddLine(ImVec2(origin.x + label_width + x, origin.y), ImVec2(origin.x + label_width + x, origin.y + height), cursor_color);
+		}
+	}
+
+	// a box per annotation in view, with its text if it fits
+	void DrawAnnotations(const ProtocolDecoder& decoder, float x, float top, float label_width, float width, double cycles_per_column) {
+		ImDrawList* draw_list = ImGui::GetWindowDrawList();
+		const float left = x + label_width;
+		draw_list->AddText(ImVec2(x, top + 2.f), IM_COL32(200, 200, 200, 255), decoder.GetName());
+		draw_list->PushClipRect(ImVec2(left, top), ImVec2(left + width, top + c_row_height), true);
+		const double end = m_start + width * cycles_per_column;
+		const uint64_t count = decoder.GetAnnotationCount();
+		for (uint64_t i = decoder.GetFirstAnnotation(); i < count; i++) {
+			const ProtocolDecoder::annotation_t& annotation = decoder.GetAnnotation(i);
+			if (annotation.end < m_start || annotation.start > end)
+				continue;
+			const float x0 = left + (float)((annotation.start - m_start) / cycles_per_column);
+			const float x1 = std::max(left + (float)((annotation.end - m_start) / cycles_per_column), x0 + 2.f);
+			draw_list->AddRectFilled(ImVec2(x0, top + 2.f), ImVec2(x1, top + c_row_height - 2.f), IM_COL32(60, 90, 160, 255), 3.f);
+			const ImVec2 size = ImGui::CalcTextSize(annotation.text);
+			if (size.x + 4.f <= x1 - x0)
+				draw_list->AddText(ImVec2(x0 + 2.f, top + (c_row_height - size.y) * 0.5f), IM_COL32(255, 255, 255, 255), annotation.text);
+		}
+		draw_list->PopClipRect();
+	}
+
+	void DrawDecoders(const LogicAnalyzer& analyzer) {
+		if (!ImGui::CollapsingHeader("Decoders"))
+			return;
+		// the channels only exist once the analyzer is attached
+		if (!analyzer.GetChannelCount())
+			g_emulator.EnableLogicAnalyzer(false);
+		const uint32_t channels = analyzer.GetChannelCount();
+
+		for (uint32_t i = 0; i < analyzer.GetDecoderCount(); i++) {
+			const ProtocolDecoder& decoder = analyzer.GetDecoder(i);
+			ImGui::PushID((int)i);
+			ImGui::Text("%s (", decoder.GetName());
+			for (uint32_t role = 0; role < decoder.GetRoleCount(); role++) {
+				const uint32_t channel = decoder.GetChannel(role);
+				ImGui::SameLine(0.f, role ? -1.f : 0.f);
+				ImGui::Text("%s=%s", decoder.GetRoleName(role), channel == ProtocolDecoder::NoChannel ? "-" : analyzer.GetName(channel).c_str());
+			}
+			ImGui::SameLine(0.f, 0.f);
+			ImGui::Text("): %llu annotations", (unsigned long long)decoder.GetAnnotationCount());
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Export")) {
+				std::string path = SaveFileName("CSV\0*.csv\0");
+				if (!path.empty())
+					m_status = decoder.Export(path, g_emulator.GetFrequency()) ? "Exported to " + path : "Could not write " + path;
+			}
+			ImGui::SameLine();
+			const bool remove = ImGui::SmallButton("Remove");
+			ImGui::PopID();
+			if (remove) {
+				g_emulator.RemoveDecoder(i);
+				break;
+			}
+		}
+
+		ImGui::SetNextItemWidth(120.f);
+		if (ImGui::Combo("Decoder", &m_decoder, c_decoders, (int)std::size(c_decoders)))
+			DefaultRoles(analyzer);
+		if (m_decoder < 0)
+			return;
+		std::unique_ptr<ProtocolDecoder> decoder = CreateDecoder();
+		for (uint32_t role = 0; role < decoder->GetRoleCount(); role++) {
+			if (role % 4)
+				ImGui::SameLine();
+			const int channel = m_roles[role];
+			ImGui::SetNextItemWidth(100.f);
+			if (ImGui::BeginCombo(decoder->GetRoleName(role), channel < 0 ? "-" : analyzer.GetName(channel).c_str())) {
+				if (decoder->IsOptional(role) && ImGui::Selectable("-", channel < 0))
+					m_roles[role] = -1;
+				for (uint32_t i = 0; i < channels; i++) {
+					if (ImGui::Selectable(analyzer.GetName(i).c_str(), (int)i == channel))
+						m_roles[role] = (int)i;
+				}
+				ImGui::EndCombo();
+			}
+		}
+		if (m_decoder == 1) {
+			ImGui::SetNextItemWidth(120.f);
+			ImGui::InputInt("Baud", &m_baud, 100, 1000);
+			m_baud = std::max(m_baud, 1);
+		}
+		else if (m_decoder == 2) {
+			static constexpr const char* c_modes[] = { "Mode 0", "Mode 1", "Mode 2", "Mode 3" };
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::Combo("CPOL/CPHA", &m_spi_mode, c_modes, (int)std::size(c_modes));
+		}
+
+		bool complete = true;
+		for (uint32_t role = 0; role < decoder->GetRoleCount(); role++)
+			complete &= m_roles[role] >= 0 || decoder->IsOptional(role);
+		if (!complete)
+			ImGui::TextDisabled("Select a channel for every role.");
+		else if (ImGui::Button("Add decoder")) {
+			uint32_t roles[ProtocolDecoder::c_max_roles];
+			for (uint32_t role = 0; role < decoder->GetRoleCount(); role++)
+				roles[role] = m_roles[role] < 0 ? ProtocolDecoder::NoChannel : (uint32_t)m_roles[role];
+			g_emulator.AddDecoder(std::move(decoder), roles);
+		}
+		if (!m_status.empty())
+			ImGui::TextUnformatted(m_status.c_str());
+	}
+
+	std::unique_ptr<ProtocolDecoder> CreateDecoder() const {
+		switch (m_decoder) {
+		case 0: return std::make_unique<Hd44780Decoder>();
+		case 1: return std::make_unique<UartDecoder>(g_emulator.GetFrequency(), (uint32_t)m_baud);
+		case 2: return std::make_unique<SpiDecoder>((uint8_t)m_spi_mode);
+		default: return std::make_unique<I2cDecoder>();
+		}
+	}
+
+	// the lcd decoder finds its pins by name, everything else starts unbound
+	void DefaultRoles(const LogicAnalyzer& analyzer) {
+		for (int& role : m_roles)
+			role = -1;
+		if (m_decoder != 0)
+			return;
+		const Hd44780Decoder decoder;
+		for (uint32_t role = 0; role < decoder.GetRoleCount(); role++) {
+			const std::string name = std::string("lcd.") + decoder.GetRoleName(role);
+			for (uint32_t i = 0; i < analyzer.GetChannelCount(); i++) {
+				if (analyzer.GetName(i) == name)
+					m_roles[role] = (int)i;
+			}
+		}
+	}
+
+	// the edge of the channel near time if there is one within a few pixels
+	static uint64_t Snap(const LogicAnalyzer& analyzer, uint32_t channel, double time, double cycles_per_column) {
+		const uint64_t cycle = (uint64_t)std::max(0.0, time);
+		const uint64_t edge = analyzer.FindEdge(channel, cycle);
+		if (edge != LogicAnalyzer::NoTime && std::abs((double)edge - time) <= c_snap_pixels * cycles_per_column)
+			return edge;
+		return cycle;
+	}
+};
+
+class CaptureLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	CaptureLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Capture", &m_open);
+
+		TriggerCapture& capture = g_emulator.capture;
+		const TriggerCapture::State state = capture.GetState();
+		const auto& irqs = g_emulator.GetAllocatedIrqs();
+		m_pattern.resize(irqs.size(), 0);
+
+		const bool editable = state == TriggerCapture::State::Idle || state == TriggerCapture::State::Done;
+		if (editable)
+			DrawTrigger(irqs);
+
+		// windows in microseconds
+		ImGui::SetNextItemWidth(120.f);
+		ImGui::InputInt("Pre-trigger (us)", &m_pre_us, 100, 1000);
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(120.f);
+		ImGui::InputInt("Post-trigger (us)", &m_post_us, 100, 1000);
+		m_pre_us = std::max(m_pre_us, 0);
+		m_post_us = std::max(m_post_us, 0);
+
+		if (editable) {
+			if (ImGui::Button("Arm")) {
+				TriggerCapture::trigger_t trigger;
+				if (BuildTrigger(trigger)) {
+					m_path = SaveFileName("Value change dump\0*.vcd\0");
+					if (!m_path.empty()) {
+						const uint64_t frequency = g_emulator.GetFrequency();
+						g_emulator.ArmCapture(trigger, m_pre_us * frequency / 1000000, m_post_us * frequency / 1000000);
+						m_saved = false;
+						m_status.clear();
+					}
+				}
+			}
+		}
+		else if (ImGui::Button("Disarm")) {
+			capture.Disarm();
+		}
+
+		// the run thread is done with the buffers, save the window once
+		if (state == TriggerCapture::State::Done && !m_saved) {
+			m_saved = true;
+			m_status = capture.Save(m_path, g_emulator.GetFrequency()) ? "Saved to " + m_path : "Could not write " + m_path;
+		}
+
+		static constexpr const char* c_states[] = { "Idle", "Armed, waiting for the trigger", "Triggered, recording the post-trigger window", "Done" };
+		ImGui::Text("State: %s", c_states[(int)state]);
+		if (!m_status.empty())
+			ImGui::TextUnformatted(m_status.c_str());
+		if (!m_error.empty())
+			ImGui::TextColored({ 1.f, 0.3f, 0.3f, 1.f }, "%s", m_error.c_str());
+
+		ImGui::End();
+	}
+private:
+	int m_kind = 0;
+	int m_channel = 0;
+	int m_edge = 0;
+	std::vector<int> m_pattern; // per channel: don't care, low, high
+	char m_location[64] = "";
+	int m_value = 0;
+	int m_mask = 0xFF;
+	int m_register_select = 0; // lcd: any, instruction, data
+	int m_pre_us = 1000;
+	int m_post_us = 1000;
+	std::string m_path;
+	bool m_saved = true;
+	std::string m_status;
+	std::string m_error;
+
+	void DrawTrigger(const std::vector<Emulator::named_irq_t>& irqs) {
+		static constexpr const char* c_kinds[] = { "Pin edge", "Pin pattern", "PC", "Memory write", "LCD command" };
+		ImGui::SetNextItemWidth(150.f);
+		ImGui::Combo("Trigger", &m_kind, c_kinds, (int)std::size(c_kinds));
+
+		switch ((TriggerCapture::Trigger)m_kind) {
+		case TriggerCapture::Trigger::PinEdge: {
+			if (irqs.empty()) {
+				ImGui::TextDisabled("No connector pins.");
+				break;
+			}
+			m_channel = std::min(m_channel, (int)irqs.size() - 1);
+			ImGui::SetNextItemWidth(150.f);
+			if (ImGui::BeginCombo("Pin", irqs[m_channel].name.c_str())) {
+				for (int i = 0; i < (int)irqs.size(); i++) {
+					if (ImGui::Selectable(irqs[i].name.c_str(), i == m_channel))
+						m_channel = i;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::SameLine();
+			static constexpr const char* c_edges[] = { "Rising", "Falling", "Any" };
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::Combo("Edge", &m_edge, c_edges, (int)std::size(c_edges));
+			break;
+		}
+		case TriggerCapture::Trigger::PinPattern: {
+			// fires when the last pin of the pattern changes into it
+			static constexpr const char* c_levels[] = { "X", "0", "1" };
+			for (int i = 0; i < (int)irqs.size() && i < 64; i++) {
+				if (i % 4)
+					ImGui::SameLine();
+				char label[48];
+				sprintf_s(label, "%s##pattern%d", irqs[i].name.c_str(), i);
+				ImGui::SetNextItemWidth(50.f);
+				ImGui::Combo(label, &m_pattern[i], c_levels, (int)std::size(c_levels));
+			}
+			break;
+		}
+		case TriggerCapture::Trigger::Pc:
+			ImGui::SetNextItemWidth(200.f);
+			ImGui::InputText("Location (function, function+offset or address)", m_location, sizeof(m_location));
+			break;
+		case TriggerCapture::Trigger::MemoryWrite:
+			ImGui::SetNextItemWidth(200.f);
+			ImGui::InputText("Address or variable", m_location, sizeof(m_location));
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::InputInt("Value", &m_value, 1, 16, ImGuiInputTextFlags_CharsHexadecimal);
+			ImGui::SameLine();
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::InputInt("Mask", &m_mask, 1, 16, ImGuiInputTextFlags_CharsHexadecimal);
+			break;
+		case TriggerCapture::Trigger::LcdCommand: {
+			static constexpr const char* c_selects[] = { "Any", "Instruction", "Data" };
+			ImGui::SetNextItemWidth(120.f);
+			ImGui::Combo("Register", &m_register_select, c_selects, (int)std::size(c_selects));
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::InputInt("Byte", &m_value, 1, 16, ImGuiInputTextFlags_CharsHexadecimal);
+			ImGui::SameLine();
+			ImGui::SetNextItemWidth(100.f);
+			ImGui::InputInt("Mask", &m_mask, 1, 16, ImGuiInputTextFlags_CharsHexadecimal);
+			break;
+		}
+		}
+	}
+
+	bool BuildTrigger(TriggerCapture::trigger_t& trigger) {
+		m_error.clear();
+		trigger.kind = (TriggerCapture::Trigger)m_kind;
+		trigger.mask = m_mask & 0xFF;
+		trigger.value = m_value & 0xFF;
+		switch (trigger.kind) {
+		case TriggerCapture::Trigger::PinEdge:
+			trigger.channel = m_channel;
+			trigger.edge = (TriggerCapture::Edge)m_edge;
+			return !g_emulator.GetAllocatedIrqs().empty();
+		case TriggerCapture::Trigger::PinPattern:
+			trigger.mask = 0;
+			trigger.value = 0;
+			for (size_t i = 0; i < m_pattern.size() && i < 64; i++) {
+				if (m_pattern[i])
+					trigger.mask |= 1ull << i;
+				if (m_pattern[i] == 2)
+					trigger.value |= 1ull << i;
+			}
+			if (!trigger.mask)
+				m_error = "select at least one pin";
+			return trigger.mask != 0;
+		case TriggerCapture::Trigger::Pc:
+			trigger.address = Breakpoints::ResolveLocation(m_location, g_emulator.debug_info);
+			if (trigger.address == Breakpoints::NoAddress)
+				m_error = "unknown location";
+			return trigger.address != Breakpoints::NoAddress;
+		case TriggerCapture::Trigger::MemoryWrite: {
+			const DebugInfo::SymbolTable& objects = g_emulator.debug_info.GetObjects();
+			const uint32_t object = objects.Find(std::string_view(m_location));
+			char* end = nullptr;
+			const unsigned long address = strtoul(m_location, &end, 0);
+			if (object != DebugInfo::NoSymbol)
+				trigger.address = objects.GetAddress(object);
+			else if (end != m_location && *end == '\0' && address <= 0xFFFF)
+				trigger.address = (uint32_t)address;
+			else {
+				m_error = "unknown address";
+				return false;
+			}
+			return true;
+		}
+		case TriggerCapture::Trigger::LcdCommand:
+			// D0-D7, RW (bit 8), RS (bit 9). only commands the firmware writes
+			trigger.mask |= 1 << 8;
+			if (m_register_select) {
+				trigger.mask |= 1 << 9;
+				trigger.value |= m_register_select == 2 ? 1 << 9 : 0;
+			}
+			return true;
+		}
+		return false;
+	}
+};
+
+class TraceLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	TraceLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		if (!m_open) return;
+		ImGui::Begin("Trace", &m_open);
+
+		const TraceRecorder& trace = g_emulator.trace;
+		if (!trace.IsEnabled()) {
+			ImGui::Checkbox("Registers", &m_registers);
+			ImGui::SameLine();
+			ImGui::Checkbox("Memory writes", &m_memory);
+			ImGui::SameLine();
+			if (ImGui::Button("Start")) {
+				std::string path = SaveFileName("Trace\0*.avrtrace\0");
+				const uint8_t options = (m_registers ? TraceRecorder::Registers : 0) | (m_memory ? TraceRecorder::Memory : 0);
+				if (!path.empty() && !g_emulator.StartTrace(path, options))
+					ImGui::OpenPopup("Trace failed");
+			}
+		}
+		else if (ImGui::Button("Stop")) {
+			g_emulator.StopTrace();
+		}
+
+		if (ImGui::BeginPopupModal("Trace failed", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+			ImGui::TextUnformatted("Could not open the trace file.");
+			if (ImGui::Button("Ok"))
+				ImGui::CloseCurrentPopup();
+			ImGui::EndPopup();
+		}
+
+		const uint64_t instructions = trace.GetInstructions();
+		const uint64_t bytes = trace.GetBytesWritten();
+		ImGui::Text("Instructions: %llu", (unsigned long long)instructions);
+		ImGui::Text("Written: %.2f MB (%.2f bytes per instruction)", bytes / (1024.0 * 1024.0), instructions ? (double)bytes / instructions : 0.0);
+		ImGui::Text("Dropped: %llu", (unsigned long long)trace.GetDropped());
+
+		// pin level waveforms for gtkwave
+		ImGui::Separator();
+		const VcdRecorder& vcd = g_emulator.vcd;
+		if (!vcd.IsRecording()) {
+			if (ImGui::Button("Record VCD")) {
+				std::string path = SaveFileName("Value change dump\0*.vcd\0");
+				if (!path.empty() && !g_emulator.StartVcd(path))
+					ImGui::OpenPopup("Trace failed");
+			}
+		}
+		else if (ImGui::Button("Stop VCD")) {
+			g_emulator.StopVcd();
+		}
+		ImGui::Text("Signals: %u", vcd.GetSignalCount());
+		ImGui::SameLine();
+		ImGui::Text("Changes: %llu", (unsigned long long)vcd.GetChanges());
+		ImGui::SameLine();
+		ImGui::Text("Dropped: %llu", (unsigned long long)vcd.GetDropped());
+		ImGui::Text("Written: %.2f MB", vcd.GetBytesWritten() / (1024.0 * 1024.0));
+
+		ImGui::End();
+	}
+private:
+	bool m_registers = false;
+	bool m_memory = false;
+};
+
+class FlightRecorderLayer : public Walnut::Layer
+{
+public:
+	bool m_open = false;
+
+	FlightRecorderLayer() : Walnut::Layer() {}
+	virtual void OnUIRender() override {
+		// a new capture opens the window
+		FlightRecorder& recorder = g_emulator.flight_recorder;
+		if (recorder.GetCaptureCount() != m_captures) {
+			m_captures = recorder.GetCaptureCount();
+			recorder.GetCapture(m_capture);
+			m_open = true;
+			m_scroll_to_end = true;
+		}
+		if (!m_open) return;
+		ImGui::Begin("Flight recorder", &m_open);
+
+		if (!m_captures) {
+			ImGui::TextUnformatted("Nothing captured yet. Exceptions, invalid opcodes and watchdog resets capture the last instructions.");
+			ImGui::End();
+			return;
+		}
+		ImGui::Text("%s at cycle %llu", m_capture.reason.c_str(), (unsigned long long)m_capture.cycle);
+
+		if (ImGui::BeginTabBar("Capture")) {
+			if (ImGui::BeginTabItem("Instructions")) {
+				DrawInstructions();
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Pins")) {
+				DrawPins();
+				ImGui::EndTabItem();
+			}
+			ImGui::EndTabBar();
+		}
+
+		ImGui::End();
+	}
+private:
+	uint32_t m_captures = 0;
+	FlightRecorder::capture_t m_capture;
+	bool m_scroll_to_end = false;
+
+	void DrawInstructions() {
+		if (!ImGui::BeginTable("Instructions", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Cycle", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Address", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Function", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Instruction", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Write", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableHeadersRow();
+
+		const DebugInfo& debug_info = g_emulator.debug_info;
+		const DebugInfo::SymbolTable& functions = debug_info.GetFunctions();
+		ImGuiListClipper clipper;
+		clipper.Begin((int)m_capture.entries.size());
+		while (clipper.Step()) {
+			for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				const FlightRecorder::entry_t& entry = m_capture.entries[row];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)entry.cycle);
+				ImGui::TableNextColumn();
+				ImGui::Text("%04X", entry.pc);
+				ImGui::TableNextColumn();
+				const uint32_t function = functions.Find(entry.pc);
+				if (function != DebugInfo::NoSymbol) {
+					const std::string_view name = functions.GetName(function);
+					ImGui::Text("%.*s+0x%X", (int)name.size(), name.data(), (entry.pc - functions.GetAddress(function)) * 2);
+				}
+				ImGui::TableNextColumn();
+				char text[128];
+				g_emulator.flight_recorder.FormatEntry(entry, debug_info, text, sizeof(text));
+				ImGui::TextUnformatted(text);
+				ImGui::TableNextColumn();
+				if (entry.reg != NoRegister)
+					ImGui::Text("r%u = 0x%02X", entry.reg, entry.value);
+			}
+		}
+		clipper.End();
+		// the newest instruction is the interesting one
+		if (m_scroll_to_end) {
+			ImGui::SetScrollHereY(1.f);
+			m_scroll_to_end = false;
+		}
+		ImGui::EndTable();
+	}
+
+	void DrawPins() {
+		if (!ImGui::BeginTable("Pins", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+			return;
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Cycle", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Port", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Pins", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableHeadersRow();
+		for (const FlightRecorder::pin_t& pin : m_capture.pins) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)pin.cycle);
+			ImGui::TableNextColumn();
+			ImGui::Text("PIN%c", pin.port);
+			ImGui::TableNextColumn();
+			ImGui::Text("%s", std::bitset<8>(pin.value).to_string().c_str());
+		}
+		ImGui::EndTable();
+	}
+};
+
+// drag and drop payloads are copied by imgui, so they have to stay trivially copyable
 struct io_to_mega_dnd_t {
 	connector_t* connector;
 	std::bitset<8> mask;
 	const char* const* m_names;
-	std::function<void()> reconnect;
+	void (*reconnect)(void* owner);
+	void* owner;
 	bool reverse;
 	int start_pin;
 	int end_pin;
@@ -279,6 +1976,10 @@ protected:
 		m_connector.Connect(m_connectable);
 	}
 
+	static void Reconnect(void* owner) {
+		static_cast<Connectable*>(owner)->Reconnect();
+	}
+
 	void DnDSource(int index) {
 		if (ImGui::BeginDragDropSource(ImGuiDragDropFlags_None)) {
 			ImGui::Text("Press space to flip.");
@@ -295,8 +1996,8 @@ protected:
 			}
 			int num_selected = end - start;
 
-			io_to_mega_dnd_t* payload = new io_to_mega_dnd_t{ m_connectable.data(), GetMask(), m_names, std::bind(&Connectable::Reconnect, this), m_reversed, start, end};
-			ImGui::SetDragDropPayload("DND_IO_TO_MEGA", payload, sizeof(io_to_mega_dnd_t));
+			io_to_mega_dnd_t payload{ m_connectable.data(), GetMask(), m_names, &Connectable::Reconnect, this, m_reversed, start, end };
+			ImGui::SetDragDropPayload("DND_IO_TO_MEGA", &payload, sizeof(io_to_mega_dnd_t));
 
 
 			if (ImGui::BeginTable("##DND_IO_TO_MEGA", num_selected, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
@@ -307,7 +2008,7 @@ protected:
 
 					if (m_selected[j]) {
 						auto& [port, pin, default_value] = m_connectable[j];
-						ImGui::Text(std::format("{}{}", port, pin).c_str());
+						ImGui::Text("%c%d", port, pin);
 					}
 					else {
 						ImGui::Text("   ");
@@ -351,7 +2052,9 @@ protected:
 		// draw the pins as drag and drop sources
 		const auto pin = [&](int index) {
 			auto& [port, pin, default_value] = m_connectable[index];
-			ImGui::Selectable(std::format("{}{}##pin{}", port, pin, index).c_str(), &m_selected[index], ImGuiSelectableFlags_DontClosePopups, ImVec2(20.f, 20.f));
+			char label[32];
+			sprintf_s(label, "%c%d##pin%d", port, pin, index);
+			ImGui::Selectable(label, &m_selected[index], ImGuiSelectableFlags_DontClosePopups, ImVec2(20.f, 20.f));
 
 			if (GetMask().any())
 				DnDSource(index);
@@ -391,7 +2094,9 @@ public:
 		ImGui::Begin("Eval Board", &m_open);
 
 		const auto port = [&](int index) {
-			ImGui::BeginGroupPanel(std::format<char>("Port {}", 'A' + index).c_str());
+			char label[16];
+			sprintf_s(label, "Port %c", 'A' + index);
+			ImGui::BeginGroupPanel(label);
 			DrawPort(index);
 			ImGui::EndGroupPanel();
 			};
@@ -433,8 +2138,8 @@ private:
 			}
 			int num_selected = end - start;
 
-			mega_to_io_dnd_t* payload = new mega_to_io_dnd_t{ &m_connectable[port_index][0], GetMask(port_index), m_reversed, start, end };
-			ImGui::SetDragDropPayload("DND_MEGA_TO_IO", payload, sizeof(mega_to_io_dnd_t));
+			mega_to_io_dnd_t payload{ &m_connectable[port_index][0], GetMask(port_index), m_reversed, start, end };
+			ImGui::SetDragDropPayload("DND_MEGA_TO_IO", &payload, sizeof(mega_to_io_dnd_t));
 
 
 			if (ImGui::BeginTable("##DND_MEGA_TO_IO", num_selected, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
@@ -445,7 +2150,7 @@ private:
 
 					if (m_selected[port_index][j]) {
 						auto& [port, pin, default_value] = m_connectable[port_index][j];
-						ImGui::Text(std::format("{}{}", port, pin).c_str());
+						ImGui::Text("%c%d", port, pin);
 					}
 					else {
 						ImGui::Text("   ");
@@ -476,7 +2181,7 @@ private:
 						pin = new_pin;
 					}
 				}
-				payload_n.reconnect();
+				payload_n.reconnect(payload_n.owner);
 			}
 			ImGui::EndDragDropTarget();
 		}
@@ -487,7 +2192,9 @@ private:
 		const auto pin = [&](int index) {
 			const char* name = m_names[port_index][index] ? m_names[port_index][index] : " / ";
 			ImVec2 size = ImGui::CalcTextSize(name);
-			ImGui::Selectable(std::format("{}##port{}{}", name, port_index, index).c_str(), &m_selected[port_index][index], ImGuiSelectableFlags_DontClosePopups, size);
+			char label[64];
+			sprintf_s(label, "%s##port%d%d", name, port_index, index);
+			ImGui::Selectable(label, &m_selected[port_index][index], ImGuiSelectableFlags_DontClosePopups, size);
 
 			if (GetMask(port_index).any())
 				DnDSource(port_index, index);
@@ -510,7 +2217,9 @@ class LEDsLayer : public Walnut::Layer, Connectable<8>
 public:
 	bool m_open = true;
 
-	LEDsLayer() : Walnut::Layer(), Connectable<8>(m_names, m_default_connection) {}
+	LEDsLayer() : Walnut::Layer(), Connectable<8>(m_names, m_default_connection) {
+		m_connector.SetStaticWiring<m_default_connection>();
+	}
 
 	virtual void OnUIRender() override {
 		if (!m_open) return;
@@ -562,7 +2271,9 @@ class ButtonsLayer : public Walnut::Layer, Connectable<4>
 public:
 	bool m_open = true;
 
-	ButtonsLayer() : Walnut::Layer(), Connectable<4>(m_names, m_buttons) {}
+	ButtonsLayer() : Walnut::Layer(), Connectable<4>(m_names, m_buttons) {
+		m_connector.SetStaticWiring<m_buttons>();
+	}
 	virtual void OnUIRender() override {
 		if (!m_open) return;
 		ImGui::Begin("Buttons", &m_open);
@@ -615,6 +2326,7 @@ public:
 	bool m_open = true;
 
 	LCDLayer() : Walnut::Layer(), Connectable<7>(m_lcd_pins, m_lcd_connection), m_lcd(g_emulator, m_connector) {
+		m_connector.SetStaticWiring<m_lcd_connection>();
 		auto init_lcd = [this]() -> void {
 			m_lcd.Reset();
 			};
@@ -632,52 +2344,112 @@ public:
 
 		ImGui::EndGroupPanel();
 
+		DrawBusStatistics();
+
 		ImGui::End();
 	}
 private:
-	void DrawLCD() {
-		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
-		ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
-		ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
-
-		std::array<std::array<character_t, 16>, 2> display = m_lcd.GetDisplay();
-		for (size_t i = 0; i < display.size(); i++) {
-			for (size_t j = 0; j < display[i].size(); j++) {
-				DrawCharacter(display[i][j]);
-				ImGui::SameLine();
-			}
-			ImGui::NewLine();
-		}
+	static constexpr uint32_t c_log_rows = 64;
 
-		ImGui::PopStyleVar(3);
+	std::shared_ptr<Walnut::Image> m_image;
+	LCDRenderer m_renderer;
+	int m_scale = 3;
+	bool m_pixel_grid = true;
+
+	void DrawBusStatistics() {
+		if (!ImGui::CollapsingHeader("Bus statistics"))
+			return;
+		const LcdCommandLog& log = m_lcd.GetLog();
+		const LcdCommandLog::stats_t& stats = log.GetStats();
+		const uint32_t frequency = g_emulator.GetFrequency();
+		const double us = 1e6 / frequency;
+
+		if (ImGui::Button("Clear"))
+			g_emulator.WhileStopped([&]() { m_lcd.ClearLog(); });
+		const uint64_t span = stats.lastCycle - stats.firstCycle;
+		ImGui::Text("Commands: %llu (%llu data writes), %.0f/s in the last second, %.0f/s overall",
+			(unsigned long long)stats.commands, (unsigned long long)stats.dataWrites,
+			log.GetRate(g_emulator.GetCycle(), frequency, frequency), span ? stats.commands * (double)frequency / span : 0.0);
+		if (stats.nibblePairs)
+			ImGui::Text("Between nibbles: %.2f us average, %.2f us max", stats.nibbleCycles * us / stats.nibblePairs, stats.maxNibbleGap * us);
+		ImGui::Text("Busy polling: %llu polls in %llu waits, %.3f ms", (unsigned long long)stats.busyPolls, (unsigned long long)stats.busyWaits, stats.busyWaitCycles * us / 1e3);
+		ImGui::Text("Busy executing: %.3f ms, waited %.3f ms longer than needed (%.2f us per command)",
+			stats.executionCycles * us / 1e3, stats.overWaitCycles * us / 1e3, stats.overWaits ? stats.overWaitCycles * us / stats.overWaits : 0.0);
+		if (stats.busyViolations)
+			ImGui::TextColored({ 1.f, 0.3f, 0.3f, 1.f }, "Commands sent while busy: %llu", (unsigned long long)stats.busyViolations);
+		bool strict = m_lcd.IsStrictTiming();
+		if (ImGui::Checkbox("Ignore commands sent while busy, like the real controller", &strict))
+			m_lcd.SetStrictTiming(strict);
+		ImGui::Text("Clears: %llu, %llu of them redundant", (unsigned long long)stats.clears, (unsigned long long)stats.redundantClears);
+		ImGui::Text("Writes of unchanged characters: %llu, %llu rewritten after a clear", (unsigned long long)stats.redundantWrites, (unsigned long long)stats.restoredWrites);
+
+		if (!ImGui::BeginTable("LCD commands", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0.f, 200.f)))
+			return;
+		ImGui::TableSetupColumn("Cycle");
+		ImGui::TableSetupColumn("Command");
+		ImGui::TableSetupColumn("Nibble gap");
+		ImGui::TableSetupColumn("Note");
+		ImGui::TableHeadersRow();
+		// newest first
+		const uint64_t count = log.GetCount();
+		const uint64_t first = std::max(log.GetFirst(), count > c_log_rows ? count - c_log_rows : 0);
+		for (uint64_t i = count; i > first; i--) {
+			const LcdCommandLog::entry_t& entry = log.Get(i - 1);
+			char text[32];
+			Hd44780Decoder::Format((uint8_t)entry.command, entry.command & 0x200, entry.command & 0x100, text, sizeof(text));
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)entry.cycle);
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(text);
+			ImGui::TableNextColumn();
+			if (entry.nibbleGap)
+				ImGui::Text("%u", entry.nibbleGap);
+			ImGui::TableNextColumn();
+			if (entry.flags & LcdCommandLog::WhileBusy)
+				ImGui::TextColored({ 1.f, 0.3f, 0.3f, 1.f }, "sent while busy");
+			else if (entry.flags & LcdCommandLog::RedundantClear)
+				ImGui::TextUnformatted("redundant clear");
+			else if (entry.flags & LcdCommandLog::RedundantWrite)
+				ImGui::TextUnformatted("unchanged");
+			else if (entry.flags & LcdCommandLog::RestoredWrite)
+				ImGui::TextUnformatted("same as before the clear");
+		}
+		ImGui::EndTable();
 	}
-	void DrawCharacter(character_t c) {
-		ImVec2 px_size{ 3.f, 3.f };
-		ImVec2 cursor = ImGui::GetCursorPos();
 
-		ImGui::BeginGroup();
-		for (size_t i = 0; i < 50; i++) { // 5x10
-			DrawPixel(c.test(i), px_size); // new line every 5 pixels
-			bool new_line = (i + 1) % 5 == 0;
-			if (new_line)
-				ImGui::SetCursorPos(ImVec2(cursor.x, ImGui::GetCursorPosY() + px_size.y));
+	void DrawLCD() {
+		ImGui::SetNextItemWidth(100.f);
+		bool layout_changed = ImGui::SliderInt("Scale", &m_scale, 1, LCDRenderer::MaxScale, "%d", ImGuiSliderFlags_AlwaysClamp);
+		ImGui::SameLine();
+		layout_changed |= ImGui::Checkbox("Pixel grid", &m_pixel_grid);
+
+		if (!m_image || layout_changed) {
+			m_renderer.SetLayout(m_scale, m_pixel_grid);
+			if (!m_image)
+				m_image = std::make_shared<Walnut::Image>(m_renderer.GetWidth(), m_renderer.GetHeight(), Walnut::ImageFormat::RGBA);
 			else
-				ImGui::SetCursorPosX(ImGui::GetCursorPosX() + px_size.x);
+				m_image->Resize(m_renderer.GetWidth(), m_renderer.GetHeight());
+			layout_changed = true;
 		}
-		ImGui::SetCursorPos(ImVec2(cursor.x + px_size.x * 6, cursor.y + px_size.y * 11));
-		ImGui::EndGroup();
-	}
-	void DrawPixel(bool value, ImVec2 size) {
-		// black = 0, white = 1
-		const auto col = value ? ImVec4(1.f, 1.f, 1.f, 1.f) : ImVec4(0.f, 0.f, 0.f, 1.f);
 
-		ImVec2 pos = ImGui::GetCursorScreenPos();
-		ImRect bb(pos, ImVec2(pos.x + size.x, pos.y + size.y));
-		ImGui::GetWindowDrawList()->AddRectFilled(
-			bb.Min,
-			bb.Max,
-			ImColor(col)
-		);
+		// only the cells that changed since the last frame are re-rendered by the LCD,
+		// the texture is only uploaded when something actually changed
+		const display_t* display;
+		cell_mask_t changed;
+		m_lcd.PullDisplay(display, changed);
+		if (layout_changed)
+			changed.set();
+		for (uint8_t line = 0; line < 2; line++) {
+			for (uint8_t column = 0; column < 16; column++) {
+				if (changed[line * 16 + column])
+					m_renderer.DrawCell((*display)[line][column], line, column);
+			}
+		}
+		if (changed.any())
+			m_image->SetData(m_renderer.GetPixels());
+
+		ImGui::Image(m_image->GetDescriptorSet(), ImVec2((float)m_renderer.GetWidth(), (float)m_renderer.GetHeight()));
 	}
 };
 
@@ -710,6 +2482,36 @@ std::string OpenFileName() {
 }
 #endif
 
+#if defined(_WIN32) || defined(_WIN64)
+std::string SaveFileName(const char* filter) {
+	char filename[MAX_PATH];
+	OPENFILENAMEA ofn;
+	ZeroMemory(&filename, sizeof(filename));
+	ZeroMemory(&ofn, sizeof(ofn));
+	ofn.lStructSize = sizeof(ofn);
+	ofn.hwndOwner = glfwGetWin32Window(Walnut::Application::Get().GetWindowHandle());
+	ofn.lpstrFilter = filter;
+	ofn.lpstrFile = filename;
+	ofn.nMaxFile = MAX_PATH;
+	ofn.lpstrTitle = "Save as";
+	ofn.Flags = OFN_DONTADDTORECENT | OFN_OVERWRITEPROMPT;
+
+	if (GetSaveFileNameA(&ofn))
+		return filename;
+	else
+		return "";
+}
+#else
+std::string SaveFileName(const char* filter) {
+	char filename[1024] = { 0 };
+	FILE* fp = popen("zenity --file-selection --save --confirm-overwrite", "r");
+	fgets(filename, 1024, fp);
+	pclose(fp);
+	filename[strcspn(filename, "\n")] = '\0';
+	return filename;
+}
+#endif
+
 Walnut::Application* Walnut::CreateApplication(int argc, char** argv) {
 	Walnut::ApplicationSpecification spec;
 	spec.Name = "RWTH PSP - Emulator";
@@ -721,6 +2523,15 @@ Walnut::Application* Walnut::CreateApplication(int argc, char** argv) {
 	std::shared_ptr<MainLayer> mainLayer = std::make_shared<MainLayer>();
 	std::shared_ptr<PortsLayer> portsLayer = std::make_shared<PortsLayer>();
 	std::shared_ptr<MemoryLayer> memoryLayer = std::make_shared<MemoryLayer>();
+	std::shared_ptr<SramLayer> sramLayer = std::make_shared<SramLayer>();
+	std::shared_ptr<DisassemblyLayer> disassemblyLayer = std::make_shared<DisassemblyLayer>();
+	std::shared_ptr<BreakpointsLayer> breakpointsLayer = std::make_shared<BreakpointsLayer>();
+	std::shared_ptr<ProfilerLayer> profilerLayer = std::make_shared<ProfilerLayer>();
+	std::shared_ptr<InterruptsLayer> interruptsLayer = std::make_shared<InterruptsLayer>();
+	std::shared_ptr<TraceLayer> traceLayer = std::make_shared<TraceLayer>();
+	std::shared_ptr<LogicAnalyzerLayer> logicAnalyzerLayer = std::make_shared<LogicAnalyzerLayer>();
+	std::shared_ptr<CaptureLayer> captureLayer = std::make_shared<CaptureLayer>();
+	std::shared_ptr<FlightRecorderLayer> flightRecorderLayer = std::make_shared<FlightRecorderLayer>();
 	std::shared_ptr<ButtonsLayer> buttonsLayer = std::make_shared<ButtonsLayer>();
 	std::shared_ptr<LEDsLayer> ledsLayer = std::make_shared<LEDsLayer>();
 	std::shared_ptr<LCDLayer> lcdLayer = std::make_shared<LCDLayer>();
@@ -736,6 +2547,15 @@ Walnut::Application* Walnut::CreateApplication(int argc, char** argv) {
 	app->PushLayer(mainLayer);
 	app->PushLayer(portsLayer);
 	app->PushLayer(memoryLayer);
+	app->PushLayer(sramLayer);
+	app->PushLayer(disassemblyLayer);
+	app->PushLayer(breakpointsLayer);
+	app->PushLayer(profilerLayer);
+	app->PushLayer(interruptsLayer);
+	app->PushLayer(traceLayer);
+	app->PushLayer(logicAnalyzerLayer);
+	app->PushLayer(captureLayer);
+	app->PushLayer(flightRecorderLayer);
 	app->PushLayer(buttonsLayer);
 	app->PushLayer(ledsLayer);
 	app->PushLayer(lcdLayer);
@@ -761,6 +2581,15 @@ Walnut::Application* Walnut::CreateApplication(int argc, char** argv) {
 		if (ImGui::BeginMenu("Window")) {
 			if (ImGui::MenuItem("Ports")) portsLayer->m_open = true;
 			if (ImGui::MenuItem("Memory")) memoryLayer->m_open = true;
+			if (ImGui::MenuItem("SRAM")) sramLayer->m_open = true;
+			if (ImGui::MenuItem("Disassembly")) disassemblyLayer->m_open = true;
+			if (ImGui::MenuItem("Breakpoints")) breakpointsLayer->m_open = true;
+			if (ImGui::MenuItem("Profiler")) profilerLayer->m_open = true;
+			if (ImGui::MenuItem("Interrupts")) interruptsLayer->m_open = true;
+			if (ImGui::MenuItem("Trace")) traceLayer->m_open = true;
+			if (ImGui::MenuItem("Logic analyzer")) logicAnalyzerLayer->m_open = true;
+			if (ImGui::MenuItem("Capture")) captureLayer->m_open = true;
+			if (ImGui::MenuItem("Flight recorder")) flightRecorderLayer->m_open = true;
 			if (ImGui::MenuItem("Buttons")) buttonsLayer->m_open = true;
 			if (ImGui::MenuItem("LEDs")) ledsLayer->m_open = true;
 			if (ImGui::MenuItem("LCD")) lcdLayer->m_open = true;
@@ -0,0 +1,166 @@
+#include "Watchpoints.h"
+#include "DebugInfo.h"
+#include <algorithm>
+#include <charconv>
+
+void Watchpoints::Before(uint32_t pc, const data_access_t* accesses, int count, const uint8_t* data) {
+	armedPc = pc;
+	candidateCount = 0;
+	for (int i = 0; i < count; i++) {
+		for (uint32_t byte = 0; byte < accesses[i].size && candidateCount < (int)std::size(candidates); byte++) {
+			// an access can run past the end of the data space, nothing is watched there
+			const uint32_t address = accesses[i].address + byte;
+			if (address >= dataSize)
+				break;
+			candidates[candidateCount++] = { (uint16_t)address, accesses[i].write, data[address] };
+		}
+	}
+}
+
+bool Watchpoints::After(const uint8_t* data) {
+	std::lock_guard lock(mutex);
+	bool hit = false;
+	for (int i = 0; i < candidateCount; i++) {
+		const candidate_t& candidate = candidates[i];
+		for (watchpoint_t& watchpoint : watchpoints) {
+			if (!watchpoint.enabled || candidate.address < watchpoint.address || candidate.address >= watchpoint.address + watchpoint.size)
+				continue;
+			const uint8_t value = data[candidate.address];
+			uint8_t kind = 0;
+			if (!candidate.write && (watchpoint.kinds & Read))
+				kind = Read;
+			else if (candidate.write && (watchpoint.kinds & Change) && value != candidate.oldValue)
+				kind = Change;
+			else if (candidate.write && (watchpoint.kinds & Write))
+				kind = Write;
+			if (!kind)
+				continue;
+			watchpoint.hits++;
+			// the first hit of the instruction is the one reported
+			if (!hit)
+				lastHit = { armedPc, candidate.address, kind, candidate.oldValue, value };
+			hasLastHit = true;
+			hit = true;
+		}
+	}
+	candidateCount = 0;
+	return hit;
+}
+
+bool Watchpoints::Add(std::string_view location, uint8_t kinds, const DebugInfo& debug_info, std::string& error) {
+	while (!location.empty() && location.front() == ' ')
+		location.remove_prefix(1);
+	while (!location.empty() && location.back() == ' ')
+		location.remove_suffix(1);
+
+	std::string_view number = location;
+	int base = 10;
+	if (number.size() > 2 && number[0] == '0' && (number[1] == 'x' || number[1] == 'X')) {
+		number.remove_prefix(2);
+		base = 16;
+	}
+	uint32_t address = 0;
+	auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), address, base);
+	if (ec == std::errc() && end == number.data() + number.size() && !number.empty()) {
+		if (address >= dataSize) {
+			error = "address out of range";
+			return false;
+		}
+		Add((uint16_t)address, 1, kinds, location);
+		return true;
+	}
+
+	const DebugInfo::SymbolTable& objects = debug_info.GetObjects();
+	const uint32_t symbol = objects.Find(location);
+	if (symbol == DebugInfo::NoSymbol) {
+		error = "unknown location";
+		return false;
+	}
+	const uint32_t start = objects.GetAddress(symbol);
+	const uint32_t size = std::max(objects.GetSize(symbol), 1u);
+	if (start >= dataSize || size > dataSize - start) {
+		error = "symbol outside the data space";
+		return false;
+	}
+	Add((uint16_t)start, (uint16_t)size, kinds, location);
+	return true;
+}
+
+void Watchpoints::Resize(uint32_t dataSize) {
+	std::lock_guard lock(mutex);
+	this->dataSize = dataSize;
+	watchpoints.clear();
+	hasLastHit = false;
+	UpdatePages();
+}
+
+void Watchpoints::Add(uint16_t address, uint16_t size, uint8_t kinds, std::string_view name) {
+	std::lock_guard lock(mutex);
+	watchpoint_t watchpoint;
+	watchpoint.address = address;
+	watchpoint.size = size;
+	watchpoint.kinds = kinds;
+	watchpoint.name = name;
+	watchpoints.push_back(std::move(watchpoint));
+	UpdatePages();
+}
+
+void Watchpoints::Remove(size_t index) {
+	std::lock_guard lock(mutex);
+	if (index < watchpoints.size())
+		watchpoints.erase(watchpoints.begin() + index);
+	UpdatePages();
+}
+
+void Watchpoints::SetEnabled(size_t index, bool enabled) {
+	std::lock_guard lock(mutex);
+	if (index < watchpoints.size())
+		watchpoints[index].enabled = enabled;
+	UpdatePages();
+}
+
+void Watchpoints::SetKinds(size_t index, uint8_t kinds) {
+	std::lock_guard lock(mutex);
+	if (index < watchpoints.size())
+		watchpoints[index].kinds = kinds;
+}
+
+void Watchpoints::Clear() {
+	std::lock_guard lock(mutex);
+	watchpoints.clear();
+	hasLastHit = false;
+	UpdatePages();
+}
+
+void Watchpoints::GetAll(std::vector<watchpoint_t>& watchpoints) const {
+	std::lock_guard lock(mutex);
+	watchpoints = this->watchpoints;
+}
+
+bool Watchpoints::GetLastHit(hit_t& hit) const {
+	std::lock_guard lock(mutex);
+	hit = lastHit;
+	return hasLastHit;
+}
+
+void Watchpoints::ResetLastHit() {
+	std::lock_guard lock(mutex);
+	hasLastHit = false;
+}
+
+void Watchpoints::UpdatePages() {
+	// rebuilt from scratch, there are only a handful of watchpoints
+	uint64_t bits[c_pages / 64] = {};
+	uint32_t active = 0;
+	for (const watchpoint_t& watchpoint : watchpoints) {
+		if (!watchpoint.enabled)
+			continue;
+		active++;
+		const uint32_t last = (watchpoint.address + watchpoint.size - 1u) / c_page_size;
+		for (uint32_t page = watchpoint.address / c_page_size; page <= last && page < c_pages; page++)
+			bits[page / 64] |= 1ull << (page % 64);
+	}
+	for (uint32_t i = 0; i < c_pages / 64; i++)
+		pages[i].store(bits[i], std::memory_order_relaxed);
+	activeCount.store(active, std::memory_order_relaxed);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "AvrDecoder.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DebugInfo;
+
+// data watchpoints on sram and io addresses. the data space is split into pages, the run loop only looks up the
+// watchpoints of an access if its page has one, every other access takes the fast path after a bit test.
+// hits stop the run after the accessing instruction
+class Watchpoints
+{
+public:
+	static constexpr uint32_t c_page_size = 64;
+	static constexpr uint32_t c_pages = 0x10000 / c_page_size;
+
+	enum Kind : uint8_t
+	{
+		Read = 1 << 0,
+		Write = 1 << 1,
+		Change = 1 << 2, // writes that change the value
+	};
+
+	struct watchpoint_t
+	{
+		uint16_t address;
+		uint16_t size = 1;
+		uint8_t kinds = Write;
+		bool enabled = true;
+		uint64_t hits = 0;
+		std::string name; // what it was set on, for display
+	};
+
+	struct hit_t
+	{
+		uint32_t pc; // word address of the accessing instruction
+		uint16_t address;
+		uint8_t kind; // Read, Write or Change
+		uint8_t oldValue;
+		uint8_t newValue;
+	};
+
+	bool Any() const { return activeCount.load(std::memory_order_relaxed) != 0; }
+	// true if any of the accesses touches a page with a watchpoint
+	bool IsWatched(const data_access_t* accesses, int count) const {
+		for (int i = 0; i < count; i++) {
+			const uint32_t first = accesses[i].address / c_page_size;
+			const uint32_t last = (accesses[i].address + accesses[i].size - 1u) / c_page_size;
+			for (uint32_t page = first; page <= last && page < c_pages; page++)
+				if ((pages[page / 64].load(std::memory_order_relaxed) >> (page % 64)) & 1)
+					return true;
+		}
+		return false;
+	}
+	// slow path around an instruction with watched accesses: Before records the old values, After compares them
+	// and returns true if a watchpoint hit
+	void Before(uint32_t pc, const data_access_t* accesses, int count, const uint8_t* data);
+	bool After(const uint8_t* data);
+
+	// size of the data space, watchpoints have to lie inside it. clears all watchpoints (new program)
+	void Resize(uint32_t dataSize);
+	// location is a data symbol (watches all of it) or a data space address (hex with 0x, or decimal)
+	bool Add(std::string_view location, uint8_t kinds, const DebugInfo& debug_info, std::string& error);
+	void Add(uint16_t address, uint16_t size, uint8_t kinds, std::string_view name);
+	void Remove(size_t index);
+	void SetEnabled(size_t index, bool enabled);
+	void SetKinds(size_t index, uint8_t kinds);
+	void Clear();
+
+	void GetAll(std::vector<watchpoint_t>& watchpoints) const;
+	// the hit that stopped the last run, false if none did
+	bool GetLastHit(hit_t& hit) const;
+	void ResetLastHit();
+private:
+	void UpdatePages();
+
+	std::atomic<uint64_t> pages[c_pages / 64] = {};
+	std::atomic<uint32_t> activeCount = 0;
+	uint32_t dataSize = 0; // only changed while the emulator is stopped
+
+	mutable std::mutex mutex; // guards everything below
+	std::vector<watchpoint_t> watchpoints;
+	bool hasLastHit = false;
+	hit_t lastHit = {};
+
+	// armed by Before, only touched by the run thread
+	struct candidate_t
+	{
+		uint16_t address;
+		bool write;
+		uint8_t oldValue;
+	};
+	uint32_t armedPc = 0;
+	candidate_t candidates[4] = {};
+	int candidateCount = 0;
+};